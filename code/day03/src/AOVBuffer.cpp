@@ -0,0 +1,167 @@
+#include "AOVBuffer.h"
+#include "ImageIO.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace glm;
+
+static const char* s_AOVNames[AOVBuffer::Num_AOV_Types] =
+{
+	"depth", "normal", "albedo", "material_id", "object_id", "sample_count", "time"
+};
+
+static const int s_NumComponents[AOVBuffer::Num_AOV_Types] = { 1, 3, 3, 1, 1, 1, 1 };
+
+const int AOVBuffer::s_FirstPlanes[AOVBuffer::Num_AOV_Types] = { 0, 1, 4, 7, 8, 9, 10 };
+
+const char* AOVBuffer::GetName(AOV_Type type)
+{
+	return s_AOVNames[type];
+}
+
+int AOVBuffer::GetNumComponents(AOV_Type type)
+{
+	return s_NumComponents[type];
+}
+
+bool AOVBuffer::ParseTypeMask(const char* names, unsigned int &typeMask)
+{
+	typeMask = 0;
+
+	const string list(names);
+	size_t begin = 0;
+
+	while (begin <= list.size())
+	{
+		size_t end = list.find(',', begin);
+		if (end == string::npos)
+			end = list.size();
+
+		const string name = list.substr(begin, end - begin);
+		begin = end + 1;
+
+		if (name.empty())
+			continue;
+
+		if (name == "all")
+		{
+			typeMask |= (1 << Num_AOV_Types) - 1;
+			continue;
+		}
+
+		int ti = 0;
+		while (ti < Num_AOV_Types && name != s_AOVNames[ti])
+			++ti;
+
+		if (ti == Num_AOV_Types)
+		{
+			cerr << __FUNCTION__ << ": unknown AOV: " << name << endl;
+			return false;
+		}
+
+		typeMask |= (1 << ti);
+	}
+
+	return true;
+}
+
+void AOVBuffer::allocate(int width, int height, unsigned int typeMask)
+{
+	m_Width = width;
+	m_Height = height;
+	m_TypeMask = typeMask;
+
+	for (int ti = 0; ti < Num_AOV_Types; ++ti)
+	{
+		for (int ci = 0; ci < s_NumComponents[ti]; ++ci)
+		{
+			vector<float> &plane = m_Planes[s_FirstPlanes[ti] + ci];
+
+			if (has(AOV_Type(ti)))
+				plane.assign(width * height, 0.f);
+			else
+				vector<float>().swap(plane);
+		}
+	}
+}
+
+void AOVBuffer::addSample(int pixelIdx, int nSamples, const FirstHitAttributes &firstHit)
+{
+	// running means of the attributes that can be averaged, the others are kept from the first sample
+	const float invNumSamples = 1.f / nSamples;
+
+	if (has(Depth_AOV))
+	{
+		float &depth = getPlane(Depth_AOV)[pixelIdx];
+		depth += (firstHit.m_Depth - depth) * invNumSamples;
+	}
+
+	for (int ci = 0; ci < 3; ++ci)
+	{
+		if (has(Normal_AOV))
+		{
+			float &n = getPlane(Normal_AOV, ci)[pixelIdx];
+			n += (firstHit.m_Normal[ci] - n) * invNumSamples;
+		}
+
+		if (has(Albedo_AOV))
+		{
+			float &a = getPlane(Albedo_AOV, ci)[pixelIdx];
+			a += (firstHit.m_Albedo[ci] - a) * invNumSamples;
+		}
+	}
+
+	if (nSamples == 1)
+	{
+		if (has(Material_Id_AOV))
+			getPlane(Material_Id_AOV)[pixelIdx] = (float)firstHit.m_MaterialId;
+		if (has(Object_Id_AOV))
+			getPlane(Object_Id_AOV)[pixelIdx] = (float)firstHit.m_ObjectId;
+	}
+
+	if (has(Sample_Count_AOV))
+		getPlane(Sample_Count_AOV)[pixelIdx] = (float)nSamples;
+}
+
+void AOVBuffer::getImage(AOV_Type type, ImageRect<vec3> &image) const
+{
+	image.allocate(m_Width, m_Height);
+
+	const int nComponents = s_NumComponents[type];
+
+	for (int i = 0; i < m_Width * m_Height; ++i)
+	{
+		for (int ci = 0; ci < 3; ++ci)
+			image.getData()[i][ci] = getPlane(type, std::min(ci, nComponents - 1))[i];
+	}
+}
+
+bool AOVBuffer::saveImages(const char* colorFilename, unsigned int typeMask) const
+{
+	const string name(colorFilename);
+	const size_t dotPos = name.find_last_of('.');
+	const string stem = (dotPos == string::npos) ? name : name.substr(0, dotPos);
+	const string ext = (dotPos == string::npos) ? "" : name.substr(dotPos);
+
+	bool saved = true;
+
+	for (int ti = 0; ti < Num_AOV_Types; ++ti)
+	{
+		if (!has(AOV_Type(ti)) || !((typeMask >> ti) & 1))
+			continue;
+
+		ImageRect<vec3> image;
+		getImage(AOV_Type(ti), image);
+
+		const string filename = stem + "_" + s_AOVNames[ti] + ext;
+
+		if (SaveImage(filename.c_str(), image))
+			cerr << __FUNCTION__ << ": " << filename << " saved" << endl;
+		else
+			saved = false;
+	}
+
+	return saved;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ImageRect.h"
+#include "FirstHitAttributes.h"
+#include "glm/glm.hpp"
+#include <vector>
+#include <cassert>
+
+// arbitrary output variables: optional per-pixel channels that are rendered in the same pass as the color,
+// stored as structure of arrays (one float plane per component) and exported next to the color image
+class AOVBuffer
+{
+public:
+	enum AOV_Type
+	{
+		Depth_AOV,	// mean distance to the first hit (0 where the primary rays did not hit any geometry)
+		Normal_AOV,	// mean shading normal of the first hit
+		Albedo_AOV,	// mean albedo of the first hit
+		Material_Id_AOV,	// of the first hit of the first sample (-1: no hit)
+		Object_Id_AOV,	// index of the scene object hit first by the first sample (-1: no hit)
+		Sample_Count_AOV,
+		Time_AOV,	// microseconds spent on the samples of the pixel
+		Num_AOV_Types
+	};
+
+	// the guides of the denoiser
+	static const unsigned int Denoiser_AOV_Mask = (1 << Depth_AOV) | (1 << Normal_AOV) | (1 << Albedo_AOV);
+
+	static const char* GetName(AOV_Type type);	// also the suffix of the exported file
+	static int GetNumComponents(AOV_Type type);
+	// mask of the comma separated channel names ("all" selects every channel); false if a name is unknown
+	static bool ParseTypeMask(const char* names, unsigned int& typeMask);
+
+	AOVBuffer() : m_Width(0), m_Height(0), m_TypeMask(0) {}
+
+	void allocate(int width, int height, unsigned int typeMask);	// the channels of the mask are cleared, the others released
+	int getWidth() const { return m_Width; }
+	int getHeight() const { return m_Height; }
+	unsigned int getTypeMask() const { return m_TypeMask; }
+	bool has(AOV_Type type) const { return (m_TypeMask >> type) & 1; }
+
+	// the channel must be allocated
+	float* getPlane(AOV_Type type, int component = 0) { assert(has(type) && !m_Planes[s_FirstPlanes[type] + component].empty()); return &m_Planes[s_FirstPlanes[type] + component][0]; }
+	const float* getPlane(AOV_Type type, int component = 0) const { assert(has(type) && !m_Planes[s_FirstPlanes[type] + component].empty()); return &m_Planes[s_FirstPlanes[type] + component][0]; }
+
+	// nSamples: number of samples of the pixel, including this one
+	void addSample(int pixelIdx, int nSamples, const FirstHitAttributes& firstHit);
+	void addTime(int pixelIdx, float microseconds) { if (has(Time_AOV)) getPlane(Time_AOV)[pixelIdx] += microseconds; }
+
+	void getImage(AOV_Type type, ImageRect<glm::vec3>& image) const;	// scalar channels are replicated into RGB
+	// the channels of the mask as <colorFilename without extension>_<channel name>.<extension of colorFilename>
+	bool saveImages(const char* colorFilename, unsigned int typeMask) const;
+
+private:
+	enum { Num_Planes = 11 };
+	static const int s_FirstPlanes[Num_AOV_Types];
+
+	int m_Width, m_Height;
+	unsigned int m_TypeMask;
+	std::vector<float> m_Planes[Num_Planes];
+};
@@ -0,0 +1,56 @@
+#include "Arena.h"
+#include <cassert>
+#include <algorithm>
+
+using namespace std;
+
+int Arena::s_NumTypes = 0;
+
+void *Arena::allocate(size_t size, size_t alignment, int typeIndex)
+{
+	// operator new aligns the blocks for any fundamental type
+	assert(alignment <= alignof(max_align_t));
+
+	if ((int)m_Cursors.size() <= typeIndex)
+		m_Cursors.resize(typeIndex + 1);
+
+	Cursor &cursor = m_Cursors[typeIndex];
+
+	const size_t padding = (alignment - (size_t)cursor.m_pNext % alignment) % alignment;
+
+	if (!cursor.m_pNext || cursor.m_Remaining < padding + size)
+	{
+		// objects larger than a block get a block of their own
+		const size_t blockSize = std::max(m_BlockSize, size);
+
+		char *block = static_cast<char*>(::operator new(blockSize));
+		m_Blocks.push_back(block);
+
+		cursor.m_pNext = block;
+		cursor.m_Remaining = blockSize;
+	}
+	else
+	{
+		cursor.m_pNext += padding;
+		cursor.m_Remaining -= padding;
+	}
+
+	void *p = cursor.m_pNext;
+	cursor.m_pNext += size;
+	cursor.m_Remaining -= size;
+
+	return p;
+}
+
+void Arena::clear()
+{
+	for (int i = (int)m_Destructors.size() - 1; i >= 0; --i)
+		m_Destructors[i].first(m_Destructors[i].second);
+	m_Destructors.clear();
+
+	for (int i = 0; i < (int)m_Blocks.size(); ++i)
+		::operator delete(m_Blocks[i]);
+	m_Blocks.clear();
+
+	m_Cursors.clear();
+}
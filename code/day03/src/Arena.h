@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// bump allocator for the objects that live as long as a scene: each type is laid out contiguously in its own blocks,
+// and clear() releases all of them at once (after calling the registered destructors)
+class Arena
+{
+public:
+	Arena(size_t blockSize = 64 * 1024) : m_BlockSize(blockSize) {}
+	~Arena() { clear(); }
+
+	// uninitialized memory for an object of type T, constructed by the caller with placement new
+	template <class T>
+	void *allocate() { return allocate(sizeof(T), alignof(T), GetTypeIndex<T>()); }
+
+	// the destructor of obj is called by clear(), in the reverse order of the registrations (trivial ones are skipped);
+	// T must be the type the object was constructed as
+	template <class T>
+	void registerDestructor(T *obj)
+	{
+		if (!std::is_trivially_destructible<T>::value)
+			m_Destructors.push_back(Destructor(&Destroy<T>, obj));
+	}
+
+	void clear();
+
+	size_t getNumDestructors() const { return m_Destructors.size(); }
+	size_t getNumBlocks() const { return m_Blocks.size(); }
+
+private:
+	struct Cursor
+	{
+		char *m_pNext;
+		size_t m_Remaining;
+
+		Cursor() : m_pNext(0), m_Remaining(0) {}
+	};
+
+	typedef std::pair<void (*)(void*), void*> Destructor;
+
+	size_t m_BlockSize;
+	std::vector<void*> m_Blocks;
+	std::vector<Cursor> m_Cursors;	// the current block of each type
+	std::vector<Destructor> m_Destructors;
+
+	void *allocate(size_t size, size_t alignment, int typeIndex);
+
+	template <class T>
+	static void Destroy(void *obj) { static_cast<T*>(obj)->~T(); }
+
+	// a small number per type, shared by all arenas
+	static int s_NumTypes;
+
+	template <class T>
+	static int GetTypeIndex()
+	{
+		static const int typeIndex = s_NumTypes++;
+		return typeIndex;
+	}
+
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+};
@@ -0,0 +1,808 @@
+#include "BVH.h"
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+
+using namespace std;
+using namespace glm;
+
+int BVH::s_MaxLeafSize = 4;
+float BVH::s_TraversalCost = 1.f;
+float BVH::s_MaxRefitCostRatio = 1.5f;
+int BVH::s_NumBins = 16;
+
+// beyond this depth nodes are split at the median, which halves the primitive count at every level:
+// fewer than 2^31 primitives add at most 31 levels, and the traversal stack holds one node per level
+static const int s_MaxBuildDepth = 48;
+static const int s_TraversalStackSize = s_MaxBuildDepth + 32;
+
+static inline float surfaceArea(const vec3 &bboxMin, const vec3 &bboxMax)
+{
+	const vec3 d = glm::max(bboxMax - bboxMin, vec3(0.f));
+	return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static inline bool intersectBoundingBox(const BVHNode &node, const vec3 &origin, const vec3 &invDir, float tmin, float tmax)
+{
+	const vec3 t0 = (node.m_BoundingBoxMin - origin) * invDir;
+	const vec3 t1 = (node.m_BoundingBoxMax - origin) * invDir;
+	const vec3 tNear = glm::min(t0, t1);
+	const vec3 tFar = glm::max(t0, t1);
+
+	const float tEnter = std::max(tmin, std::max(tNear.x, std::max(tNear.y, tNear.z)));
+	const float tExit = std::min(tmax, std::min(tFar.x, std::min(tFar.y, tFar.z)));
+
+	return tEnter <= tExit;
+}
+
+// returns the mask of the active lanes whose ray overlaps the node's box before their current closest hit
+static inline int intersectBoundingBoxPacket(const BVHNode &node, const RayPacket &packet, float tmin, const float *tmax, int activeMask)
+{
+	int hitMask = 0;
+
+#pragma omp simd reduction(|:hitMask)
+	for (int lane = 0; lane < RayPacket::Width; ++lane)
+	{
+		const float tx0 = (node.m_BoundingBoxMin.x - packet.m_OriginX[lane]) * packet.m_InvDirX[lane];
+		const float tx1 = (node.m_BoundingBoxMax.x - packet.m_OriginX[lane]) * packet.m_InvDirX[lane];
+		const float ty0 = (node.m_BoundingBoxMin.y - packet.m_OriginY[lane]) * packet.m_InvDirY[lane];
+		const float ty1 = (node.m_BoundingBoxMax.y - packet.m_OriginY[lane]) * packet.m_InvDirY[lane];
+		const float tz0 = (node.m_BoundingBoxMin.z - packet.m_OriginZ[lane]) * packet.m_InvDirZ[lane];
+		const float tz1 = (node.m_BoundingBoxMax.z - packet.m_OriginZ[lane]) * packet.m_InvDirZ[lane];
+
+		const float tEnter = std::max(tmin, std::max(std::min(tx0, tx1), std::max(std::min(ty0, ty1), std::min(tz0, tz1))));
+		const float tExit = std::min(tmax[lane], std::min(std::max(tx0, tx1), std::min(std::max(ty0, ty1), std::max(tz0, tz1))));
+
+		hitMask |= (tEnter <= tExit ? 1 : 0) << lane;
+	}
+
+	return hitMask & activeMask;
+}
+
+void BVH::clear()
+{
+	m_Nodes.clear();
+	m_Primitives.clear();
+	m_Objects.clear();
+	m_LeafNodes.clear();
+	m_InteriorNodesByDepth.clear();
+	m_BuildCostRatio = 0.f;
+}
+
+// spreads the lower 10 bits of v to every third bit
+static inline unsigned int expandBits(unsigned int v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+// 30-bit code of a point in the unit cube
+static inline unsigned int mortonCode(const vec3 &p)
+{
+	const vec3 q = glm::clamp(p * 1024.f, vec3(0.f), vec3(1023.f));
+	return (expandBits((unsigned int)q.x) << 2) | (expandBits((unsigned int)q.y) << 1) | expandBits((unsigned int)q.z);
+}
+
+// merge sort whose halves are sorted by tasks, down to depth levels
+template <class T, class Compare>
+static void parallelSort(T *first, T *last, int depth, Compare comp)
+{
+	if (depth <= 0 || last - first < 4096)
+	{
+		std::sort(first, last, comp);
+		return;
+	}
+
+	T *middle = first + (last - first) / 2;
+
+#pragma omp task
+	parallelSort(first, middle, depth - 1, comp);
+
+	parallelSort(middle, last, depth - 1, comp);
+
+#pragma omp taskwait
+
+	std::inplace_merge(first, middle, last, comp);
+}
+
+void BVH::build(const vector<GeometricObject*> &objects)
+{
+	clear();
+
+	m_Objects = objects;
+
+	const auto tStart = chrono::steady_clock::now();
+
+	vector<int> entryOffsets(objects.size() + 1, 0);
+	for (int oi = 0; oi < (int)objects.size(); ++oi)
+		entryOffsets[oi + 1] = entryOffsets[oi] + objects[oi]->getNumPrimitives();
+
+	const int nEntries = entryOffsets.back();
+
+	if (nEntries == 0)
+		return;
+
+	BuildContext ctx;
+	ctx.m_Entries.resize(nEntries);
+
+	for (int oi = 0; oi < (int)objects.size(); ++oi)
+	{
+		const int nPrimitives = objects[oi]->getNumPrimitives();
+
+#pragma omp parallel for if (nPrimitives >= 4096)
+		for (int pi = 0; pi < nPrimitives; ++pi)
+		{
+			BuildEntry &e = ctx.m_Entries[entryOffsets[oi] + pi];
+			e.m_BoundingBoxMin = objects[oi]->getPrimitiveBoundingBoxMin(pi);
+			e.m_BoundingBoxMax = objects[oi]->getPrimitiveBoundingBoxMax(pi);
+			e.m_Centroid = 0.5f * (e.m_BoundingBoxMin + e.m_BoundingBoxMax);
+			e.m_Ref.m_ObjectIdx = oi;
+			e.m_Ref.m_PrimitiveIdx = pi;
+		}
+	}
+
+	// Morton order, so that the primitives close in space stay close in memory through the partitions and in the leaves
+
+	vec3 centroidMin(1.0e+30f), centroidMax(-1.0e+30f);
+	for (int i = 0; i < nEntries; ++i)
+	{
+		centroidMin = glm::min(centroidMin, ctx.m_Entries[i].m_Centroid);
+		centroidMax = glm::max(centroidMax, ctx.m_Entries[i].m_Centroid);
+	}
+
+	const vec3 invCentroidExtent = 1.f / glm::max(centroidMax - centroidMin, vec3(1.0e-20f));
+
+#pragma omp parallel for if (nEntries >= 4096)
+	for (int i = 0; i < nEntries; ++i)
+		ctx.m_Entries[i].m_MortonCode = mortonCode((ctx.m_Entries[i].m_Centroid - centroidMin) * invCentroidExtent);
+
+	// a node per entry and one less, at most
+	ctx.m_Nodes.resize(2 * nEntries - 1);
+	ctx.m_NumNodes = 1;
+
+#pragma omp parallel if (nEntries >= 4096)
+	{
+#pragma omp single
+		{
+			parallelSort(&ctx.m_Entries[0], &ctx.m_Entries[0] + nEntries, 8,
+				[](const BuildEntry &a, const BuildEntry &b) { return a.m_MortonCode < b.m_MortonCode; });
+
+			BuildRec(&ctx, 0, 0, nEntries, 0, ComputeBounds(ctx, 0, nEntries));
+		}
+	}
+
+	// depth-first order; the leaves reference the entries in the same order
+	m_Nodes.reserve(ctx.m_NumNodes);
+	flatten(ctx, 0);
+
+	m_Primitives.resize(nEntries);
+	for (int i = 0; i < nEntries; ++i)
+		m_Primitives[i] = ctx.m_Entries[i].m_Ref;
+
+	buildRefitOrder();
+
+	float primitiveArea = 0.f;
+	for (int i = 0; i < nEntries; ++i)
+		primitiveArea += surfaceArea(ctx.m_Entries[i].m_BoundingBoxMin, ctx.m_Entries[i].m_BoundingBoxMax);
+
+	m_BuildCostRatio = getNodeAreaCost() / std::max(primitiveArea, 1.0e-20f);
+
+	const auto tEnd = chrono::steady_clock::now();
+
+	cerr << __FUNCTION__ << ": " << m_Primitives.size() << " primitives, " << m_Nodes.size() << " nodes in "
+		<< chrono::duration<float, milli>(tEnd - tStart).count() << " ms" << endl;
+}
+
+// primitive bounds and counts in the bins of the centroids along each axis
+struct SAHBins
+{
+	int m_Counts[3][BVH::Max_Bins];
+	vec3 m_Min[3][BVH::Max_Bins];
+	vec3 m_Max[3][BVH::Max_Bins];
+
+	void init(int nBins)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (int bi = 0; bi < nBins; ++bi)
+			{
+				m_Counts[axis][bi] = 0;
+				m_Min[axis][bi] = vec3(1.0e+30f);
+				m_Max[axis][bi] = vec3(-1.0e+30f);
+			}
+		}
+	}
+
+	inline void add(const ivec3 &bins, const vec3 &bboxMin, const vec3 &bboxMax)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			++m_Counts[axis][bins[axis]];
+			m_Min[axis][bins[axis]] = glm::min(m_Min[axis][bins[axis]], bboxMin);
+			m_Max[axis][bins[axis]] = glm::max(m_Max[axis][bins[axis]], bboxMax);
+		}
+	}
+
+	void merge(const SAHBins &b, int nBins)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (int bi = 0; bi < nBins; ++bi)
+			{
+				m_Counts[axis][bi] += b.m_Counts[axis][bi];
+				m_Min[axis][bi] = glm::min(m_Min[axis][bi], b.m_Min[axis][bi]);
+				m_Max[axis][bi] = glm::max(m_Max[axis][bi], b.m_Max[axis][bi]);
+			}
+		}
+	}
+};
+
+// the entries of larger nodes are binned in chunks by tasks
+static const int s_ParallelBinningSize = 65536;
+static const int s_BinningChunkSize = 16384;
+
+// subtrees of fewer entries are built by the task of their parent
+static const int s_MinTaskSize = 4096;
+
+BVH::BuildBounds BVH::ComputeBounds(const BuildContext &ctx, int begin, int end)
+{
+	BuildBounds bounds;
+	bounds.m_Min = bounds.m_CentroidMin = vec3(1.0e+30f);
+	bounds.m_Max = bounds.m_CentroidMax = vec3(-1.0e+30f);
+
+	for (int i = begin; i < end; ++i)
+	{
+		const BuildEntry &e = ctx.m_Entries[i];
+		bounds.m_Min = glm::min(bounds.m_Min, e.m_BoundingBoxMin);
+		bounds.m_Max = glm::max(bounds.m_Max, e.m_BoundingBoxMax);
+		bounds.m_CentroidMin = glm::min(bounds.m_CentroidMin, e.m_Centroid);
+		bounds.m_CentroidMax = glm::max(bounds.m_CentroidMax, e.m_Centroid);
+	}
+
+	return bounds;
+}
+
+void BVH::BuildRec(BuildContext *ctx, int nodeIdx, int begin, int end, int depth, BuildBounds bounds)
+{
+	vector<BuildEntry> &entries = ctx->m_Entries;
+	BVHNode &node = ctx->m_Nodes[nodeIdx].m_Node;
+
+	node.m_BoundingBoxMin = bounds.m_Min;
+	node.m_BoundingBoxMax = bounds.m_Max;
+
+	const int n = end - begin;
+	const vec3 centroidMin = bounds.m_CentroidMin;
+	const vec3 centroidExtent = bounds.m_CentroidMax - bounds.m_CentroidMin;
+	const bool isDegenerate = (centroidExtent.x <= 0.f && centroidExtent.y <= 0.f && centroidExtent.z <= 0.f);
+
+	int bestAxis = 0;
+	int bestSplit = begin + n / 2;
+	float bestCost = 1.0e+30f;
+
+	// of the children, unless computed by the split
+	bool hasChildBounds = false;
+	BuildBounds leftBounds, rightBounds;
+
+	if (n > 1 && !isDegenerate && depth < s_MaxBuildDepth)
+	{
+		// SAH over the bins of the centroids along each axis; a few entries need no more bins than themselves
+		const int nBins = std::max(2, std::min(std::min(s_NumBins, (int)Max_Bins), n));
+		const vec3 binScale = (float)nBins * 0.9999f / glm::max(centroidExtent, vec3(1.0e-20f));
+
+		SAHBins bins;
+		bins.init(nBins);
+
+		if (n >= s_ParallelBinningSize)
+		{
+			const int nChunks = (n + s_BinningChunkSize - 1) / s_BinningChunkSize;
+			vector<SAHBins> chunkBins(nChunks);
+
+			for (int ci = 0; ci < nChunks; ++ci)
+			{
+				// through ctx: a reference to the entries would be privatized into a copy of them
+#pragma omp task shared(chunkBins)
+				{
+					const vector<BuildEntry> &chunkEntries = ctx->m_Entries;
+					SAHBins &cb = chunkBins[ci];
+					cb.init(nBins);
+
+					const int chunkEnd = std::min(begin + (ci + 1) * s_BinningChunkSize, end);
+					for (int i = begin + ci * s_BinningChunkSize; i < chunkEnd; ++i)
+						cb.add(glm::min(ivec3((chunkEntries[i].m_Centroid - centroidMin) * binScale), ivec3(nBins - 1)), chunkEntries[i].m_BoundingBoxMin, chunkEntries[i].m_BoundingBoxMax);
+				}
+			}
+
+#pragma omp taskwait
+
+			for (int ci = 0; ci < nChunks; ++ci)
+				bins.merge(chunkBins[ci], nBins);
+		}
+		else
+		{
+			for (int i = begin; i < end; ++i)
+				bins.add(glm::min(ivec3((entries[i].m_Centroid - centroidMin) * binScale), ivec3(nBins - 1)), entries[i].m_BoundingBoxMin, entries[i].m_BoundingBoxMax);
+		}
+
+		const float invParentArea = 1.f / std::max(surfaceArea(bounds.m_Min, bounds.m_Max), 1.0e-20f);
+		int bestBin = 0;
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (centroidExtent[axis] <= 0.f)
+				continue;
+
+			// splitting between the bins bi - 1 and bi
+			float rightCosts[Max_Bins];
+			vec3 rMin(1.0e+30f), rMax(-1.0e+30f);
+			int nRight = 0;
+
+			for (int bi = nBins - 1; bi > 0; --bi)
+			{
+				rMin = glm::min(rMin, bins.m_Min[axis][bi]);
+				rMax = glm::max(rMax, bins.m_Max[axis][bi]);
+				nRight += bins.m_Counts[axis][bi];
+				rightCosts[bi] = surfaceArea(rMin, rMax) * nRight;
+			}
+
+			vec3 lMin(1.0e+30f), lMax(-1.0e+30f);
+			int nLeft = 0;
+
+			for (int bi = 1; bi < nBins; ++bi)
+			{
+				lMin = glm::min(lMin, bins.m_Min[axis][bi - 1]);
+				lMax = glm::max(lMax, bins.m_Max[axis][bi - 1]);
+				nLeft += bins.m_Counts[axis][bi - 1];
+
+				if (nLeft == 0 || nLeft == n)
+					continue;
+
+				const float cost = s_TraversalCost + (surfaceArea(lMin, lMax) * nLeft + rightCosts[bi]) * invParentArea;
+
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bi;
+
+					leftBounds.m_Min = lMin;
+					leftBounds.m_Max = lMax;
+				}
+			}
+		}
+
+		if (bestCost < 1.0e+30f)
+		{
+			rightBounds.m_Min = vec3(1.0e+30f);
+			rightBounds.m_Max = vec3(-1.0e+30f);
+
+			for (int bi = bestBin; bi < nBins; ++bi)
+			{
+				rightBounds.m_Min = glm::min(rightBounds.m_Min, bins.m_Min[bestAxis][bi]);
+				rightBounds.m_Max = glm::max(rightBounds.m_Max, bins.m_Max[bestAxis][bi]);
+			}
+
+			// partition, collecting the centroid bounds of both sides
+			leftBounds.m_CentroidMin = rightBounds.m_CentroidMin = vec3(1.0e+30f);
+			leftBounds.m_CentroidMax = rightBounds.m_CentroidMax = vec3(-1.0e+30f);
+
+			const float splitMin = centroidMin[bestAxis];
+			const float splitScale = binScale[bestAxis];
+			auto isLeft = [=](const BuildEntry &e) { return std::min((int)((e.m_Centroid[bestAxis] - splitMin) * splitScale), nBins - 1) < bestBin; };
+
+			int i = begin, j = end;
+
+			while (true)
+			{
+				for (; i < j && isLeft(entries[i]); ++i)
+				{
+					leftBounds.m_CentroidMin = glm::min(leftBounds.m_CentroidMin, entries[i].m_Centroid);
+					leftBounds.m_CentroidMax = glm::max(leftBounds.m_CentroidMax, entries[i].m_Centroid);
+				}
+
+				for (; i < j && !isLeft(entries[j - 1]); --j)
+				{
+					rightBounds.m_CentroidMin = glm::min(rightBounds.m_CentroidMin, entries[j - 1].m_Centroid);
+					rightBounds.m_CentroidMax = glm::max(rightBounds.m_CentroidMax, entries[j - 1].m_Centroid);
+				}
+
+				if (i >= j)
+					break;
+
+				std::swap(entries[i], entries[j - 1]);
+			}
+
+			bestSplit = i;
+			hasChildBounds = true;
+		}
+	}
+	else if (n > 1 && !isDegenerate)
+	{
+		// too deep: median split along the largest centroid extent
+		bestAxis = (centroidExtent.x > centroidExtent.y && centroidExtent.x > centroidExtent.z) ? 0 : (centroidExtent.y > centroidExtent.z ? 1 : 2);
+		std::nth_element(entries.begin() + begin, entries.begin() + bestSplit, entries.begin() + end,
+			[bestAxis](const BuildEntry &a, const BuildEntry &b) { return a.m_Centroid[bestAxis] < b.m_Centroid[bestAxis]; });
+		bestCost = 0.f;
+	}
+
+	// leaf cost equals the number of intersection tests
+	const bool makeLeaf = (n == 1) || (n <= s_MaxLeafSize && bestCost >= (float)n) || (isDegenerate && n <= 0xffff);
+
+	if (makeLeaf)
+	{
+		node.m_Offset = begin;
+		node.m_NumPrimitives = (unsigned short)n;
+		node.m_SplitAxis = 0;
+		return;
+	}
+
+	node.m_NumPrimitives = 0;
+	node.m_SplitAxis = (unsigned short)bestAxis;
+
+	if (!hasChildBounds)
+	{
+		leftBounds = ComputeBounds(*ctx, begin, bestSplit);
+		rightBounds = ComputeBounds(*ctx, bestSplit, end);
+	}
+
+	const int leftIdx = ctx->m_NumNodes.fetch_add(2);
+	ctx->m_Nodes[nodeIdx].m_Children[0] = leftIdx;
+	ctx->m_Nodes[nodeIdx].m_Children[1] = leftIdx + 1;
+
+#pragma omp task if (bestSplit - begin >= s_MinTaskSize)
+	BuildRec(ctx, leftIdx, begin, bestSplit, depth + 1, leftBounds);
+
+	BuildRec(ctx, leftIdx + 1, bestSplit, end, depth + 1, rightBounds);
+}
+
+int BVH::flatten(const BuildContext &ctx, int buildNodeIdx)
+{
+	const BuildNode &buildNode = ctx.m_Nodes[buildNodeIdx];
+
+	const int nodeIdx = (int)m_Nodes.size();
+	m_Nodes.push_back(buildNode.m_Node);
+
+	if (!buildNode.m_Node.isLeaf())
+	{
+		flatten(ctx, buildNode.m_Children[0]);
+		m_Nodes[nodeIdx].m_Offset = flatten(ctx, buildNode.m_Children[1]);
+	}
+
+	return nodeIdx;
+}
+
+void BVH::buildRefitOrder()
+{
+	m_LeafNodes.clear();
+	m_InteriorNodesByDepth.clear();
+
+	// the children follow their parent in the depth-first order, so the depths are known when they are reached
+	vector<int> depths(m_Nodes.size(), 0);
+
+	for (int ni = 0; ni < (int)m_Nodes.size(); ++ni)
+	{
+		if (m_Nodes[ni].isLeaf())
+		{
+			m_LeafNodes.push_back(ni);
+			continue;
+		}
+
+		depths[ni + 1] = depths[m_Nodes[ni].m_Offset] = depths[ni] + 1;
+
+		if ((int)m_InteriorNodesByDepth.size() <= depths[ni])
+			m_InteriorNodesByDepth.resize(depths[ni] + 1);
+		m_InteriorNodesByDepth[depths[ni]].push_back(ni);
+	}
+}
+
+bool BVH::refit()
+{
+	if (m_Nodes.empty())
+		return false;
+
+	// the refs of the leaves are only valid for the same primitives
+	size_t nPrimitives = 0;
+	for (int oi = 0; oi < (int)m_Objects.size(); ++oi)
+		nPrimitives += m_Objects[oi]->getNumPrimitives();
+
+	if (nPrimitives != m_Primitives.size())
+		return false;
+
+	const auto tStart = chrono::steady_clock::now();
+
+	const int nLeaves = (int)m_LeafNodes.size();
+	float primitiveArea = 0.f;
+
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:primitiveArea)
+	for (int li = 0; li < nLeaves; ++li)
+	{
+		BVHNode &node = m_Nodes[m_LeafNodes[li]];
+
+		vec3 bboxMin(1.0e+30f), bboxMax(-1.0e+30f);
+
+		for (int i = 0; i < node.m_NumPrimitives; ++i)
+		{
+			const PrimitiveRef &ref = m_Primitives[node.m_Offset + i];
+			const vec3 primMin = m_Objects[ref.m_ObjectIdx]->getPrimitiveBoundingBoxMin(ref.m_PrimitiveIdx);
+			const vec3 primMax = m_Objects[ref.m_ObjectIdx]->getPrimitiveBoundingBoxMax(ref.m_PrimitiveIdx);
+
+			bboxMin = glm::min(bboxMin, primMin);
+			bboxMax = glm::max(bboxMax, primMax);
+			primitiveArea += surfaceArea(primMin, primMax);
+		}
+
+		node.m_BoundingBoxMin = bboxMin;
+		node.m_BoundingBoxMax = bboxMax;
+	}
+
+	// deepest first: the children of the nodes of one depth are all done
+	for (int di = (int)m_InteriorNodesByDepth.size() - 1; di >= 0; --di)
+	{
+		const vector<int> &nodes = m_InteriorNodesByDepth[di];
+		const int n = (int)nodes.size();
+
+#pragma omp parallel for schedule(static) if (n >= 1024)
+		for (int i = 0; i < n; ++i)
+		{
+			BVHNode &node = m_Nodes[nodes[i]];
+			const BVHNode &left = m_Nodes[nodes[i] + 1];
+			const BVHNode &right = m_Nodes[node.m_Offset];
+
+			node.m_BoundingBoxMin = glm::min(left.m_BoundingBoxMin, right.m_BoundingBoxMin);
+			node.m_BoundingBoxMax = glm::max(left.m_BoundingBoxMax, right.m_BoundingBoxMax);
+		}
+	}
+
+	const float costRatio = getNodeAreaCost() / std::max(primitiveArea, 1.0e-20f);
+	const auto tEnd = chrono::steady_clock::now();
+
+	if (costRatio > s_MaxRefitCostRatio * m_BuildCostRatio)
+	{
+		cerr << __FUNCTION__ << ": SAH cost ratio " << m_BuildCostRatio << " -> " << costRatio << " after "
+			<< chrono::duration<float, milli>(tEnd - tStart).count() << " ms, to be rebuilt" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+float BVH::getSAHCost() const
+{
+	if (m_Nodes.empty())
+		return 0.f;
+
+	return getNodeAreaCost() / std::max(surfaceArea(m_Nodes[0].m_BoundingBoxMin, m_Nodes[0].m_BoundingBoxMax), 1.0e-20f);
+}
+
+float BVH::getNodeAreaCost() const
+{
+	const int nNodes = (int)m_Nodes.size();
+
+	double cost = 0.0;	// the sum over millions of nodes would depend on the number of threads in float
+
+#pragma omp parallel for reduction(+:cost) if (nNodes >= 4096)
+	for (int ni = 0; ni < nNodes; ++ni)
+	{
+		const BVHNode &node = m_Nodes[ni];
+		cost += surfaceArea(node.m_BoundingBoxMin, node.m_BoundingBoxMax) * (node.isLeaf() ? (float)node.m_NumPrimitives : s_TraversalCost);
+	}
+
+	return (float)cost;
+}
+
+bool BVH::hit(const Ray &r, float tmin, float tmax, HitRecord &record) const
+{
+	if (m_Nodes.empty())
+		return false;
+
+	const vec3 origin = r.getOrigin();
+	const vec3 dir = r.getUnitDir();
+	const vec3 invDir(1.f / dir.x, 1.f / dir.y, 1.f / dir.z);
+	const bool dirIsNeg[3] = { dir.x < 0.f, dir.y < 0.f, dir.z < 0.f };
+
+	int stack[s_TraversalStackSize];
+	int stackSize = 0;
+	int nodeIdx = 0;
+
+	float tClosest = tmax;
+	bool hitPrimitive = false;
+
+	while (true)
+	{
+		const BVHNode &node = m_Nodes[nodeIdx];
+
+		if (intersectBoundingBox(node, origin, invDir, tmin, tClosest))
+		{
+			if (node.isLeaf())
+			{
+				for (int i = 0; i < node.m_NumPrimitives; ++i)
+				{
+					const PrimitiveRef &ref = m_Primitives[node.m_Offset + i];
+
+					HitRecord tmpRec;
+					if (m_Objects[ref.m_ObjectIdx]->hitPrimitive(ref.m_PrimitiveIdx, r, tmin, tClosest, tmpRec))
+					{
+						tClosest = tmpRec.m_ParamT;
+						record = tmpRec;
+						record.m_ObjectId = ref.m_ObjectIdx;
+						hitPrimitive = true;
+					}
+				}
+			}
+			else
+			{
+				// visit the nearer child first
+				if (dirIsNeg[node.m_SplitAxis])
+				{
+					assert(stackSize < s_TraversalStackSize);
+					stack[stackSize++] = nodeIdx + 1;
+					nodeIdx = node.m_Offset;
+				}
+				else
+				{
+					assert(stackSize < s_TraversalStackSize);
+					stack[stackSize++] = node.m_Offset;
+					nodeIdx = nodeIdx + 1;
+				}
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+
+		nodeIdx = stack[--stackSize];
+	}
+
+	return hitPrimitive;
+}
+
+bool BVH::shadowHit(const Ray &r, float tmin, float tmax) const
+{
+	if (m_Nodes.empty())
+		return false;
+
+	const vec3 origin = r.getOrigin();
+	const vec3 dir = r.getUnitDir();
+	const vec3 invDir(1.f / dir.x, 1.f / dir.y, 1.f / dir.z);
+	const bool dirIsNeg[3] = { dir.x < 0.f, dir.y < 0.f, dir.z < 0.f };
+
+	int stack[s_TraversalStackSize];
+	int stackSize = 0;
+	int nodeIdx = 0;
+
+	while (true)
+	{
+		const BVHNode &node = m_Nodes[nodeIdx];
+
+		if (intersectBoundingBox(node, origin, invDir, tmin, tmax))
+		{
+			if (node.isLeaf())
+			{
+				for (int i = 0; i < node.m_NumPrimitives; ++i)
+				{
+					const PrimitiveRef &ref = m_Primitives[node.m_Offset + i];
+
+					if (m_Objects[ref.m_ObjectIdx]->shadowHitPrimitive(ref.m_PrimitiveIdx, r, tmin, tmax))
+						return true;
+				}
+			}
+			else
+			{
+				// the order does not change the result, but the nearer child is more likely to contain an occluder
+				if (dirIsNeg[node.m_SplitAxis])
+				{
+					assert(stackSize < s_TraversalStackSize);
+					stack[stackSize++] = nodeIdx + 1;
+					nodeIdx = node.m_Offset;
+				}
+				else
+				{
+					assert(stackSize < s_TraversalStackSize);
+					stack[stackSize++] = node.m_Offset;
+					nodeIdx = nodeIdx + 1;
+				}
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+
+		nodeIdx = stack[--stackSize];
+	}
+
+	return false;
+}
+
+int BVH::hitPacket(const RayPacket &packet, int activeMask, float tmin, float tmax, HitRecord *records) const
+{
+	if (m_Nodes.empty() || !activeMask)
+		return 0;
+
+	float tClosest[RayPacket::Width];
+	int closestPrimitive[RayPacket::Width];
+
+	for (int lane = 0; lane < RayPacket::Width; ++lane)
+	{
+		tClosest[lane] = tmax;
+		closestPrimitive[lane] = -1;
+	}
+
+	// the traversal order follows the first active lane; the rays of a packet are expected to be coherent
+	int firstLane = 0;
+	while (!RayPacket::IsLaneActive(activeMask, firstLane))
+		++firstLane;
+
+	const bool dirIsNeg[3] = { packet.m_DirX[firstLane] < 0.f, packet.m_DirY[firstLane] < 0.f, packet.m_DirZ[firstLane] < 0.f };
+
+	int stack[s_TraversalStackSize];
+	int stackSize = 0;
+	int nodeIdx = 0;
+
+	while (true)
+	{
+		const BVHNode &node = m_Nodes[nodeIdx];
+
+		if (intersectBoundingBoxPacket(node, packet, tmin, tClosest, activeMask))
+		{
+			if (node.isLeaf())
+			{
+				for (int i = 0; i < node.m_NumPrimitives; ++i)
+				{
+					const PrimitiveRef &ref = m_Primitives[node.m_Offset + i];
+					const int hitMask = m_Objects[ref.m_ObjectIdx]->hitPrimitivePacket(ref.m_PrimitiveIdx, packet, tmin, tClosest, activeMask);
+
+					for (int lane = 0; lane < RayPacket::Width; ++lane)
+					{
+						if (RayPacket::IsLaneActive(hitMask, lane))
+							closestPrimitive[lane] = node.m_Offset + i;
+					}
+				}
+			}
+			else
+			{
+				if (dirIsNeg[node.m_SplitAxis])
+				{
+					assert(stackSize < s_TraversalStackSize);
+					stack[stackSize++] = nodeIdx + 1;
+					nodeIdx = node.m_Offset;
+				}
+				else
+				{
+					assert(stackSize < s_TraversalStackSize);
+					stack[stackSize++] = node.m_Offset;
+					nodeIdx = nodeIdx + 1;
+				}
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+
+		nodeIdx = stack[--stackSize];
+	}
+
+	// hit attributes are computed only once per lane, for the closest primitive
+	int hitMask = 0;
+
+	for (int lane = 0; lane < RayPacket::Width; ++lane)
+	{
+		if (closestPrimitive[lane] < 0)
+			continue;
+
+		const PrimitiveRef &ref = m_Primitives[closestPrimitive[lane]];
+
+		if (m_Objects[ref.m_ObjectIdx]->hitPrimitive(ref.m_PrimitiveIdx, packet.getRay(lane), tmin, tmax, records[lane]))
+		{
+			records[lane].m_ObjectId = ref.m_ObjectIdx;
+			hitMask |= (1 << lane);
+		}
+	}
+
+	return hitMask;
+}
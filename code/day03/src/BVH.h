@@ -0,0 +1,114 @@
+#pragma once
+
+#include "GeometricObject.h"
+#include "HitRecord.h"
+#include "Ray.h"
+#include <vector>
+#include <atomic>
+
+// node of a flattened binary BVH (32 bytes)
+// nodes are stored in depth-first order, so the first child of an interior node is always the next node
+struct BVHNode
+{
+	glm::vec3 m_BoundingBoxMin;
+	int m_Offset;	// index of the first primitive (leaf) or of the second child (interior node)
+	glm::vec3 m_BoundingBoxMax;
+	unsigned short m_NumPrimitives;	// 0 for interior nodes
+	unsigned short m_SplitAxis;
+
+	inline bool isLeaf() const { return m_NumPrimitives > 0; }
+};
+
+// bounding volume hierarchy over the primitives of a set of geometric objects,
+// built with the surface area heuristic (SAH) and traversed without recursion;
+// the primitives are sorted along a Morton curve, then split by the SAH over bins of centroids, the subtrees in parallel as OpenMP tasks
+class BVH
+{
+public:
+	static int s_MaxLeafSize;
+	static int s_NumBins;	// per axis, for the SAH (2 to Max_Bins)
+	static const int Max_Bins = 32;
+	static float s_TraversalCost;	// relative to the cost of a ray-primitive intersection test
+	static float s_MaxRefitCostRatio;	// refit() gives up once its quality metric exceeds this times the one after the last build
+
+	BVH() : m_BuildCostRatio(0.f) {}
+
+	void build(const std::vector<GeometricObject*> &objects);
+	void clear();
+
+	// recomputes the node bounds bottom-up from the current primitive bounds (e.g. after objects moved), keeping the topology;
+	// false if the tree has to be rebuilt instead: the primitives changed, or the quality degraded past s_MaxRefitCostRatio.
+	// the quality is measured by the SAH sum of the node areas relative to the sum of the primitive areas rather than to the root,
+	// whose growth under a few far-moving primitives would hide the stretched nodes
+	bool refit();
+
+	// expected cost of a random ray in units of intersection tests, from the node areas relative to the root
+	float getSAHCost() const;
+
+	bool hit(const Ray &r, float tmin, float tmax, HitRecord &record) const;
+
+	// any-hit traversal for occlusion tests: returns at the first primitive hit in [tmin, tmax]
+	bool shadowHit(const Ray &r, float tmin, float tmax) const;
+
+	// traverses the tree once for all active lanes of the packet; records[lane] is filled for every lane in the returned mask
+	int hitPacket(const RayPacket &packet, int activeMask, float tmin, float tmax, HitRecord *records) const;
+
+	bool isEmpty() const { return m_Nodes.empty(); }
+	int getNumNodes() const { return (int)m_Nodes.size(); }
+	int getNumPrimitives() const { return (int)m_Primitives.size(); }
+
+	glm::vec3 getBoundingBoxMin() const { return m_Nodes.empty() ? glm::vec3(0.f) : m_Nodes[0].m_BoundingBoxMin; }
+	glm::vec3 getBoundingBoxMax() const { return m_Nodes.empty() ? glm::vec3(0.f) : m_Nodes[0].m_BoundingBoxMax; }
+
+private:
+	struct PrimitiveRef
+	{
+		int m_ObjectIdx;
+		int m_PrimitiveIdx;
+	};
+
+	struct BuildEntry
+	{
+		glm::vec3 m_BoundingBoxMin;
+		glm::vec3 m_BoundingBoxMax;
+		glm::vec3 m_Centroid;
+		PrimitiveRef m_Ref;
+		unsigned int m_MortonCode;
+	};
+
+	// node of the tree under construction, allocated by the tasks in any order and flattened afterwards
+	struct BuildNode
+	{
+		BVHNode m_Node;	// m_Offset: first entry of a leaf
+		int m_Children[2];
+	};
+
+	// of the primitives and of their centroids in a range of entries
+	struct BuildBounds
+	{
+		glm::vec3 m_Min, m_Max;
+		glm::vec3 m_CentroidMin, m_CentroidMax;
+	};
+
+	struct BuildContext
+	{
+		std::vector<BuildEntry> m_Entries;	// the leaves own contiguous ranges, in the order of the depth-first traversal
+		std::vector<BuildNode> m_Nodes;
+		std::atomic<int> m_NumNodes;
+	};
+
+	std::vector<BVHNode> m_Nodes;
+	std::vector<PrimitiveRef> m_Primitives;
+	std::vector<GeometricObject*> m_Objects;
+
+	// for refit(): the leaves, and the interior nodes grouped by depth, so that each group can be refit in parallel
+	std::vector<int> m_LeafNodes;
+	std::vector<std::vector<int> > m_InteriorNodesByDepth;
+	float m_BuildCostRatio;	// of the SAH area sum to the primitive area sum, for refit()
+
+	void buildRefitOrder();
+	float getNodeAreaCost() const;	// SAH cost times the root area
+	static BuildBounds ComputeBounds(const BuildContext &ctx, int begin, int end);
+	static void BuildRec(BuildContext *ctx, int nodeIdx, int begin, int end, int depth, BuildBounds bounds);
+	int flatten(const BuildContext &ctx, int buildNodeIdx);
+};
@@ -7,27 +7,30 @@ class BlinnPhongMaterial : public Material
 {
 private:
 	BlinnPhongMaterial()
-		: shininess(32), ks(1,1,1), kd(1,1,1)
 	{
+		data().m_Type = Blinn_Phong_Type;
+		data().m_Shininess = 32;
+		data().m_SpecularCoeff = vec3(1,1,1);
+		data().m_DiffuseCoeff = vec3(1,1,1);
 	}
 
 	BlinnPhongMaterial(const BlinnPhongMaterial &m)
-		: shininess(m.shininess), ks(m.ks), kd(m.kd), Material(m)
+		: Material(m)
 	{
 	}
 
 public:
 	static BlinnPhongMaterial *CreateMaterial()
 	{
-		BlinnPhongMaterial *m = new BlinnPhongMaterial();
-		material_cache.push_back( m );
+		BlinnPhongMaterial *m = new (AllocateMaterial<BlinnPhongMaterial>()) BlinnPhongMaterial();
+		RegisterMaterial(m);
 		return m;
 	}
 
 	static BlinnPhongMaterial *CreateMaterial(const BlinnPhongMaterial *_m)
 	{
-		BlinnPhongMaterial *m = new BlinnPhongMaterial(*_m);
-		material_cache.push_back( m );
+		BlinnPhongMaterial *m = new (AllocateMaterial<BlinnPhongMaterial>()) BlinnPhongMaterial(*_m);
+		RegisterMaterial(m);
 		return m;
 	}
 
@@ -35,22 +38,15 @@ public:
 	{
 	}
 
-	Material_Type getMaterialType() const { return Blinn_Phong_Type; }
+	Real getShininess() const { return data().m_Shininess; }
+	void setShininess(Real s) { data().m_Shininess = s; }
 
-	Real getShininess() const { return shininess; }
-	void setShininess(Real s) { shininess = s; }
+	const vec3 &getSpecularCoeff() const { return data().m_SpecularCoeff; }
+	void setSpecularCoeff(const vec3 &k) { data().m_SpecularCoeff = k; }
+	void setSpecularCoeff(Real r, Real g, Real b) { data().m_SpecularCoeff = vec3(r,g,b); }
 
-	vec3 getSpecularCoeff() const { return ks; }
-	void setSpecularCoeff(const vec3 &k) { ks = k; }
-	void setSpecularCoeff(Real r, Real g, Real b) { ks = vec3(r,g,b); }
-
-	vec3 getDiffuseCoeff() const { return kd; }
-	void setDiffuseCoeff(const vec3 &k) { kd = k; }
-	void setDiffuseCoeff(Real r, Real g, Real b) { kd = vec3(r,g,b); }
-
-private:
-	Real shininess; // power of cosine lobe
-	vec3 ks;	// phong
-	vec3 kd;	// diffuse
+	const vec3 &getDiffuseCoeff() const { return data().m_DiffuseCoeff; }
+	void setDiffuseCoeff(const vec3 &k) { data().m_DiffuseCoeff = k; }
+	void setDiffuseCoeff(Real r, Real g, Real b) { data().m_DiffuseCoeff = vec3(r,g,b); }
 
 };
@@ -0,0 +1,268 @@
+#include "DemoScenes.h"
+#include "Scene.h"
+#include "PathFinder.h"
+
+#include "Sphere.h"
+#include "TriangleMesh.h"
+#include "Instance.h"
+
+#include "DiffuseMaterial.h"
+#include "BlinnPhongMaterial.h"
+#include "PerfectSpecularMaterial.h"
+#include "SpecularRefractionMaterial.h"
+#include "TexturedMaterial.h"
+#include "ImageTexture.h"
+
+#include <iostream>
+
+using namespace glm;
+
+// objects shared by CreateSpherePyramidScene and CreateLightSourceScene
+static void AddSpherePyramid(Scene& scene)
+{
+	// floor
+	{
+		DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
+		m->setDiffuseCoeff(0.5f, 0.5f, 0.5f);
+
+		const float halfSize = 3.f;
+
+		TriangleMesh* o = TriangleMesh::CreateGeometricObject();
+		o->addTriangle(Triangle(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), m));
+		o->addTriangle(Triangle(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), vec3(-halfSize, 0.f, -halfSize), m));
+		o->setMaterial(m);
+
+		scene.addObject(o);
+	}
+
+	// pyramid top
+	{
+		PerfectSpecularMaterial* m = PerfectSpecularMaterial::CreateMaterial();
+		m->setSpecularCoeff(0.5f, 0.5f, 0.5f);
+		scene.addObject(Sphere::CreateGeometricObject(glm::vec3(0.f, sqrtf(2.f) + 1.f, 0.f), 1.f, m));
+	}
+
+	// front left
+	{
+		//DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
+		BlinnPhongMaterial* m = BlinnPhongMaterial::CreateMaterial();
+		m->setDiffuseCoeff(0.2f, 0.2f, 0.2f);
+		m->setSpecularCoeff(0.8f, 0.2f, 0.2f);
+		m->setShininess(64.f);
+		scene.addObject(Sphere::CreateGeometricObject(glm::vec3(-1.f, 1.f, 1.f), 1.f, m));
+	}
+
+	// front right
+	{
+		//DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
+		//m->setDiffuseCoeff(0.5f, 1.f, 0.5f);
+		SpecularRefractionMaterial* m = SpecularRefractionMaterial::CreateMaterial();
+		m->setRefractionIndex(1.5f);
+		m->setDispersion(0.01f);	// flint glass; only seen in the spectral mode
+		m->setSpecularCoeff(0.5f, 1.f, 0.5f);
+		scene.addObject(Sphere::CreateGeometricObject(glm::vec3(1.f, 1.f, 1.f), 1.f, m));
+	}
+
+	// rear right
+	{
+		DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
+		m->setDiffuseCoeff(0.5f, 1.f, 0.5f);
+		scene.addObject(Sphere::CreateGeometricObject(glm::vec3(-1.f, 1.f, -1.f), 1.f, m));
+	}
+
+	// rear right
+	{
+		DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
+		m->setDiffuseCoeff(0.5f, 0.5f, 1.f);
+		scene.addObject(Sphere::CreateGeometricObject(glm::vec3(1.f, 1.f, -1.f), 1.f, m));
+	}
+}
+
+void CreateSpherePyramidScene(Scene& scene)
+{
+	{
+		PathFinder finder;
+		finder.addSearchPath("Resources");
+		finder.addSearchPath("../Resources");
+		finder.addSearchPath("../../Resources");
+
+		scene.loadEnvironmentMap(finder.find("sunset_fairway_2k.hdr").c_str());
+	}
+
+	AddSpherePyramid(scene);
+}
+
+void CreateLightSourceScene(Scene& scene)
+{
+	scene.setBackgroundColor(vec3(0.f));
+
+	AddSpherePyramid(scene);
+
+	// small and bright, found almost only by light sampling
+	scene.addLight(new SphereLight(vec3(-1.5f, 4.5f, 1.5f), 0.1f, vec3(400.f, 360.f, 300.f)));
+
+	scene.addLight(new PointLight(vec3(2.f, 3.f, 2.f), vec3(2.f, 2.f, 3.f)));
+
+	scene.addLight(new SpotLight(vec3(-3.f, 4.f, -2.f), vec3(0.6f, -1.f, 0.4f), vec3(30.f, 20.f, 10.f), glm::radians(25.f), glm::radians(15.f)));
+
+	// panel facing down behind the pyramid
+	scene.addLight(new TriangleLight(vec3(2.5f, 3.5f, -1.f), vec3(2.5f, 3.5f, 1.f), vec3(2.5f, 1.5f, 0.f), vec3(3.f)));
+}
+
+void CreateBunnyScene(Scene& scene)
+{
+	PathFinder finder;
+	finder.addSearchPath("Resources");
+	finder.addSearchPath("../Resources");
+	finder.addSearchPath("../../Resources");
+
+	scene.loadEnvironmentMap(finder.find("sunset_fairway_2k.hdr").c_str());
+
+	// floor
+	{
+		DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
+		m->setDiffuseCoeff(0.5f, 0.5f, 0.5f);
+
+		const float halfSize = 3.f;
+
+		TriangleMesh* o = TriangleMesh::CreateGeometricObject();
+		o->addTriangle(Triangle(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), m));
+		o->addTriangle(Triangle(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), vec3(-halfSize, 0.f, -halfSize), m));
+		o->setMaterial(m);
+
+		scene.addObject(o);
+	}
+
+	// the mesh is scaled into the unit cube [0, 1]^3 and added as is
+	TriangleMesh* bunny = TriangleMesh::CreateGeometricObject();
+	if (!bunny->loadObj(finder.find("bunny10k.obj").c_str()))
+	{
+		std::cerr << __FUNCTION__ << ": the bunny mesh could not be loaded" << std::endl;
+		return;
+	}
+
+	BlinnPhongMaterial* m = BlinnPhongMaterial::CreateMaterial();
+	m->setDiffuseCoeff(0.6f, 0.5f, 0.4f);
+	m->setSpecularCoeff(0.2f, 0.2f, 0.2f);
+	m->setShininess(32.f);
+	bunny->setMaterial(m);
+
+	scene.addObject(bunny);
+}
+
+void CreateInstancedBunnyScene(Scene& scene)
+{
+	PathFinder finder;
+	finder.addSearchPath("Resources");
+	finder.addSearchPath("../Resources");
+	finder.addSearchPath("../../Resources");
+
+	scene.loadEnvironmentMap(finder.find("sunset_fairway_2k.hdr").c_str());
+
+	const int gridSize = 10;
+	const float spacing = 1.2f;
+	const float halfSize = 0.5f * gridSize * spacing;
+
+	// floor
+	{
+		DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
+		m->setDiffuseCoeff(0.5f, 0.5f, 0.5f);
+
+		TriangleMesh* o = TriangleMesh::CreateGeometricObject();
+		o->addTriangle(Triangle(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), m));
+		o->addTriangle(Triangle(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), vec3(-halfSize, 0.f, -halfSize), m));
+		o->setMaterial(m);
+
+		scene.addObject(o);
+	}
+
+	// the bunny mesh is not added to the scene itself, only its instances are
+	TriangleMesh* bunny = TriangleMesh::CreateGeometricObject();
+	if (!bunny->loadObj(finder.find("bunny10k.obj").c_str()))
+	{
+		std::cerr << __FUNCTION__ << ": the bunny mesh could not be loaded" << std::endl;
+		return;
+	}
+
+	DiffuseMaterial* diffuse = DiffuseMaterial::CreateMaterial();
+	diffuse->setDiffuseCoeff(0.8f, 0.6f, 0.4f);
+	bunny->setMaterial(diffuse);
+
+	BlinnPhongMaterial* glossy = BlinnPhongMaterial::CreateMaterial();
+	glossy->setDiffuseCoeff(0.2f, 0.2f, 0.2f);
+	glossy->setSpecularCoeff(0.2f, 0.4f, 0.8f);
+	glossy->setShininess(64.f);
+
+	Instance* first = 0;
+
+	for (int i = 0; i < gridSize; ++i)
+	{
+		for (int j = 0; j < gridSize; ++j)
+		{
+			// the mesh is scaled into the unit cube; rotate about its vertical center axis and place it on the floor
+			const float angle = 0.7f * (float)(i * gridSize + j);
+			mat4 transform = glm::translate(mat4(1.f), vec3(-halfSize + (i + 0.5f) * spacing, 0.f, -halfSize + (j + 0.5f) * spacing));
+			transform = glm::rotate(transform, angle, vec3(0.f, 1.f, 0.f));
+			transform = glm::translate(transform, vec3(-0.5f, 0.f, -0.5f));
+
+			Instance* o = first ? Instance::CreateGeometricObject(first, mat4x3(transform)) : Instance::CreateGeometricObject(bunny, mat4x3(transform));
+			if (!first) first = o;
+
+			o->setMaterial(((i + j) & 1) ? (Material*)glossy : (Material*)diffuse);
+
+			scene.addObject(o);
+		}
+	}
+}
+
+void CreateTexturedScene(Scene& scene)
+{
+	{
+		PathFinder finder;
+		finder.addSearchPath("Resources");
+		finder.addSearchPath("../Resources");
+		finder.addSearchPath("../../Resources");
+
+		scene.loadEnvironmentMap(finder.find("sunset_fairway_2k.hdr").c_str());
+	}
+
+	// floor, 40 repeats of an 8x8 checker board over 40 units; aliases toward the horizon without filtering
+	{
+		const int texSize = 64, cellSize = 8;
+
+		ImageTexture::ImageRGBf image(texSize, texSize);
+		for (int yi = 0; yi < texSize; ++yi)
+			for (int xi = 0; xi < texSize; ++xi)
+				image(xi, yi) = ((xi / cellSize + yi / cellSize) % 2) ? vec3(0.8f, 0.8f, 0.8f) : vec3(0.1f, 0.1f, 0.3f);
+
+		TexturedMaterial* m = TexturedMaterial::CreateMaterial();
+		m->setTexture(ImageTexture::CreateTexture(image));
+		m->setPhongCoeff(0.05f, 0.05f, 0.05f);
+
+		const float halfSize = 20.f, repeats = 40.f;
+
+		Triangle t0(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), m);
+		t0.setTexCoord0(vec2(0.f, 0.f));
+		t0.setTexcoord1(vec2(repeats, 0.f));
+		t0.setTexcoord2(vec2(repeats, repeats));
+
+		Triangle t1(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), vec3(-halfSize, 0.f, -halfSize), m);
+		t1.setTexCoord0(vec2(0.f, 0.f));
+		t1.setTexcoord1(vec2(repeats, repeats));
+		t1.setTexcoord2(vec2(0.f, repeats));
+
+		TriangleMesh* o = TriangleMesh::CreateGeometricObject();
+		o->addTriangle(t0);
+		o->addTriangle(t1);
+		o->setMaterial(m);
+
+		scene.addObject(o);
+	}
+
+	// the floor seen in a mirror: the cone keeps growing over the bounce
+	{
+		PerfectSpecularMaterial* m = PerfectSpecularMaterial::CreateMaterial();
+		m->setSpecularCoeff(0.8f, 0.8f, 0.8f);
+		scene.addObject(Sphere::CreateGeometricObject(glm::vec3(0.f, 1.f, 0.f), 1.f, m));
+	}
+}
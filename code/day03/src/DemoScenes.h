@@ -0,0 +1,20 @@
+#pragma once
+
+class Scene;
+
+// scenes shared by the interactive viewer and the batch renderer
+
+// six spheres with different materials on a diffuse floor, lit by an environment map
+void CreateSpherePyramidScene(Scene& scene);
+
+// the same objects lit only by a small sphere light, a point light, a spot light and an emissive triangle
+void CreateLightSourceScene(Scene& scene);
+
+// bunny10k.obj (scaled into the unit cube) on a diffuse floor
+void CreateBunnyScene(Scene& scene);
+
+// a 10x10 grid of instances of one bunny mesh on a diffuse floor (the mesh is stored once)
+void CreateInstancedBunnyScene(Scene& scene);
+
+// a large floor with a finely repeated checker texture and a mirror sphere, for the texture filtering by ray cones
+void CreateTexturedScene(Scene& scene);
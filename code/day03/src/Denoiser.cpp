@@ -0,0 +1,195 @@
+#include "Denoiser.h"
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+int Denoiser::s_NumIterations = 5;
+float Denoiser::s_ColorSigma = 4.f;
+float Denoiser::s_NormalSigma = 64.f;
+float Denoiser::s_DepthSigma = 0.1f;
+float Denoiser::s_AlbedoSigma = 0.1f;
+
+static inline float luminance(float r, float g, float b)
+{
+	return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+// exp(x) for x <= 0, accurate to about 1e-5 relative; free of calls and branches, so that the filter loop vectorizes
+static inline float expNegative(float x)
+{
+	// exp(x) = 2^-t; t >= 0 is clamped on its bit pattern, which orders like the value (a float select would not vectorize)
+	float t = -x * 1.442695041f;
+	int tBits;
+	memcpy(&tBits, &t, sizeof(float));
+	tBits = (tBits < 0x42fc0000) ? tBits : 0x42fc0000;	// 126
+	memcpy(&t, &tBits, sizeof(float));
+
+	// 2^-t = 2^-n * 2^f with the nearest integer n, which the addition leaves in the low bits of the mantissa
+	const float m = t + 12582912.f;	// 1.5 * 2^23
+	int mBits;
+	memcpy(&mBits, &m, sizeof(float));
+	const int n = mBits - 0x4b400000;
+	const float f = (m - 12582912.f) - t;	// in [-0.5, 0.5]
+	const float p = 1.f + f * (0.6931472f + f * (0.2402265f + f * (0.05550411f + f * (0.009618129f + f * 0.001333355f))));
+
+	const int scaleBits = (127 - n) << 23;
+	float scale;
+	memcpy(&scale, &scaleBits, sizeof(float));
+
+	return p * scale;
+}
+
+bool Denoiser::denoise(const ImageRGBf &color, const ImageRect<float> &variance, const AOVBuffer &guides, ImageRGBf &output)
+{
+	if (!guides.has(AOVBuffer::Depth_AOV) || !guides.has(AOVBuffer::Normal_AOV) || !guides.has(AOVBuffer::Albedo_AOV))
+	{
+		cerr << __FUNCTION__ << ": the guides have not been rendered" << endl;
+		return false;
+	}
+
+	m_Width = color.getWidth();
+	m_Height = color.getHeight();
+
+	const int n = m_Width * m_Height;
+
+	for (int ci = 0; ci < 3; ++ci)
+	{
+		m_Color[ci].resize(n);
+		m_FilteredColor[ci].resize(n);
+	}
+	m_Variance.resize(n);
+	m_FilteredVariance.resize(n);
+	m_Luminance.resize(n);
+	m_InvLuminanceSigma.resize(n);
+	m_InvDepthSigma.resize(n);
+
+	const float *depth = guides.getPlane(AOVBuffer::Depth_AOV);
+	const float invDepthSigma = 1.f / s_DepthSigma;
+
+	for (int i = 0; i < n; ++i)
+	{
+		for (int ci = 0; ci < 3; ++ci)
+			m_Color[ci][i] = color.getData()[i][ci];
+		m_Variance[i] = variance.getData()[i];
+		m_InvDepthSigma[i] = invDepthSigma / std::max(depth[i], 1.0e-3f);
+	}
+
+	for (int it = 0; it < s_NumIterations; ++it)
+	{
+		filter(guides, 1 << it);
+
+		for (int ci = 0; ci < 3; ++ci)
+			m_Color[ci].swap(m_FilteredColor[ci]);
+		m_Variance.swap(m_FilteredVariance);
+	}
+
+	output.allocate(m_Width, m_Height);
+
+	for (int i = 0; i < n; ++i)
+		output.getData()[i] = vec3(m_Color[0][i], m_Color[1][i], m_Color[2][i]);
+
+	return true;
+}
+
+void Denoiser::filter(const AOVBuffer &guides, int step)
+{
+	const int width = m_Width;
+	const int height = m_Height;
+	const int n = width * height;
+
+	const float *r = &m_Color[0][0], *g = &m_Color[1][0], *b = &m_Color[2][0];
+	const float *var = &m_Variance[0];
+	const float *nx = guides.getPlane(AOVBuffer::Normal_AOV, 0), *ny = guides.getPlane(AOVBuffer::Normal_AOV, 1), *nz = guides.getPlane(AOVBuffer::Normal_AOV, 2);
+	const float *ar = guides.getPlane(AOVBuffer::Albedo_AOV, 0), *ag = guides.getPlane(AOVBuffer::Albedo_AOV, 1), *ab = guides.getPlane(AOVBuffer::Albedo_AOV, 2);
+	const float *z = guides.getPlane(AOVBuffer::Depth_AOV), *invZSigma = &m_InvDepthSigma[0];
+	float *lum = &m_Luminance[0], *invLumSigma = &m_InvLuminanceSigma[0];
+
+	const float normalSigma = s_NormalSigma;
+	const float invAlbedoSigma2 = 1.f / (s_AlbedoSigma * s_AlbedoSigma);
+
+#pragma omp parallel for
+	for (int i = 0; i < n; ++i)
+	{
+		lum[i] = luminance(r[i], g[i], b[i]);
+		invLumSigma[i] = 1.f / (s_ColorSigma * sqrtf(std::max(var[i], 0.f)) + 1.0e-6f);
+	}
+
+	static const float kernel[5] = { 1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+
+#pragma omp parallel
+	{
+		// sums of a scanline
+		vector<float> sumW(width), sumR(width), sumG(width), sumB(width), sumVar(width);
+
+#pragma omp for schedule(dynamic, 4)
+		for (int yi = 0; yi < height; ++yi)
+		{
+			std::fill(sumW.begin(), sumW.end(), 0.f);
+			std::fill(sumR.begin(), sumR.end(), 0.f);
+			std::fill(sumG.begin(), sumG.end(), 0.f);
+			std::fill(sumB.begin(), sumB.end(), 0.f);
+			std::fill(sumVar.begin(), sumVar.end(), 0.f);
+
+			float *sw = &sumW[0], *sr = &sumR[0], *sg = &sumG[0], *sb = &sumB[0], *sv = &sumVar[0];
+			const int rowP = width * yi;
+
+			for (int ky = -2; ky <= 2; ++ky)
+			{
+				const int yq = yi + ky * step;
+				if (yq < 0 || yq >= height)
+					continue;
+
+				for (int kx = -2; kx <= 2; ++kx)
+				{
+					// the taps outside the image are skipped by narrowing the range of x
+					const int offset = kx * step;
+					const int x0 = std::max(0, -offset);
+					const int x1 = std::min(width, width - offset);
+					const int rowQ = width * yq + offset;
+
+					const float h = kernel[ky + 2] * kernel[kx + 2];
+					const float invDistance = (kx || ky) ? 1.f / (step * sqrtf(float(kx * kx + ky * ky))) : 0.f;
+
+#pragma omp simd
+					for (int xi = x0; xi < x1; ++xi)
+					{
+						const int p = rowP + xi;
+						const int q = rowQ + xi;
+
+						const float dLum = fabsf(lum[p] - lum[q]) * invLumSigma[p];
+
+						// 1 - cos for unit normals, and no edge between two pixels without geometry
+						const float dnx = nx[p] - nx[q], dny = ny[p] - ny[q], dnz = nz[p] - nz[q];
+						const float dNormal = 0.5f * normalSigma * (dnx * dnx + dny * dny + dnz * dnz);
+
+						const float dDepth = fabsf(z[p] - z[q]) * invZSigma[p] * invDistance;
+
+						const float dar = ar[p] - ar[q], dag = ag[p] - ag[q], dab = ab[p] - ab[q];
+						const float dAlbedo = (dar * dar + dag * dag + dab * dab) * invAlbedoSigma2;
+
+						const float w = h * expNegative(-(dLum + dNormal + dDepth + dAlbedo));
+
+						sw[xi] += w;
+						sr[xi] += w * r[q];
+						sg[xi] += w * g[q];
+						sb[xi] += w * b[q];
+						sv[xi] += w * w * var[q];
+					}
+				}
+			}
+
+			// the center tap always has a nonzero weight
+			for (int xi = 0; xi < width; ++xi)
+			{
+				const float invW = 1.f / sw[xi];
+
+				m_FilteredColor[0][rowP + xi] = sr[xi] * invW;
+				m_FilteredColor[1][rowP + xi] = sg[xi] * invW;
+				m_FilteredColor[2][rowP + xi] = sb[xi] * invW;
+				m_FilteredVariance[rowP + xi] = sv[xi] * invW * invW;
+			}
+		}
+	}
+}
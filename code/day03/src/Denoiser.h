@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ImageRect.h"
+#include "AOVBuffer.h"
+#include "glm/glm.hpp"
+#include <vector>
+
+// edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the variance guided luminance weight of SVGF:
+// a 5x5 B3-spline kernel is applied s_NumIterations times with holes of 2^i pixels between its taps,
+// and the weight of each tap falls off with the differences of the color and of the first-hit guides
+// (normal, depth and albedo) between the two pixels, so that the filter does not blur across edges
+class Denoiser
+{
+public:
+	typedef ImageRect<glm::vec3> ImageRGBf;
+
+	static int s_NumIterations;
+	static float s_ColorSigma;	// in units of the standard error of the pixel luminance
+	static float s_NormalSigma;	// exponent of the normal weight (higher values keep more normal edges)
+	static float s_DepthSigma;	// depth difference relative to the depth of the pixel, per pixel of distance
+	static float s_AlbedoSigma;
+
+	// variance: of the mean luminance of each pixel; a huge value turns off the luminance weight of the pixel
+	// guides: must have the channels of AOVBuffer::Denoiser_AOV_Mask, otherwise output is left unchanged and false is returned
+	bool denoise(const ImageRGBf& color, const ImageRect<float>& variance, const AOVBuffer& guides, ImageRGBf& output);
+
+private:
+	int m_Width, m_Height;
+
+	// planes of the image being filtered (structure of arrays, so that the filter loop vectorizes),
+	// the second set receives the result of an iteration
+	std::vector<float> m_Color[3], m_FilteredColor[3];
+	std::vector<float> m_Variance, m_FilteredVariance;
+	std::vector<float> m_Luminance, m_InvLuminanceSigma;
+
+	std::vector<float> m_InvDepthSigma;
+
+	void filter(const AOVBuffer& guides, int step);	// one iteration from m_Color to m_FilteredColor
+};
@@ -7,27 +7,28 @@ class DiffuseMaterial : public Material
 {
 private:
 	DiffuseMaterial()
-		: kd(1,1,1)
 	{
+		data().m_Type = Diffuse_Type;
+		data().m_DiffuseCoeff = vec3(1,1,1);
 	}
 
 	DiffuseMaterial(const DiffuseMaterial &m)
-		: kd(m.kd), Material(m)
+		: Material(m)
 	{
 	}
 
 public:
 	static DiffuseMaterial *CreateMaterial()
 	{
-		DiffuseMaterial *m = new DiffuseMaterial();
-		material_cache.push_back( m );
+		DiffuseMaterial *m = new (AllocateMaterial<DiffuseMaterial>()) DiffuseMaterial();
+		RegisterMaterial(m);
 		return m;
 	}
 
 	static DiffuseMaterial *CreateMaterial(const DiffuseMaterial *_m)
 	{
-		DiffuseMaterial *m = new DiffuseMaterial(*_m);
-		material_cache.push_back( m );
+		DiffuseMaterial *m = new (AllocateMaterial<DiffuseMaterial>()) DiffuseMaterial(*_m);
+		RegisterMaterial(m);
 		return m;
 	}
 
@@ -35,15 +36,10 @@ public:
 	{
 	}
 
-	Material_Type getMaterialType() const { return Diffuse_Type; }
-
 	void clone(Material **m) const { *m = new DiffuseMaterial(*this); }
 
-	vec3 getDiffuseCoeff() const { return kd; }
-	void setDiffuseCoeff(const vec3 &k) { kd = k; }
-	void setDiffuseCoeff(Real r, Real g, Real b) { kd = vec3(r,g,b); }
-
-private:
-	vec3 kd;
+	const vec3 &getDiffuseCoeff() const { return data().m_DiffuseCoeff; }
+	void setDiffuseCoeff(const vec3 &k) { data().m_DiffuseCoeff = k; }
+	void setDiffuseCoeff(Real r, Real g, Real b) { data().m_DiffuseCoeff = vec3(r,g,b); }
 
 };
@@ -1,26 +1,248 @@
 #include "EnvironmentMap.h"
 #include "glm/glm.hpp"
-#include "arcball_camera.h"
+#include "glm/ext.hpp"
 #include <vector>
+#include <algorithm>
 #undef _UNICODE
 #include <IL/il.h>
 
 using namespace std;
 using namespace glm;
 
-extern ArcballCamera g_Camera;
+// polynomial approximations of the equirectangular mapping (Abramowitz and Stegun 4.4.46 and a minimax fit of atan on [0, 1]);
+// the errors stay far below a texel of a 16k map
+
+static inline float fastAtan2(float y, float x)
+{
+	const float ax = fabsf(x);
+	const float ay = fabsf(y);
+	const float maxXY = std::max(ax, ay);
+
+	if (maxXY == 0.f)
+		return 0.f;
+
+	const float a = std::min(ax, ay) / maxXY;
+	const float s = a * a;
+	float r = a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f + s * (-0.11643287f + s * (0.05265332f + s * -0.01172120f)))));
+
+	if (ay > ax)
+		r = 0.5f * pi<float>() - r;
+	if (x < 0.f)
+		r = pi<float>() - r;
+
+	return (y < 0.f) ? -r : r;
+}
+
+static inline float fastAsin(float x)
+{
+	const float ax = std::min(fabsf(x), 1.f);
+	const float p = 1.5707963050f + ax * (-0.2145988016f + ax * (0.0889789874f + ax * (-0.0501743046f + ax * (0.0308918810f + ax * (-0.0170881256f + ax * (0.0066700901f + ax * -0.0012624911f))))));
+	const float r = 0.5f * pi<float>() - sqrtf(1.f - ax) * p;
+
+	return (x < 0.f) ? -r : r;
+}
+
+// inverse of directionFromTexCoords()
+static inline vec2 texCoordsFromDirection(const vec3 &d)
+{
+	return vec2(0.5f * fastAtan2(-d.z, -d.x) / pi<float>() + 0.5f, fastAsin(d.y) / pi<float>() + 0.5f);
+}
 
 vec3 EnvironmentMap::fetchColor(const Ray& ray) const
 {
 	if (!m_Texture.getData())
 		return vec3(0.f);
 
-	const vec3 d = ray.getUnitDir();
+	const vec2 uv = texCoordsFromDirection(ray.getUnitDir());
+
+	const float x = m_Texture.getWidth() * uv.x;
+	const float y = m_Texture.getHeight() * uv.y;
+
+	// level 0 while the cone is narrower than a texel (pi / height radians in latitude)
+	const float coneAngle = ray.getConeAngle();
+	const float lod = (coneAngle > 0.f && !m_MipLevels.empty()) ? log2f(coneAngle * m_Texture.getHeight() / pi<float>()) : 0.f;
+
+	if (lod <= 0.f)
+		return m_Texture.bilinearInterp(x, y);
+
+	if (lod >= (float)m_MipLevels.size())
+		return fetchMipLevel((int)m_MipLevels.size(), x, y);
+
+	// trilinear
+	const int level = (int)lod;
+	const float t = lod - level;
+
+	return (1.f - t) * fetchMipLevel(level, x, y) + t * fetchMipLevel(level + 1, x, y);
+}
+
+vec3 EnvironmentMap::fetchMipLevel(int level, float x, float y) const
+{
+	if (level == 0)
+		return m_Texture.bilinearInterp(x, y);
+
+	// texel centers of the level in the texel coordinates of level 0, where the centers are at the integers
+	const ImageRGBf &image = m_MipLevels[level - 1];
+	const float sx = (float)image.getWidth() / m_Texture.getWidth();
+	const float sy = (float)image.getHeight() / m_Texture.getHeight();
+
+	return image.bilinearInterp((x + 0.5f) * sx - 0.5f, (y + 0.5f) * sy - 0.5f);
+}
+
+void EnvironmentMap::buildMipChain()
+{
+	m_MipLevels.clear();
+
+	const ImageRGBf *pSrc = &m_Texture;
+
+	int nLevels = 0;
+	for (int w = m_Texture.getWidth(), h = m_Texture.getHeight(); w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2)
+		++nLevels;
+
+	m_MipLevels.resize(nLevels);
+
+	for (int li = 0; li < nLevels; ++li)
+	{
+		pSrc->downsample(m_MipLevels[li]);
+		pSrc = &m_MipLevels[li];
+	}
+}
+
+static inline float luminance(const vec3 &c)
+{
+	return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+// cell (xi, yi) covers longitude [xi, xi+1) * 2pi / width and latitude [yi, yi+1) * pi / height - pi/2, as in fetchColor()
+static inline vec3 directionFromTexCoords(float u, float v)
+{
+	const float phi = 2.f * pi<float>() * (u - 0.5f);
+	const float lat = pi<float>() * (v - 0.5f);
+	return vec3(-cosf(phi) * cosf(lat), sinf(lat), -sinf(phi) * cosf(lat));
+}
+
+void EnvironmentMap::buildSamplingDistribution()
+{
+	m_MarginalCDF.clear();
+	m_ConditionalCDFs.clear();
+	m_CellPdfs.clear();
+
+	const int width = m_Texture.getWidth();
+	const int height = m_Texture.getHeight();
+
+	// fetchColor() interpolates bilinearly, so the radiance inside a cell comes from up to four texels;
+	// weighting each cell by the brightest of them keeps the pdf non-zero wherever the radiance is
+	vector<float> cellWeights(width * height);
+
+	for (int yi = 0; yi < height; ++yi)
+	{
+		const int yi1 = std::min(yi + 1, height - 1);
+
+		// cells near the poles cover less solid angle
+		const float cosLat = cosf(pi<float>() * ((yi + 0.5f) / height - 0.5f));
+
+		for (int xi = 0; xi < width; ++xi)
+		{
+			const int xi1 = std::min(xi + 1, width - 1);
+			const float maxLuminance = std::max(std::max(luminance(m_Texture(xi, yi)), luminance(m_Texture(xi1, yi))),
+				std::max(luminance(m_Texture(xi, yi1)), luminance(m_Texture(xi1, yi1))));
+
+			cellWeights[xi + width * yi] = maxLuminance * cosLat;
+		}
+	}
+
+	m_ConditionalCDFs.resize((width + 1) * height);
+	m_MarginalCDF.resize(height + 1);
+	m_MarginalCDF[0] = 0.f;
+
+	for (int yi = 0; yi < height; ++yi)
+	{
+		float *cdf = &m_ConditionalCDFs[(width + 1) * yi];
+
+		cdf[0] = 0.f;
+		for (int xi = 0; xi < width; ++xi)
+			cdf[xi + 1] = cdf[xi] + cellWeights[xi + width * yi];
+
+		m_MarginalCDF[yi + 1] = m_MarginalCDF[yi] + cdf[width];
+
+		if (cdf[width] > 0.f)
+		{
+			for (int xi = 1; xi <= width; ++xi)
+				cdf[xi] /= cdf[width];
+		}
+	}
+
+	const float totalWeight = m_MarginalCDF[height];
+
+	if (!(totalWeight > 0.f))
+	{
+		// black environment: nothing to sample
+		m_MarginalCDF.clear();
+		m_ConditionalCDFs.clear();
+		return;
+	}
+
+	for (int yi = 1; yi <= height; ++yi)
+		m_MarginalCDF[yi] /= totalWeight;
+
+	m_CellPdfs.resize(width * height);
+
+	for (int i = 0; i < width * height; ++i)
+		m_CellPdfs[i] = cellWeights[i] / totalWeight * (width * height);
+}
+
+vec3 EnvironmentMap::sampleDirection(float u1, float u2, vec3 &dir, float &pdf) const
+{
+	pdf = 0.f;
+
+	if (!hasSamplingDistribution())
+		return vec3(0.f);
+
+	const int width = m_Texture.getWidth();
+	const int height = m_Texture.getHeight();
+
+	// row, then cell within the row; the offset inside the cell is uniform
+	const int yi = std::min((int)(std::upper_bound(m_MarginalCDF.begin(), m_MarginalCDF.end(), u1) - m_MarginalCDF.begin()) - 1, height - 1);
+	const float rowProb = m_MarginalCDF[yi + 1] - m_MarginalCDF[yi];
+	const float dv = (rowProb > 0.f) ? (u1 - m_MarginalCDF[yi]) / rowProb : 0.5f;
+
+	const float *cdf = &m_ConditionalCDFs[(width + 1) * yi];
+	const int xi = std::min((int)(std::upper_bound(cdf, cdf + width + 1, u2) - cdf) - 1, width - 1);
+	const float cellProb = cdf[xi + 1] - cdf[xi];
+	const float du = (cellProb > 0.f) ? (u2 - cdf[xi]) / cellProb : 0.5f;
+
+	const float u = (xi + std::min(du, 1.f)) / width;
+	const float v = (yi + std::min(dv, 1.f)) / height;
+
+	dir = directionFromTexCoords(u, v);
+
+	// the unit square maps to the sphere with d(omega) = 2 pi^2 cos(latitude) du dv
+	const float cosLat = sqrtf(std::max(1.f - dir.y * dir.y, 0.f));
+	if (cosLat <= 0.f)
+		return vec3(0.f);
+
+	pdf = m_CellPdfs[xi + width * yi] / (2.f * pi<float>() * pi<float>() * cosLat);
+
+	return fetchColor(Ray(vec3(0.f), dir));
+}
+
+float EnvironmentMap::getPdf(const vec3 &dir) const
+{
+	if (!hasSamplingDistribution())
+		return 0.f;
+
+	const int width = m_Texture.getWidth();
+	const int height = m_Texture.getHeight();
 
-	const float x = m_Texture.getWidth() * (0.5f * atan2f(-d.z, -d.x) / pi<float>() + 0.5f);
-	const float y = m_Texture.getHeight() * (asinf(d.y) / pi<float>() + 0.5f);
+	const vec2 uv = texCoordsFromDirection(dir);
 
-	return m_Texture.bilinearInterp(x, y);
+	const int xi = glm::clamp((int)(uv.x * width), 0, width - 1);
+	const int yi = glm::clamp((int)(uv.y * height), 0, height - 1);
+
+	const float cosLat = sqrtf(std::max(1.f - dir.y * dir.y, 0.f));
+	if (cosLat <= 0.f)
+		return 0.f;
+
+	return m_CellPdfs[xi + width * yi] / (2.f * pi<float>() * pi<float>() * cosLat);
 }
 
 bool EnvironmentMap::load(const char* filename)
@@ -44,31 +266,41 @@ bool EnvironmentMap::load(const char* filename)
 	m_Texture.allocate(width, height);
 	ilCopyPixels(0, 0, 0, width, height, 1, IL_RGB, IL_FLOAT, m_Texture.getData());
 
+	ilDeleteImages(1, &imgName);
+
+	cerr << __FUNCTION__ << ": file loaded: " << filename << " (" << width << "x" << height << ")" << endl;
+
+	buildMipChain();
+	buildSamplingDistribution();
+
+	return true;
+}
+
+#ifndef HEADLESS
+void EnvironmentMap::uploadTexture() const
+{
 	if (!m_TexID) glGenTextures(1, &m_TexID);
 	glBindTexture(GL_TEXTURE_2D, m_TexID);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, m_Texture.getData());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, m_Texture.getWidth(), m_Texture.getHeight(), 0, GL_RGB, GL_FLOAT, m_Texture.getData());
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);	// deprecated from OpenGL 3.0
 	glBindTexture(GL_TEXTURE_2D, 0);
-
-	ilDeleteImages(1, &imgName);
-
-	cerr << __FUNCTION__ << ": file loaded: " << filename << " (" << width << "x" << height << ")" << endl;
-
-	bakeVBO();
-
-	return true;
 }
 
-void EnvironmentMap::drawGL() const
+void EnvironmentMap::drawGL(const mat4& viewMatrix) const
 {
-	if (!m_TexID || !m_VBO)
+	if (!m_Texture.getData())
 		return;
 
-	mat4 M = g_Camera.transform();
+	if (!m_TexID)
+		uploadTexture();
+	if (!m_VBO)
+		bakeVBO();
+
+	mat4 M = viewMatrix;
 	M[3][0] = M[3][1] = M[3][2] = 0.f;
 
 	glMatrixMode(GL_MODELVIEW);
@@ -98,7 +330,7 @@ void EnvironmentMap::drawGL() const
 	glPopMatrix();
 }
 
-void EnvironmentMap::bakeVBO()
+void EnvironmentMap::bakeVBO() const
 {
 	const int nDivSphereLatitude = 64;
 	const int nDivSphereLongitude = 128;
@@ -152,3 +384,4 @@ void EnvironmentMap::bakeVBO()
 
 	m_NumSphereVertices = (int)vertices.size();
 }
+#endif
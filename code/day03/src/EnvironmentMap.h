@@ -1,8 +1,11 @@
 #pragma once
 
+#ifndef HEADLESS
 #include <GL/glew.h>
+#endif
 #include "ImageRect.h"
 #include "Ray.h"
+#include <vector>
 
 class EnvironmentMap
 {
@@ -12,20 +15,44 @@ public:
 	EnvironmentMap() : m_NumSphereVertices(0), m_VBO(0), m_TexID(0) {}
 	~EnvironmentMap()
 	{
+#ifndef HEADLESS
 		if (m_VBO) glDeleteBuffers(1, &m_VBO);
 		if (m_TexID) glDeleteTextures(1, &m_TexID);
+#endif
 	}
 
+	// bilinear lookup, filtered over the mip chain once the cone angle of the ray spans more than a texel
 	glm::vec3 fetchColor(const Ray &ray) const;
 
+	// importance sampling proportional to luminance over solid angle (marginal/conditional CDFs over the texel grid);
+	// returns the radiance arriving from the sampled direction, pdf is given per unit solid angle
+	glm::vec3 sampleDirection(float u1, float u2, glm::vec3 &dir, float &pdf) const;
+	float getPdf(const glm::vec3 &dir) const;
+	bool hasSamplingDistribution() const { return !m_MarginalCDF.empty(); }
+
+	// loads the image only; OpenGL resources are created on the first drawGL() so that loading works without a context
 	bool load(const char* filename);
 
-	void drawGL() const;
+#ifndef HEADLESS
+	void drawGL(const glm::mat4& viewMatrix) const;
+#endif
 
 private:
 	ImageRGBf m_Texture;
-	int m_NumSphereVertices;
-	GLuint m_VBO, m_TexID;
-
-	void bakeVBO();
+	std::vector<ImageRGBf> m_MipLevels;	// 2x2 box-filtered levels below m_Texture, down to 1x1
+	mutable int m_NumSphereVertices;
+	mutable unsigned int m_VBO, m_TexID;	// OpenGL buffer and texture names
+
+	std::vector<float> m_MarginalCDF;	// over rows (height + 1 entries)
+	std::vector<float> m_ConditionalCDFs;	// over the cells of each row ((width + 1) entries per row)
+	std::vector<float> m_CellPdfs;	// probability of each cell times the number of cells (density over the unit square)
+
+	void buildMipChain();
+	void buildSamplingDistribution();
+	glm::vec3 fetchMipLevel(int level, float x, float y) const;	// x, y: texel coordinates of m_Texture
+
+#ifndef HEADLESS
+	void uploadTexture() const;
+	void bakeVBO() const;
+#endif
 };
\ No newline at end of file
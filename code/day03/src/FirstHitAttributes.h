@@ -0,0 +1,59 @@
+#pragma once
+
+#include "HitRecord.h"
+#include "Material.h"
+#include "Texture.h"
+#include "glm/glm.hpp"
+
+// surface seen first by a camera path, recorded into the AOVs of its pixel (see AOVBuffer)
+struct FirstHitAttributes
+{
+	glm::vec3 m_Albedo;
+	glm::vec3 m_Normal;	// zero if the primary ray did not hit any geometry
+	float m_Depth;	// distance along the primary ray (0 if it did not hit any geometry)
+	int m_MaterialId;	// -1 if the primary ray did not hit any geometry
+	int m_ObjectId;	// index of the object in the scene, -1 if the primary ray did not hit any geometry
+
+	// the primary ray escaped or hit a light source
+	void setNoHit()
+	{
+		m_Albedo = glm::vec3(1.f);
+		m_Normal = glm::vec3(0.f);
+		m_Depth = 0.f;
+		m_MaterialId = -1;
+		m_ObjectId = -1;
+	}
+
+	void setHit(const HitRecord& record)
+	{
+		const MaterialData& mat = Material::GetMaterialData(record.m_MaterialId);
+
+		switch (mat.m_Type)
+		{
+		case Material::Pseudo_Normal_Color_Type:
+			m_Albedo = 0.5f * record.m_Normal + glm::vec3(0.5f);
+			break;
+		case Material::Diffuse_Type:
+			m_Albedo = mat.m_DiffuseCoeff;
+			break;
+		case Material::Blinn_Phong_Type:
+			m_Albedo = glm::min(mat.m_DiffuseCoeff + mat.m_SpecularCoeff, glm::vec3(1.f));
+			break;
+		case Material::Textured_Type:
+			m_Albedo = glm::min((mat.m_pTexture ? mat.m_pTexture->getColor(record.m_TexCoords) : glm::vec3(0.f)) + mat.m_SpecularCoeff, glm::vec3(1.f));
+			break;
+		case Material::Perfect_Specular_Type:
+		case Material::Specular_Refraction_Type:
+			m_Albedo = mat.m_SpecularCoeff;
+			break;
+		default:	// not lit by the path tracer
+			m_Albedo = glm::vec3(0.f);
+			break;
+		}
+
+		m_Normal = record.m_Normal;
+		m_Depth = record.m_ParamT;
+		m_MaterialId = record.m_MaterialId;
+		m_ObjectId = record.m_ObjectId;
+	}
+};
@@ -1,23 +1,21 @@
 #pragma once
 
 #include "Ray.h"
+#include "RayPacket.h"
 #include "Material.h"
 #include "Texture.h"
+#include "Arena.h"
 
 #include <vector>
 
 class GeometricObject
 {
 public:
-	static void ClearGeometricObjectCache()
-	{
-		for (int i=0; i<(int)s_GeometricObjectCache.size(); i++)
-			delete s_GeometricObjectCache[i];
-		s_GeometricObjectCache.clear();
-	}
+	// destroys all the objects created by CreateGeometricObject() and releases their blocks at once
+	static void ClearGeometricObjectCache() { s_GeometricObjectArena.clear(); }
 
 	GeometricObject()
-		: m_pMaterial(0)
+		: m_MaterialId(-1)
 	{
 	}
 
@@ -29,23 +27,64 @@ public:
 
 	virtual bool hit(const Ray &r, float tmin, float tmax, HitRecord &record) const = 0;
 
+	// occlusion query: true if anything is hit in [tmin, tmax]; no hit attributes are computed
+	virtual bool shadowHit(const Ray &r, float tmin, float tmax) const
+	{
+		HitRecord record;
+		return hit(r, tmin, tmax, record);
+	}
+
+#ifndef HEADLESS
 	virtual void drawGL() const = 0;	// for preview using OpenGL
+#endif
 
-	Material *getMaterial() const { return m_pMaterial; }
-	void setMaterial(Material *m) { m_pMaterial = m; }
+	int getMaterialId() const { return m_MaterialId; }
+	void setMaterialId(int id) { m_MaterialId = id; }
+	void setMaterial(const Material *m) { m_MaterialId = m ? m->getMaterialId() : -1; }
 
 	virtual glm::vec3 getBoundingBoxMin() const { return glm::vec3(0,0,0); }	// to be implemented
 	virtual glm::vec3 getBoundingBoxMax() const { return glm::vec3(0,0,0); }	// to be implemented
 
+	// primitive-level access for acceleration structures
+	// (an object consists of a single primitive unless it is an aggregate such as TriangleMesh)
+	virtual int getNumPrimitives() const { return 1; }
+	virtual bool hitPrimitive(int primIdx, const Ray &r, float tmin, float tmax, HitRecord &record) const { return hit(r, tmin, tmax, record); }
+	virtual bool shadowHitPrimitive(int primIdx, const Ray &r, float tmin, float tmax) const { return shadowHit(r, tmin, tmax); }
+	virtual glm::vec3 getPrimitiveBoundingBoxMin(int primIdx) const { return getBoundingBoxMin(); }
+	virtual glm::vec3 getPrimitiveBoundingBoxMax(int primIdx) const { return getBoundingBoxMax(); }
+
+	// tests the active lanes of a packet against a primitive; tmax is updated for every lane that hits closer,
+	// and the mask of those lanes is returned (attributes are computed later with hitPrimitive() for the closest hits only)
+	virtual int hitPrimitivePacket(int primIdx, const RayPacket &packet, float tmin, float *tmax, int activeMask) const
+	{
+		int hitMask = 0;
+
+		for (int lane = 0; lane < RayPacket::Width; ++lane)
+		{
+			HitRecord tmpRec;
+			if (RayPacket::IsLaneActive(activeMask, lane) && hitPrimitive(primIdx, packet.getRay(lane), tmin, tmax[lane], tmpRec))
+			{
+				tmax[lane] = tmpRec.m_ParamT;
+				hitMask |= (1 << lane);
+			}
+		}
+
+		return hitMask;
+	}
+
 protected:
 	typedef glm::vec3 vec3;
 	typedef glm::vec2 vec2;
 	typedef float Real;
 
-	static std::vector<GeometricObject *> s_GeometricObjectCache;
+	static Arena s_GeometricObjectArena;	// the objects of each type are adjacent in memory
 
-	Material *m_pMaterial;
+	int m_MaterialId;	// written to HitRecord, so that the hit functions do not dereference the material
 
-	static void RegisterObject(GeometricObject* obj);
+	// for CreateGeometricObject(): obj = new (AllocateObject<T>()) T(...); RegisterObject(obj);
+	template <class T>
+	static void *AllocateObject() { return s_GeometricObjectArena.allocate<T>(); }
+	template <class T>
+	static void RegisterObject(T* obj) { s_GeometricObjectArena.registerDestructor(obj); }
 };
 
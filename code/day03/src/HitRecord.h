@@ -2,14 +2,14 @@
 
 #include "glm/glm.hpp"
 
-class Material;
-
 struct HitRecord
 {
 	float m_ParamT;	// ray parameter (used like o + t * d)
 	glm::vec3 m_Normal;	// surface normal
 	glm::vec3 m_HitPos;	// hit position p (= o + t + d)
 	glm::vec3 m_TexCoords;	// texture coordinate
-	Material *m_pMaterial;
+	float m_TexCoordScale;	// texture coordinate units per world unit around the hit point (0: no texture mapping)
+	int m_MaterialId;	// index into the material table (Material::GetMaterialData)
+	int m_ObjectId;	// index of the hit object in the objects of the BVH (of the scene, for the hits of Scene::hit)
 };
 
@@ -0,0 +1,161 @@
+#include "ImageIO.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// both formats are written in little-endian byte order, which matches the supported platforms
+
+bool SaveImagePFM(const char* filename, const ImageRect<glm::vec3>& image)
+{
+	ofstream ofs(filename, ios::binary);
+
+	if (!ofs)
+	{
+		cerr << __FUNCTION__ << ": cannot open " << filename << endl;
+		return false;
+	}
+
+	const int width = image.getWidth();
+	const int height = image.getHeight();
+
+	// a negative scale denotes little-endian data; scanlines are stored from bottom to top
+	ofs << "PF\n" << width << " " << height << "\n-1.0\n";
+
+	for (int yi = 0; yi < height; ++yi)
+		ofs.write((const char*)image.getScanline(yi), width * sizeof(glm::vec3));
+
+	return ofs.good();
+}
+
+namespace
+{
+	struct EXRWriter
+	{
+		vector<char> m_Bytes;
+
+		void put(const void* p, size_t size) { m_Bytes.insert(m_Bytes.end(), (const char*)p, (const char*)p + size); }
+		void putString(const char* s) { put(s, strlen(s) + 1); }
+		void putInt(int32_t v) { put(&v, 4); }
+		void putFloat(float v) { put(&v, 4); }
+		void putByte(unsigned char v) { put(&v, 1); }
+
+		void beginAttribute(const char* name, const char* type, int32_t size)
+		{
+			putString(name);
+			putString(type);
+			putInt(size);
+		}
+	};
+}
+
+bool SaveImageEXR(const char* filename, const ImageRect<glm::vec3>& image)
+{
+	const int width = image.getWidth();
+	const int height = image.getHeight();
+
+	// channels must be listed in alphabetical order
+	const char* channelNames[3] = { "B", "G", "R" };
+	const int channelComponents[3] = { 2, 1, 0 };
+
+	EXRWriter w;
+
+	// magic number and version 2 (single-part scanline file)
+	const unsigned char magic[4] = { 0x76, 0x2f, 0x31, 0x01 };
+	w.put(magic, 4);
+	w.putInt(2);
+
+	w.beginAttribute("channels", "chlist", 3 * (2 + 16) + 1);
+	for (int ci = 0; ci < 3; ++ci)
+	{
+		w.putString(channelNames[ci]);
+		w.putInt(2);	// FLOAT
+		w.putByte(0);	// pLinear
+		w.putByte(0); w.putByte(0); w.putByte(0);	// reserved
+		w.putInt(1);	// x sampling
+		w.putInt(1);	// y sampling
+	}
+	w.putByte(0);
+
+	w.beginAttribute("compression", "compression", 1);
+	w.putByte(0);	// NO_COMPRESSION
+
+	w.beginAttribute("dataWindow", "box2i", 16);
+	w.putInt(0); w.putInt(0); w.putInt(width - 1); w.putInt(height - 1);
+
+	w.beginAttribute("displayWindow", "box2i", 16);
+	w.putInt(0); w.putInt(0); w.putInt(width - 1); w.putInt(height - 1);
+
+	w.beginAttribute("lineOrder", "lineOrder", 1);
+	w.putByte(0);	// INCREASING_Y
+
+	w.beginAttribute("pixelAspectRatio", "float", 4);
+	w.putFloat(1.f);
+
+	w.beginAttribute("screenWindowCenter", "v2f", 8);
+	w.putFloat(0.f); w.putFloat(0.f);
+
+	w.beginAttribute("screenWindowWidth", "float", 4);
+	w.putFloat(1.f);
+
+	w.putByte(0);	// end of header
+
+	// offset table followed by one scanline per chunk
+	const int32_t lineDataSize = 3 * width * sizeof(float);
+	const uint64_t tableEnd = w.m_Bytes.size() + sizeof(uint64_t) * height;
+
+	for (int y = 0; y < height; ++y)
+	{
+		const uint64_t offset = tableEnd + (uint64_t)y * (8 + lineDataSize);
+		w.put(&offset, 8);
+	}
+
+	vector<float> channel(width);
+
+	for (int y = 0; y < height; ++y)
+	{
+		// EXR scanlines go from top to bottom
+		const glm::vec3* scanline = image.getScanline(height - 1 - y);
+
+		w.putInt(y);
+		w.putInt(lineDataSize);
+
+		for (int ci = 0; ci < 3; ++ci)
+		{
+			for (int xi = 0; xi < width; ++xi)
+				channel[xi] = scanline[xi][channelComponents[ci]];
+			w.put(&channel[0], width * sizeof(float));
+		}
+	}
+
+	ofstream ofs(filename, ios::binary);
+
+	if (!ofs)
+	{
+		cerr << __FUNCTION__ << ": cannot open " << filename << endl;
+		return false;
+	}
+
+	ofs.write(&w.m_Bytes[0], w.m_Bytes.size());
+
+	return ofs.good();
+}
+
+bool SaveImage(const char* filename, const ImageRect<glm::vec3>& image)
+{
+	const string name(filename);
+	const size_t dotPos = name.find_last_of('.');
+	const string ext = (dotPos == string::npos) ? "" : name.substr(dotPos + 1);
+
+	if (ext == "exr" || ext == "EXR")
+		return SaveImageEXR(filename, image);
+	if (ext == "pfm" || ext == "PFM")
+		return SaveImagePFM(filename, image);
+
+	cerr << __FUNCTION__ << ": unsupported format: " << filename << " (use .pfm or .exr)" << endl;
+	return false;
+}
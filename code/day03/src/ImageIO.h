@@ -0,0 +1,12 @@
+#pragma once
+
+#include "ImageRect.h"
+#include "glm/glm.hpp"
+
+// writers for linear (HDR) RGB images; the first scanline of the image is the bottom one, as in OpenGL
+
+bool SaveImagePFM(const char* filename, const ImageRect<glm::vec3>& image);	// portable float map
+bool SaveImageEXR(const char* filename, const ImageRect<glm::vec3>& image);	// OpenEXR, 32-bit float, uncompressed scanlines
+
+// selects the format from the extension (.pfm or .exr)
+bool SaveImage(const char* filename, const ImageRect<glm::vec3>& image);
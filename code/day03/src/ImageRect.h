@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 #include <cmath>
 #include <algorithm>
@@ -311,6 +312,28 @@ public:
 		}
 	}
 
+	// 2x2 box filter into an image of half the size, rounded up (odd sizes repeat the last row or column)
+	void downsample(ImageRect &img) const
+	{
+		assert(data);
+
+		img.allocate((width+1)/2, (height+1)/2);
+
+		for (int yi=0; yi<img.height; yi++)
+		{
+			const int y0 = 2*yi;
+			const int y1 = std::min(y0+1, height-1);
+
+			for (int xi=0; xi<img.width; xi++)
+			{
+				const int x0 = 2*xi;
+				const int x1 = std::min(x0+1, width-1);
+
+				img.data[xi + img.width*yi] = 0.25f*(data[x0 + width*y0] + data[x1 + width*y0] + data[x0 + width*y1] + data[x1 + width*y1]);
+			}
+		}
+	}
+
 	void fill(const T& v)
 	{
 		assert(data);
@@ -0,0 +1,104 @@
+#include "ImageTexture.h"
+#include <cmath>
+#include <iostream>
+#undef _UNICODE
+#include <IL/il.h>
+
+using namespace std;
+using namespace glm;
+
+ImageTexture *ImageTexture::CreateTexture(const char *filename)
+{
+	ILuint imgName;
+	ilGenImages(1, &imgName);
+	ilBindImage(imgName);
+
+	ilEnable(IL_ORIGIN_SET);
+	ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
+
+	if (!ilLoadImage(filename))
+	{
+		cerr << __FUNCTION__ << ": Error: cannot open " << filename << endl;
+		ilDeleteImages(1, &imgName);
+		return 0;
+	}
+
+	ImageRGBf image(ilGetInteger(IL_IMAGE_WIDTH), ilGetInteger(IL_IMAGE_HEIGHT));
+	ilCopyPixels(0, 0, 0, image.getWidth(), image.getHeight(), 1, IL_RGB, IL_FLOAT, image.getData());
+
+	ilDeleteImages(1, &imgName);
+
+	cerr << __FUNCTION__ << ": file loaded: " << filename << " (" << image.getWidth() << "x" << image.getHeight() << ")" << endl;
+
+	return CreateTexture(image);
+}
+
+ImageTexture *ImageTexture::CreateTexture(const ImageRGBf &image)
+{
+	ImageTexture *t = new (AllocateTexture<ImageTexture>()) ImageTexture(image);
+	RegisterTexture(t);
+	return t;
+}
+
+ImageTexture::ImageTexture(const ImageRGBf &image)
+{
+	int nLevels = 1;
+	for (int w = image.getWidth(), h = image.getHeight(); w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2)
+		++nLevels;
+
+	m_Levels.resize(nLevels);
+	m_Levels[0].copy(image);
+
+	for (int li = 1; li < nLevels; ++li)
+		m_Levels[li - 1].downsample(m_Levels[li]);
+}
+
+vec3 ImageTexture::fetchBilinear(int level, float u, float v) const
+{
+	const ImageRGBf &image = m_Levels[level];
+	const int width = image.getWidth();
+	const int height = image.getHeight();
+
+	// texel centers at (i + 0.5) / size, wrapped around
+	const float x = u * width - 0.5f;
+	const float y = v * height - 0.5f;
+	const float xf = floorf(x);
+	const float yf = floorf(y);
+	const float s = x - xf;
+	const float t = y - yf;
+
+	const int x0 = ((int)xf % width + width) % width;
+	const int y0 = ((int)yf % height + height) % height;
+	const int x1 = (x0 + 1 < width) ? x0 + 1 : 0;
+	const int y1 = (y0 + 1 < height) ? y0 + 1 : 0;
+
+	const vec3 r0 = mix(image(x0, y0), image(x1, y0), s);
+	const vec3 r1 = mix(image(x0, y1), image(x1, y1), s);
+
+	return mix(r0, r1, t);
+}
+
+vec3 ImageTexture::getColor(const vec3 &uvw) const
+{
+	return fetchBilinear(0, uvw.x, uvw.y);
+}
+
+vec3 ImageTexture::getFilteredColor(const vec3 &uvw, float footprint) const
+{
+	// level 0 while the footprint is narrower than a texel
+	const int size = std::max(m_Levels[0].getWidth(), m_Levels[0].getHeight());
+	const float lod = (footprint > 0.f) ? log2f(footprint * size) : 0.f;
+
+	if (lod <= 0.f)
+		return fetchBilinear(0, uvw.x, uvw.y);
+
+	const int lastLevel = (int)m_Levels.size() - 1;
+
+	if (lod >= (float)lastLevel)
+		return fetchBilinear(lastLevel, uvw.x, uvw.y);
+
+	const int level = (int)lod;
+	const float t = lod - level;
+
+	return mix(fetchBilinear(level, uvw.x, uvw.y), fetchBilinear(level + 1, uvw.x, uvw.y), t);
+}
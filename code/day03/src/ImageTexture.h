@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Texture.h"
+#include "ImageRect.h"
+#include "glm/glm.hpp"
+#include <vector>
+
+// texture from an image, repeated outside [0, 1)^2; the mip pyramid built on creation
+// lets getFilteredColor() average over the footprint of a ray cone with a few texel reads
+class ImageTexture : public Texture
+{
+public:
+	typedef ImageRect<glm::vec3> ImageRGBf;
+
+	// destroyed by Texture::ClearTextureCache(); 0 if the file cannot be loaded
+	static ImageTexture *CreateTexture(const char *filename);
+	static ImageTexture *CreateTexture(const ImageRGBf &image);
+
+	using Texture::getColor;
+	glm::vec3 getColor(const glm::vec3 &uvw) const;	// bilinear at the full resolution
+	glm::vec3 getFilteredColor(const glm::vec3 &uvw, float footprint) const;	// trilinear over the pyramid
+
+	Texture_Type getTextureType() const { return Image_Texture; }
+	bool isSolidTexture() const { return false; }
+
+	int getNumLevels() const { return (int)m_Levels.size(); }
+	const ImageRGBf &getLevel(int level) const { return m_Levels[level]; }
+
+private:
+	std::vector<ImageRGBf> m_Levels;	// the image, then 2x2 box-filtered levels down to 1x1
+
+	ImageTexture(const ImageRGBf &image);
+
+	glm::vec3 fetchBilinear(int level, float u, float v) const;
+};
@@ -0,0 +1,93 @@
+#include "Instance.h"
+
+using namespace std;
+using namespace glm;
+
+Instance *Instance::CreateGeometricObject(const GeometricObject *object, const mat4x3 &objectToWorld)
+{
+	BVH *bvh = new BVH();
+	bvh->build(vector<GeometricObject*>(1, const_cast<GeometricObject*>(object)));
+
+	Instance *obj = new (AllocateObject<Instance>()) Instance(object, shared_ptr<const BVH>(bvh), objectToWorld);
+	GeometricObject::RegisterObject(obj);
+	return obj;
+}
+
+void Instance::setTransform(const mat4x3 &objectToWorld)
+{
+	m_ObjectToWorld = objectToWorld;
+	m_WorldToObject = mat4x3(glm::inverse(mat4(objectToWorld)));
+	m_NormalMatrix = glm::transpose(glm::inverse(mat3(objectToWorld)));
+
+	m_BoundingBoxPos[0] = vec3( 1.0e+30f);
+	m_BoundingBoxPos[1] = vec3(-1.0e+30f);
+
+	if (m_pBVH->isEmpty())
+		return;
+
+	const vec3 bboxMin = m_pBVH->getBoundingBoxMin();
+	const vec3 bboxMax = m_pBVH->getBoundingBoxMax();
+
+	for (int i = 0; i < 8; ++i)
+	{
+		const vec3 corner((i & 1) ? bboxMax.x : bboxMin.x, (i & 2) ? bboxMax.y : bboxMin.y, (i & 4) ? bboxMax.z : bboxMin.z);
+		const vec3 p = m_ObjectToWorld * vec4(corner, 1.f);
+
+		m_BoundingBoxPos[0] = glm::min(m_BoundingBoxPos[0], p);
+		m_BoundingBoxPos[1] = glm::max(m_BoundingBoxPos[1], p);
+	}
+}
+
+float Instance::transformRay(const Ray &r, Ray &objectRay) const
+{
+	const vec3 dir = mat3(m_WorldToObject) * r.getUnitDir();
+	const Real scale = glm::length(dir);
+
+	objectRay.setOrigin(m_WorldToObject * vec4(r.getOrigin(), 1.f));
+	objectRay.setUnitDir(dir / scale);
+
+	return scale;
+}
+
+bool Instance::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
+{
+	Ray objectRay;
+	const Real scale = transformRay(r, objectRay);
+
+	if (!m_pBVH->hit(objectRay, tmin * scale, tmax * scale, record))
+		return false;
+
+	record.m_ParamT /= scale;
+	record.m_TexCoordScale *= scale;	// exact for uniform scaling
+	record.m_HitPos = r.calculatePosition(record.m_ParamT);
+	record.m_Normal = glm::normalize(m_NormalMatrix * record.m_Normal);
+
+	// the material of the instance, if any, overrides that of the object
+	if (m_MaterialId >= 0)
+		record.m_MaterialId = m_MaterialId;
+
+	return true;
+}
+
+bool Instance::shadowHit(const Ray &r, Real tmin, Real tmax) const
+{
+	Ray objectRay;
+	const Real scale = transformRay(r, objectRay);
+
+	return m_pBVH->shadowHit(objectRay, tmin * scale, tmax * scale);
+}
+
+#ifndef HEADLESS
+// for preview using OpenGL
+void Instance::drawGL() const
+{
+	const mat4 m(m_ObjectToWorld);
+
+	glPushMatrix();
+	glMultMatrixf(glm::value_ptr(m));
+
+	m_pObject->drawGL();
+
+	glPopMatrix();
+}
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef HEADLESS
+#include <GL/glew.h>
+#endif
+#include "GeometricObject.h"
+#include "BVH.h"
+#include <memory>
+
+// a placed copy of a shared object (e.g. a TriangleMesh) with an affine 4x3 object-to-world transform
+// the object itself is not added to the scene; its primitives are indexed once by a bottom-level BVH in object space,
+// shared by all instances created from each other, and the scene BVH holds each instance as a single primitive
+class Instance : public GeometricObject
+{
+private:
+	Instance(const GeometricObject *object, const std::shared_ptr<const BVH> &bvh, const glm::mat4x3 &objectToWorld)
+		: m_pObject(object), m_pBVH(bvh)
+	{
+		setTransform(objectToWorld);
+	}
+
+public:
+	// builds the bottom-level BVH over the primitives of object
+	static Instance *CreateGeometricObject(const GeometricObject *object, const glm::mat4x3 &objectToWorld);
+
+	// another placement of the object of instance (the BVH is shared, not rebuilt)
+	static Instance *CreateGeometricObject(const Instance *instance, const glm::mat4x3 &objectToWorld)
+	{
+		Instance *obj = new (AllocateObject<Instance>()) Instance(instance->m_pObject, instance->m_pBVH, objectToWorld);
+		obj->m_MaterialId = instance->m_MaterialId;
+		GeometricObject::RegisterObject(obj);
+		return obj;
+	}
+
+	bool hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const;
+	bool shadowHit(const Ray &r, Real tmin, Real tmax) const;
+
+#ifndef HEADLESS
+	void drawGL() const;	// for preview using OpenGL
+#endif
+
+	// after changing the transform of an instance in a scene, call Scene::invalidateAccelerationStructure()
+	// (only the scene BVH is refit)
+	void setTransform(const glm::mat4x3 &objectToWorld);
+	const glm::mat4x3 &getTransform() const { return m_ObjectToWorld; }
+
+	const GeometricObject *getObject() const { return m_pObject; }
+
+	// bounding box of the transformed box of the object
+	vec3 getBoundingBoxMin() const { return m_BoundingBoxPos[0]; }
+	vec3 getBoundingBoxMax() const { return m_BoundingBoxPos[1]; }
+
+private:
+	const GeometricObject *m_pObject;
+	std::shared_ptr<const BVH> m_pBVH;
+
+	glm::mat4x3 m_ObjectToWorld;
+	glm::mat4x3 m_WorldToObject;
+	glm::mat3 m_NormalMatrix;	// inverse transpose of the linear part of m_ObjectToWorld
+
+	vec3 m_BoundingBoxPos[2];
+
+	// the object space ray has a unit direction, so its ray parameter is scaled by the returned factor
+	Real transformRay(const Ray &r, Ray &objectRay) const;
+};
@@ -0,0 +1,240 @@
+#include "LightSource.h"
+#include "Triangle.h"
+#include "MaterialSampling.h"
+#ifndef HEADLESS
+#include <GL/glew.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+static inline float average(const vec3 &c)
+{
+	return (c.r + c.g + c.b) / 3.f;
+}
+
+#ifndef HEADLESS
+static void drawPointGL(const vec3 &p)
+{
+	glPointSize(5.f);
+	glBegin(GL_POINTS);
+	glVertex3fv(value_ptr(p));
+	glEnd();
+	glPointSize(1.f);
+}
+#endif
+
+// PointLight
+
+vec3 PointLight::sample(const vec3 &pos, float u1, float u2, vec3 &wi, float &distance, float &pdf) const
+{
+	const vec3 d = m_Position - pos;
+	const float distance2 = dot(d, d);
+
+	distance = sqrtf(distance2);
+	wi = d / distance;
+	pdf = 1.f;
+
+	return m_Intensity / distance2;
+}
+
+float PointLight::getPower() const
+{
+	return 4.f * pi<float>() * average(m_Intensity);
+}
+
+#ifndef HEADLESS
+void PointLight::drawGL() const
+{
+	drawPointGL(m_Position);
+}
+#endif
+
+// SpotLight
+
+vec3 SpotLight::sample(const vec3 &pos, float u1, float u2, vec3 &wi, float &distance, float &pdf) const
+{
+	const vec3 d = m_Position - pos;
+	const float distance2 = dot(d, d);
+
+	distance = sqrtf(distance2);
+	wi = d / distance;
+	pdf = 1.f;
+
+	const float cosAngle = dot(-wi, m_Direction);
+	const float falloff = glm::smoothstep(m_CosTotalAngle, m_CosFalloffStart, cosAngle);
+
+	return falloff * m_Intensity / distance2;
+}
+
+float SpotLight::getPower() const
+{
+	// the falloff is approximated by its midpoint
+	return 2.f * pi<float>() * (1.f - 0.5f * (m_CosFalloffStart + m_CosTotalAngle)) * average(m_Intensity);
+}
+
+#ifndef HEADLESS
+void SpotLight::drawGL() const
+{
+	drawPointGL(m_Position);
+
+	glBegin(GL_LINES);
+	glVertex3fv(value_ptr(m_Position));
+	glVertex3fv(value_ptr(m_Position + 0.5f * m_Direction));
+	glEnd();
+}
+#endif
+
+// SphereLight
+
+float SphereLight::getConePdf(const vec3 &pos) const
+{
+	const vec3 toCenter = m_Center - pos;
+	const float distance2 = dot(toCenter, toCenter);
+	const float radius2 = m_Radius * m_Radius;
+
+	if (distance2 <= radius2)
+		return 0.f;
+
+	// 1 - cos(thetaMax), written so that it does not cancel out for small or distant spheres
+	const float sinThetaMax2 = radius2 / distance2;
+	const float cosThetaMax = sqrtf(std::max(1.f - sinThetaMax2, 0.f));
+	const float solidAngle = 2.f * pi<float>() * sinThetaMax2 / (1.f + cosThetaMax);
+
+	return 1.f / solidAngle;
+}
+
+vec3 SphereLight::sample(const vec3 &pos, float u1, float u2, vec3 &wi, float &distance, float &pdf) const
+{
+	pdf = getConePdf(pos);
+
+	if (pdf <= 0.f)
+		return vec3(0.f);
+
+	const vec3 toCenter = m_Center - pos;
+	const float distance2 = dot(toCenter, toCenter);
+	const vec3 axis = toCenter / sqrtf(distance2);
+
+	// uniform direction within the cone around the axis
+	const float sinThetaMax2 = m_Radius * m_Radius / distance2;
+	const float cosThetaMax = sqrtf(std::max(1.f - sinThetaMax2, 0.f));
+	const float cosTheta = 1.f - u1 * sinThetaMax2 / (1.f + cosThetaMax);
+	const float sinTheta = sqrtf(std::max(1.f - cosTheta * cosTheta, 0.f));
+	const float phi = 2.f * pi<float>() * u2;
+
+	vec3 xLocal, zLocal;
+	BuildLocalCoordinateSystem(axis, xLocal, zLocal);
+	wi = normalize(cosf(phi) * sinTheta * xLocal + cosTheta * axis + sinf(phi) * sinTheta * zLocal);
+
+	// distance to the near side of the sphere
+	const float b = dot(-toCenter, wi);
+	const float c = distance2 - m_Radius * m_Radius;
+	distance = -b - sqrtf(std::max(b * b - c, 0.f));
+
+	return m_Radiance;
+}
+
+bool SphereLight::hit(const Ray &r, float tmin, float tmax, float &t, vec3 &radiance) const
+{
+	const vec3 v = r.getOrigin() - m_Center;
+	const vec3 d = r.getUnitDir();
+
+	const float b = dot(v, d);
+	const float c = dot(v, v) - m_Radius * m_Radius;
+	const float D = b * b - c;
+
+	// only the outside emits
+	if (c <= 0.f || D <= 0.f)
+		return false;
+
+	t = -b - sqrtf(D);
+
+	if (t < tmin || t > tmax)
+		return false;
+
+	radiance = m_Radiance;
+	return true;
+}
+
+float SphereLight::getPdf(const vec3 &pos, const vec3 &wi, float t) const
+{
+	return getConePdf(pos);
+}
+
+float SphereLight::getPower() const
+{
+	return pi<float>() * 4.f * pi<float>() * m_Radius * m_Radius * average(m_Radiance);
+}
+
+#ifndef HEADLESS
+void SphereLight::drawGL() const
+{
+	drawPointGL(m_Center);
+}
+#endif
+
+// TriangleLight
+
+vec3 TriangleLight::sample(const vec3 &pos, float u1, float u2, vec3 &wi, float &distance, float &pdf) const
+{
+	// uniform point on the triangle
+	const float su1 = sqrtf(u1);
+	const vec3 p = m_Vertex0 + (su1 * (1.f - u2)) * m_Edge1 + (su1 * u2) * m_Edge2;
+
+	const vec3 d = p - pos;
+	const float distance2 = dot(d, d);
+
+	distance = sqrtf(distance2);
+	wi = d / distance;
+
+	const float cosLight = dot(-wi, m_Normal);
+
+	if (cosLight <= 0.f)
+	{
+		pdf = 0.f;
+		return vec3(0.f);
+	}
+
+	pdf = distance2 / (m_Area * cosLight);
+
+	return m_Radiance;
+}
+
+bool TriangleLight::hit(const Ray &r, float tmin, float tmax, float &t, vec3 &radiance) const
+{
+	if (dot(r.getUnitDir(), m_Normal) >= 0.f)
+		return false;
+
+	float beta, gamma;
+	if (!Triangle::Intersect(m_Vertex0, m_Edge1, m_Edge2, r, tmin, tmax, t, beta, gamma))
+		return false;
+
+	radiance = m_Radiance;
+	return true;
+}
+
+float TriangleLight::getPdf(const vec3 &pos, const vec3 &wi, float t) const
+{
+	const float cosLight = dot(-wi, m_Normal);
+
+	return (cosLight > 0.f) ? t * t / (m_Area * cosLight) : 0.f;
+}
+
+float TriangleLight::getPower() const
+{
+	return pi<float>() * m_Area * average(m_Radiance);
+}
+
+#ifndef HEADLESS
+void TriangleLight::drawGL() const
+{
+	const vec3 v1 = m_Vertex0 + m_Edge1;
+	const vec3 v2 = m_Vertex0 + m_Edge2;
+
+	glBegin(GL_TRIANGLES);
+	glVertex3fv(value_ptr(m_Vertex0));
+	glVertex3fv(value_ptr(v1));
+	glVertex3fv(value_ptr(v2));
+	glEnd();
+}
+#endif
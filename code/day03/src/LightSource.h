@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Ray.h"
+#include "glm/glm.hpp"
+
+// light sources sampled by next-event estimation; they are not part of the BVH
+// area lights (SphereLight, TriangleLight) are also found by the rays of BSDF sampling through hit(),
+// point and spot lights are delta lights that only next-event estimation can reach
+class LightSource
+{
+public:
+	virtual ~LightSource() {}
+
+	// samples a direction wi from pos towards the light; returns the incident radiance along wi
+	// (intensity / distance^2 for delta lights), or zero if pos does not receive light from the sample;
+	// distance is that of the sampled point and pdf the solid angle density of wi (1 for delta lights)
+	virtual glm::vec3 sample(const glm::vec3 &pos, float u1, float u2, glm::vec3 &wi, float &distance, float &pdf) const = 0;
+
+	virtual bool isDelta() const { return false; }
+
+	// nearest hit of the emitting surface in [tmin, tmax]; radiance is that emitted towards the ray origin
+	virtual bool hit(const Ray &r, float tmin, float tmax, float &t, glm::vec3 &radiance) const { return false; }
+
+	// solid angle density of sample() choosing wi from pos, when wi hits the light at distance t
+	virtual float getPdf(const glm::vec3 &pos, const glm::vec3 &wi, float t) const { return 0.f; }
+
+	virtual float getPower() const = 0;	// average over RGB; lights are chosen in proportion to it
+
+#ifndef HEADLESS
+	virtual void drawGL() const = 0;	// for preview using OpenGL
+#endif
+};
+
+class PointLight : public LightSource
+{
+public:
+	PointLight(const glm::vec3 &position, const glm::vec3 &intensity)
+		: m_Position(position), m_Intensity(intensity)
+	{
+	}
+
+	glm::vec3 sample(const glm::vec3 &pos, float u1, float u2, glm::vec3 &wi, float &distance, float &pdf) const;
+	bool isDelta() const { return true; }
+	float getPower() const;
+#ifndef HEADLESS
+	void drawGL() const;
+#endif
+
+private:
+	glm::vec3 m_Position;
+	glm::vec3 m_Intensity;	// radiant intensity (W/sr)
+};
+
+// point light restricted to a cone, with a smooth falloff between the two cone angles
+class SpotLight : public LightSource
+{
+public:
+	SpotLight(const glm::vec3 &position, const glm::vec3 &direction, const glm::vec3 &intensity, float totalAngle, float falloffStartAngle)
+		: m_Position(position), m_Direction(glm::normalize(direction)), m_Intensity(intensity),
+		m_CosTotalAngle(cosf(totalAngle)), m_CosFalloffStart(cosf(falloffStartAngle))
+	{
+	}
+
+	glm::vec3 sample(const glm::vec3 &pos, float u1, float u2, glm::vec3 &wi, float &distance, float &pdf) const;
+	bool isDelta() const { return true; }
+	float getPower() const;
+#ifndef HEADLESS
+	void drawGL() const;
+#endif
+
+private:
+	glm::vec3 m_Position;
+	glm::vec3 m_Direction;
+	glm::vec3 m_Intensity;	// on the axis
+	float m_CosTotalAngle;
+	float m_CosFalloffStart;
+};
+
+// sphere emitting uniform radiance, sampled within the cone of directions it subtends
+class SphereLight : public LightSource
+{
+public:
+	SphereLight(const glm::vec3 &center, float radius, const glm::vec3 &radiance)
+		: m_Center(center), m_Radius(radius), m_Radiance(radiance)
+	{
+	}
+
+	glm::vec3 sample(const glm::vec3 &pos, float u1, float u2, glm::vec3 &wi, float &distance, float &pdf) const;
+	bool hit(const Ray &r, float tmin, float tmax, float &t, glm::vec3 &radiance) const;
+	float getPdf(const glm::vec3 &pos, const glm::vec3 &wi, float t) const;
+	float getPower() const;
+#ifndef HEADLESS
+	void drawGL() const;
+#endif
+
+private:
+	glm::vec3 m_Center;
+	float m_Radius;
+	glm::vec3 m_Radiance;
+
+	float getConePdf(const glm::vec3 &pos) const;	// 0 if pos is inside the sphere
+};
+
+// one-sided emitting triangle, facing the side of cross(v1 - v0, v2 - v0); sampled uniformly by area
+class TriangleLight : public LightSource
+{
+public:
+	TriangleLight(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, const glm::vec3 &radiance)
+		: m_Vertex0(v0), m_Edge1(v1 - v0), m_Edge2(v2 - v0), m_Radiance(radiance)
+	{
+		const glm::vec3 c = glm::cross(m_Edge1, m_Edge2);
+		m_Area = 0.5f * glm::length(c);
+		m_Normal = glm::normalize(c);
+	}
+
+	glm::vec3 sample(const glm::vec3 &pos, float u1, float u2, glm::vec3 &wi, float &distance, float &pdf) const;
+	bool hit(const Ray &r, float tmin, float tmax, float &t, glm::vec3 &radiance) const;
+	float getPdf(const glm::vec3 &pos, const glm::vec3 &wi, float t) const;
+	float getPower() const;
+#ifndef HEADLESS
+	void drawGL() const;
+#endif
+
+private:
+	glm::vec3 m_Vertex0;
+	glm::vec3 m_Edge1, m_Edge2;
+	glm::vec3 m_Normal;
+	float m_Area;
+	glm::vec3 m_Radiance;
+};
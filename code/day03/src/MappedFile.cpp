@@ -0,0 +1,92 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifndef _WIN32
+
+bool MappedFile::open(const char* filename)
+{
+	close();
+
+	const int fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);	// the mapping stays valid
+
+	if (p == MAP_FAILED)
+	{
+		cerr << __FUNCTION__ << ": cannot map " << filename << endl;
+		return false;
+	}
+
+	m_pData = (const unsigned char*)p;
+	m_Size = (size_t)st.st_size;
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_pData && m_Buffer.empty())
+		munmap((void*)m_pData, m_Size);
+
+	m_pData = 0;
+	m_Size = 0;
+	m_Buffer.clear();
+}
+
+#else
+
+bool MappedFile::open(const char* filename)
+{
+	close();
+
+	ifstream ifs(filename, ios::binary | ios::ate);
+	if (!ifs)
+		return false;
+
+	const streamoff size = ifs.tellg();
+	if (size <= 0)
+		return false;
+
+	m_Buffer.resize((size_t)size);
+	ifs.seekg(0);
+
+	if (!ifs.read((char*)&m_Buffer[0], size))
+	{
+		m_Buffer.clear();
+		return false;
+	}
+
+	m_pData = &m_Buffer[0];
+	m_Size = m_Buffer.size();
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	m_pData = 0;
+	m_Size = 0;
+	m_Buffer.clear();
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// read-only view of a whole file, memory-mapped where mmap is available (read into memory otherwise)
+class MappedFile
+{
+public:
+	MappedFile() : m_pData(0), m_Size(0) {}
+	~MappedFile() { close(); }
+
+	bool open(const char* filename);
+	void close();
+
+	const unsigned char* getData() const { return m_pData; }
+	size_t getSize() const { return m_Size; }
+
+private:
+	const unsigned char* m_pData;
+	size_t m_Size;
+	std::vector<unsigned char> m_Buffer;	// used if the file is not mapped
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
@@ -1,4 +1,28 @@
 #include "Material.h"
 
-std::vector<Material *> Material::material_cache;
+Arena Material::s_MaterialArena;
+std::vector<MaterialData> Material::s_MaterialTable;
 
+int Material::AllocateMaterialData(Material_Type type)
+{
+	MaterialData d;
+	d.m_Type = type;
+	d.m_AmbientCoeff = glm::vec3(0.f);
+	d.m_DiffuseCoeff = glm::vec3(0.f);
+	d.m_SpecularCoeff = glm::vec3(0.f);
+	d.m_Shininess = 0.f;
+	d.m_RefractionIndex = 1.f;
+	d.m_DispersionCoeff = 0.f;
+	d.m_pTexture = 0;
+
+	s_MaterialTable.push_back(d);
+	return (int)s_MaterialTable.size() - 1;
+}
+
+int Material::CopyMaterialData(int materialId)
+{
+	const MaterialData d = s_MaterialTable[materialId];	// copied first; push_back may reallocate the table
+
+	s_MaterialTable.push_back(d);
+	return (int)s_MaterialTable.size() - 1;
+}
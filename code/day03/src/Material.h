@@ -1,8 +1,27 @@
 #pragma once
 
 #include "HitRecord.h"
+#include "Arena.h"
 #include <vector>
 
+class Texture;
+
+// shading parameters of a material (the fields that its type does not use are ignored)
+// all of them are kept in one contiguous table indexed by the material id stored in HitRecord,
+// so that shading reads plain data instead of calling into Material objects
+struct MaterialData
+{
+	int m_Type;	// Material::Material_Type
+	glm::vec3 m_AmbientCoeff;
+	glm::vec3 m_DiffuseCoeff;
+	glm::vec3 m_SpecularCoeff;
+	float m_Shininess;	// power of cosine lobe
+	float m_RefractionIndex;
+	float m_DispersionCoeff;	// Cauchy's B in um^2, used by the spectral mode of the path tracer
+	const Texture *m_pTexture;	// destroyed by Texture::ClearTextureCache()
+};
+
+// a Material object is a handle to its entry in the material table; the derived classes provide typed setters/getters
 class Material
 {
 protected:
@@ -10,22 +29,23 @@ protected:
 	typedef float Real;
 
 	Material()
-		: ambient(0,0,0)
+		: m_MaterialId(AllocateMaterialData(Ambient_Type))
 	{
 	}
 
 	Material(const glm::vec3 &_ambient)
-		: ambient(_ambient)
+		: m_MaterialId(AllocateMaterialData(Ambient_Type))
 	{
+		data().m_AmbientCoeff = _ambient;
 	}
 
 	Material(const Material *m)
-		: ambient(m->ambient)
+		: m_MaterialId(CopyMaterialData(m->m_MaterialId))
 	{
 	}
 
 	Material(const Material &m)
-		: ambient(m.ambient)
+		: m_MaterialId(CopyMaterialData(m.m_MaterialId))
 	{
 	}
 
@@ -38,60 +58,76 @@ public:
 		Blinn_Phong_Type,
 		Textured_Type,
 		Perfect_Specular_Type,
-		Specular_Refraction_Type
+		Specular_Refraction_Type,
+		Num_Material_Types
 	};
 
+	// destroys all the materials created by CreateMaterial() and releases their blocks at once
 	static void ClearMaterialCache()
 	{
-		for (int i=0; i<(int)material_cache.size(); i++)
-			delete material_cache[i];
-		material_cache.clear();
+		s_MaterialArena.clear();
+		s_MaterialTable.clear();
 	}
 
 	static Material *CreateMaterial()
 	{
-		Material *m = new Material();
-		material_cache.push_back( m );
+		Material *m = new (AllocateMaterial<Material>()) Material();
+		RegisterMaterial(m);
 		return m;
 	}
 
 	static Material *CreateMaterial(const vec3 &_ambient)
 	{
-		Material *m = new Material(_ambient);
-		material_cache.push_back( m );
+		Material *m = new (AllocateMaterial<Material>()) Material(_ambient);
+		RegisterMaterial(m);
 		return m;
 	}
 
 	static Material *CreateMaterial(const Material *_m)
 	{
-		Material *m = new Material(_m);
-		material_cache.push_back( m );
+		Material *m = new (AllocateMaterial<Material>()) Material(_m);
+		RegisterMaterial(m);
 		return m;
 	}
 
 	static Material *CreateMaterial(const Material &_m)
 	{
-		Material *m = new Material(_m);
-		material_cache.push_back( m );
+		Material *m = new (AllocateMaterial<Material>()) Material(_m);
+		RegisterMaterial(m);
 		return m;
 	}
 
+	static const MaterialData &GetMaterialData(int materialId) { return s_MaterialTable[materialId]; }
+
 	virtual ~Material()
 	{
 	}
 
-	virtual Material_Type getMaterialType() const { return Ambient_Type; }
+	int getMaterialId() const { return m_MaterialId; }
+	Material_Type getMaterialType() const { return (Material_Type)data().m_Type; }
 
 	virtual void clone(Material **m) const { *m = new Material(*this); }
 
-	vec3 getAmbientCoeff() const { return ambient; }
-	void setAmbientCoeff(const vec3 &a) { ambient = a; }
-	void setAmbientCoeff(Real r, Real g, Real b) { ambient = glm::vec3(r,g,b); }
+	vec3 getAmbientCoeff() const { return data().m_AmbientCoeff; }
+	void setAmbientCoeff(const vec3 &a) { data().m_AmbientCoeff = a; }
+	void setAmbientCoeff(Real r, Real g, Real b) { data().m_AmbientCoeff = glm::vec3(r,g,b); }
 
 protected:
-	vec3 ambient;
+	const int m_MaterialId;
 
-	static std::vector<Material *> material_cache;
+	MaterialData &data() { return s_MaterialTable[m_MaterialId]; }
+	const MaterialData &data() const { return s_MaterialTable[m_MaterialId]; }
 
-};
+	static Arena s_MaterialArena;
+
+	// for CreateMaterial(): m = new (AllocateMaterial<T>()) T(...); RegisterMaterial(m);
+	template <class T>
+	static void *AllocateMaterial() { return s_MaterialArena.allocate<T>(); }
+	template <class T>
+	static void RegisterMaterial(T *m) { s_MaterialArena.registerDestructor(m); }
+	static std::vector<MaterialData> s_MaterialTable;
 
+	static int AllocateMaterialData(Material_Type type);
+	static int CopyMaterialData(int materialId);
+
+};
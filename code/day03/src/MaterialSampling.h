@@ -0,0 +1,104 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "glm/ext.hpp"
+#include <algorithm>
+#include <cmath>
+
+// BRDF sampling and evaluation shared by PathTracer::traceRec and WavefrontIntegrator
+// directions point away from the surface (wo towards the viewer, wi towards the light); the normal faces wo
+
+// orthonormal basis (xLocal, normal, zLocal), with the normal as the local y axis
+inline void BuildLocalCoordinateSystem(const glm::vec3 &normal, glm::vec3 &xLocal, glm::vec3 &zLocal)
+{
+	xLocal = glm::normalize((fabsf(normal.y) < 0.9f) ? glm::cross(normal, glm::vec3(0.f, 1.f, 0.f)) : glm::cross(normal, glm::vec3(1.f, 0.f, 0.f)));
+	zLocal = glm::cross(xLocal, normal);
+}
+
+// theta is measured from the tangent plane, so sin(theta) is the cosine to the normal
+inline glm::vec3 LocalToWorld(const glm::vec3 &normal, float phi, float theta)
+{
+	glm::vec3 xLocal, zLocal;
+	BuildLocalCoordinateSystem(normal, xLocal, zLocal);
+
+	return glm::normalize(cosf(phi) * cosf(theta) * xLocal + sinf(theta) * normal + sinf(phi) * cosf(theta) * zLocal);
+}
+
+// Lambert: pdf = cos / pi
+
+inline glm::vec3 SampleCosineWeightedDirection(const glm::vec3 &normal, float xi1, float xi2)
+{
+	return LocalToWorld(normal, 2.f * glm::pi<float>() * xi1, acosf(sqrtf(xi2)));
+}
+
+inline float CosineWeightedPdf(const glm::vec3 &normal, const glm::vec3 &wi)
+{
+	return std::max(glm::dot(normal, wi), 0.f) / glm::pi<float>();
+}
+
+// Blinn-Phong specular lobe: f = ks (n + 8) / (8 pi) cos^n(theta_h), energy-normalized, sampled through the half vector
+
+inline glm::vec3 SampleBlinnPhongDirection(const glm::vec3 &normal, const glm::vec3 &wo, float shininess, float xi1, float xi2)
+{
+	const glm::vec3 half = LocalToWorld(normal, 2.f * glm::pi<float>() * xi1, asinf(powf(xi2, 1.f / (shininess + 1.f))));
+	return glm::reflect(-wo, half);
+}
+
+inline float BlinnPhongPdf(const glm::vec3 &normal, const glm::vec3 &wo, const glm::vec3 &wi, float shininess)
+{
+	const glm::vec3 half = glm::normalize(wo + wi);
+	const float cosHalf = std::max(glm::dot(normal, half), 0.f);
+	const float woDotHalf = glm::dot(wo, half);
+
+	if (woDotHalf <= 0.f)
+		return 0.f;
+
+	return (shininess + 1.f) / (2.f * glm::pi<float>()) * powf(cosHalf, shininess) / (4.f * woDotHalf);
+}
+
+inline glm::vec3 EvalBlinnPhongSpecular(const glm::vec3 &normal, const glm::vec3 &wo, const glm::vec3 &wi, const glm::vec3 &specularCoeff, float shininess)
+{
+	const glm::vec3 half = glm::normalize(wo + wi);
+	return specularCoeff * ((shininess + 8.f) / (8.f * glm::pi<float>())) * powf(std::max(glm::dot(normal, half), 0.f), shininess);
+}
+
+// lobe selection of the Blinn-Phong material: diffuse with probability m_DiffuseProb, specular with m_SpecularProb,
+// the path is terminated otherwise (russian roulette starts after the minimum recursion depth)
+struct BlinnPhongLobes
+{
+	float m_DiffuseProb;
+	float m_SpecularProb;
+
+	BlinnPhongLobes(const glm::vec3 &diffuseCoeff, const glm::vec3 &specularCoeff, bool applyRussianRoulette)
+	{
+		const glm::vec3 dsCoeff = diffuseCoeff + specularCoeff;
+		const float continueProb = applyRussianRoulette ? std::min(std::max(dsCoeff.x, std::max(dsCoeff.y, dsCoeff.z)), 1.f) : 1.f;
+
+		m_DiffuseProb = std::min(std::max(diffuseCoeff.x, std::max(diffuseCoeff.y, diffuseCoeff.z)), continueProb);
+		m_SpecularProb = continueProb - m_DiffuseProb;
+	}
+
+	// density of the sampled direction given that the path continues (used for multiple importance sampling)
+	float getPdf(const glm::vec3 &normal, const glm::vec3 &wo, const glm::vec3 &wi, float shininess) const
+	{
+		const float continueProb = m_DiffuseProb + m_SpecularProb;
+		if (continueProb <= 0.f)
+			return 0.f;
+
+		return (m_DiffuseProb * CosineWeightedPdf(normal, wi) + m_SpecularProb * BlinnPhongPdf(normal, wo, wi, shininess)) / continueProb;
+	}
+};
+
+inline float PowerHeuristic(float pdf, float otherPdf)
+{
+	const float p2 = pdf * pdf;
+	const float sum = p2 + otherPdf * otherPdf;
+	return (sum > 0.f) ? p2 / sum : 0.f;
+}
+
+// spread angle of the cone that a sampled direction stands for: each of the nSamples directions per pixel drawn with
+// the density pdf (per unit solid angle) covers a solid angle of 1 / (pdf nSamples), so the filtering vanishes as nSamples grows
+inline float SampleConeAngle(float pdf, int nSamples)
+{
+	return (pdf > 0.f) ? 2.f * sqrtf(1.f / (glm::pi<float>() * pdf * nSamples)) : 0.f;
+}
@@ -1,16 +1,21 @@
+#ifndef HEADLESS
 #include <GL/glew.h>
+#include "GLSLProgramObject.h"
+#endif
 #include "PathTracer.h"
-#include "GLFW/glfw3.h"
 #include "arcball_camera.h"
 #include "Scene.h"
 #include "HitRecord.h"
+#include "MaterialSampling.h"
+#include "Spectrum.h"
 #include <iostream>
 #include <chrono>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-#include "DiffuseMaterial.h"
-#include "BlinnPhongMaterial.h"
-#include "PerfectSpecularMaterial.h"
-#include "SpecularRefractionMaterial.h"
+#include "Material.h"
+#include "Texture.h"
 
 using namespace std;
 using namespace glm;
@@ -20,63 +25,546 @@ int PathTracer::s_MaxRecursionDepth = 32;
 int PathTracer::s_MinRecursionDepth = 5;
 int PathTracer::s_NumSamplesPerPixel = 100;
 int PathTracer::s_NumSamplesPerUpdate = 5;
+unsigned int PathTracer::s_RandomSeed = 12345;
+RandomStream::Sampler_Type PathTracer::s_SamplerType = RandomStream::Independent_Sampler;
+int PathTracer::s_TileSize = 16;
+int PathTracer::s_NumThreads = 0;
+bool PathTracer::s_ReportTileTimes = false;
+bool PathTracer::s_UsePacketTracing = true;
+bool PathTracer::s_UseWavefront = false;
+bool PathTracer::s_UseAdaptiveSampling = false;
+float PathTracer::s_AdaptiveErrorThreshold = 0.02f;
+int PathTracer::s_MinAdaptiveSamples = 16;
+int PathTracer::s_MaxAdaptiveSamplesScale = 8;
+std::atomic<bool> PathTracer::s_DisplaySampleCountHeatmap(false);
+bool PathTracer::s_UseEnvironmentSampling = true;
+bool PathTracer::s_UseLightSampling = true;
+bool PathTracer::s_UseRayCones = true;
+bool PathTracer::s_UseDenoiser = false;
+unsigned int PathTracer::s_AOVMask = 0;
+bool PathTracer::s_UseSpectralDispersion = false;
+int PathTracer::s_FresnelSplitDepth = 2;
+
+PathTracer::~PathTracer()
+{
+	stopBackgroundRendering();
+#ifndef HEADLESS
+	if (m_FrameBufferTexID) glDeleteTextures(1, &m_FrameBufferTexID);
+	if (m_pGammaShader) delete m_pGammaShader;
+#endif
+}
+
+void PathTracer::renderScene(Scene &scene, const ArcballCamera &camera, int width, int height, const mat4 &projMatrix)
+{
+	stopBackgroundRendering();
+
+	setupCameraFrame(camera, width, height, 0.5f * height * projMatrix[1][1]);
+	render(scene, s_NumSamplesPerPixel, true);
+}
+
+void PathTracer::renderImage(Scene &scene, const ArcballCamera &camera, float fovy, int width, int height, int nSamplesPerPixel)
+{
+	stopBackgroundRendering();
+
+	setupCameraFrame(camera, width, height, 0.5f * height / tanf(0.5f * radians(fovy)));
+	render(scene, nSamplesPerPixel, false);
+}
+
+void PathTracer::startBackgroundRendering(Scene &scene, const ArcballCamera &camera, int width, int height, const mat4 &projMatrix)
+{
+	stopBackgroundRendering();
+
+	setupCameraFrame(camera, width, height, 0.5f * height * projMatrix[1][1]);
+
+	m_IsBackgroundRendering = true;
+	m_CancelRequested = false;
+	m_IsBackgroundRenderingDone = false;
+	m_PublishedEpoch = 0;
+	m_ConsumedEpoch = 0;
+
+	m_BackgroundThread = thread([this, &scene]()
+	{
+		render(scene, s_NumSamplesPerPixel, false);
+
+		// the display may not have been ready for the last pass
+		while (!m_CancelRequested && !publishPass())
+			this_thread::sleep_for(chrono::milliseconds(1));
+
+		m_IsBackgroundRenderingDone = true;
+	});
+}
+
+void PathTracer::stopBackgroundRendering()
+{
+	if (!m_BackgroundThread.joinable())
+		return;
+
+	m_CancelRequested = true;
+	m_BackgroundThread.join();
 
-extern GLFWwindow *g_pWindow;
-extern ArcballCamera g_Camera;
-extern Scene g_Scene;
-extern int g_WindowWidth, g_WindowHeight;
-extern mat4 g_ProjMatrix;
-extern bool g_KeepTracing;
+	m_IsBackgroundRendering = false;
+	m_CancelRequested = false;
+}
 
-void PathTracer::renderScene()
+bool PathTracer::isBackgroundRenderingOutdated(const ArcballCamera &camera, int width, int height, const mat4 &projMatrix) const
+{
+	if (!m_BackgroundThread.joinable())
+		return true;
+
+	return !(MakeCameraFrame(camera, width, height, 0.5f * height * projMatrix[1][1]) == m_CameraFrame);
+}
+
+PathTracer::CameraFrame PathTracer::MakeCameraFrame(const ArcballCamera &camera, int width, int height, float screenDist)
+{
+	CameraFrame f;
+	camera.getEyeCoordinateSystem(f.m_XAxis, f.m_YAxis, f.m_ZAxis, f.m_Eye);
+	f.m_HalfWidth = 0.5f * width;
+	f.m_HalfHeight = 0.5f * height;
+	f.m_ScreenDist = screenDist;
+
+	return f;
+}
+
+void PathTracer::setupCameraFrame(const ArcballCamera &camera, int width, int height, float screenDist)
+{
+	m_CameraFrame = MakeCameraFrame(camera, width, height, screenDist);
+
+	m_FrameBuffer.allocate(width, height);
+}
+
+void PathTracer::render(Scene &scene, int nSamplesPerPixel, bool invokeCallback)
 {
 	const auto tStart = chrono::system_clock::now();
 
-	vec3 xAxis, yAxis, zAxis, eye;
-	g_Camera.getEyeCoordinateSystem(xAxis, yAxis, zAxis, eye);
+	scene.updateAccelerationStructure();
+	m_pScene = &scene;
+
+	const int width = m_FrameBuffer.getWidth();
+	const int height = m_FrameBuffer.getHeight();
+
+#ifdef _OPENMP
+	const int nThreads = (s_NumThreads > 0) ? s_NumThreads : omp_get_max_threads();
+#else
+	const int nThreads = 1;
+#endif
+
+	m_TileScheduler.setup(width, height, s_TileSize, nThreads);
+
+	// also allocated when unused, since the settings may be switched during background rendering
+	m_WavefrontIntegrators.resize(nThreads);
+	m_WavefrontQueues.resize(nThreads);
 
-	m_FrameBuffer.allocate(g_WindowWidth, g_WindowHeight);
+	m_Statistics.clear();
+	m_WorkerStatistics.assign(nThreads, RenderStatistics());
 
-	const float halfWidth = 0.5f * g_WindowWidth;
-	const float halfHeight = 0.5f * g_WindowHeight;
-	const float screenDist = halfHeight * g_ProjMatrix[1][1];
+	m_FrameBuffer.fill(vec3(0.f));
+	m_SampleCounts.allocate(width, height);
+	m_SampleCounts.fill(0);
+	m_LuminanceM2.allocate(width, height);
+	m_LuminanceM2.fill(0.f);
+	m_UseDenoiser = s_UseDenoiser;
+	m_AOVs.allocate(width, height, m_UseDenoiser ? (s_AOVMask | AOVBuffer::Denoiser_AOV_Mask) : s_AOVMask);
+	m_IsDenoised = false;
 
-	int nRemainingSamples = s_NumSamplesPerPixel;
+	// with adaptive sampling the budget of the whole image stays the same, but single pixels may take more samples
+	m_NumSamplesPerPixel = nSamplesPerPixel;
+	m_MaxSamplesPerPixel = s_UseAdaptiveSampling ? nSamplesPerPixel * std::max(s_MaxAdaptiveSamplesScale, 1) : nSamplesPerPixel;
 
-	while (nRemainingSamples > 0)
+	const long long nBudgetSamples = (long long)nSamplesPerPixel * width * height;
+	long long nSamplesDone = 0;
+
+	while (nSamplesDone < nBudgetSamples)
 	{
-		const int nSamplesDone = s_NumSamplesPerPixel - nRemainingSamples;
-		const int nNewRemainingSamples = std::max(nRemainingSamples - s_NumSamplesPerUpdate, 0);
-		const int nNewSamples = nRemainingSamples - nNewRemainingSamples;
-		const int nNewSamplesDone = nSamplesDone + nNewSamples;
+		long long nPassSamples = 0;
+
+		// a cheap first pass, so that a restarted background rendering shows the new view quickly
+		m_NumSamplesPerPass = (m_IsBackgroundRendering && nSamplesDone == 0) ? 1 : s_NumSamplesPerUpdate;
+
+		m_TileScheduler.reset();
 
-#pragma omp parallel for
-		for (int yi = 0; yi < g_WindowHeight; ++yi)
+#pragma omp parallel num_threads(nThreads) reduction(+:nPassSamples)
 		{
-			for (int xi = 0; xi < g_WindowWidth; ++xi)
+#ifdef _OPENMP
+			const int workerIdx = omp_get_thread_num();
+#else
+			const int workerIdx = 0;
+#endif
+			int tileIdx;
+
+			while (!m_CancelRequested.load(memory_order_relaxed) && m_TileScheduler.pop(workerIdx, tileIdx))
 			{
-				vec3 pixelColor = float(nSamplesDone) * m_FrameBuffer(xi, yi);
+				const auto tTileStart = chrono::steady_clock::now();
 
-				for (int si = 0; si < nNewSamples; ++si)
-				{
-					const vec3 dir = (xi + frand() - halfWidth) * xAxis + (yi + frand() - halfHeight) * yAxis - screenDist * zAxis;
-					pixelColor += traceRec(Ray(eye, glm::normalize(dir)), 0);
-				}
+				nPassSamples += renderTile(m_TileScheduler.getTile(tileIdx), workerIdx);
 
-				m_FrameBuffer(xi, yi) = pixelColor / float(nNewSamplesDone);
+				const auto tTileEnd = chrono::steady_clock::now();
+				m_TileScheduler.setTileTime(tileIdx, chrono::duration<float, milli>(tTileEnd - tTileStart).count());
 			}
 		}
 
-		nRemainingSamples = nNewRemainingSamples;
+		for (int ti = 0; ti < nThreads; ++ti)
+		{
+			m_Statistics += m_WorkerStatistics[ti];
+			m_WorkerStatistics[ti].clear();
+		}
+
+		// a cancelled pass is incomplete and not published
+		if (m_CancelRequested)
+			return;
+
+		// every pixel has converged or reached the maximum number of samples
+		if (nPassSamples == 0)
+			break;
+
+		nSamplesDone += nPassSamples;
 
-		renderIntermediateFrame();
+		// only the passes that are displayed are denoised; a headless rendering denoises its final image
+		if (m_UseDenoiser && (invokeCallback || m_IsBackgroundRendering))
+			denoiseFrameBuffer();
+
+		if (invokeCallback && m_IntermediateFrameCallback)
+			m_IntermediateFrameCallback();
+
+		if (m_IsBackgroundRendering)
+			publishPass();
 
 		const auto tNow = chrono::system_clock::now();
 		const auto elapsed = chrono::duration_cast<chrono::milliseconds>(tNow - tStart).count() / 1000.f;
-		cerr << __FUNCTION__ << ": " << nNewSamplesDone << "/" << s_NumSamplesPerPixel << " samples (" << elapsed << " sec)" << endl;
+		cerr << __FUNCTION__ << ": " << float(nSamplesDone) / (width * height) << "/" << nSamplesPerPixel << " samples (" << elapsed << " sec)" << endl;
+
+		if (s_ReportTileTimes)
+			m_TileScheduler.printTileTimeStatistics(__FUNCTION__);
+	}
+
+	if (m_UseDenoiser && !invokeCallback && !m_IsBackgroundRendering)
+		denoiseFrameBuffer();
+}
+
+void PathTracer::denoiseFrameBuffer()
+{
+	const auto tStart = chrono::steady_clock::now();
+
+	const int width = m_FrameBuffer.getWidth();
+	const int height = m_FrameBuffer.getHeight();
+
+	// variance of the mean luminance; unknown below two samples, where only the guides stop the filter
+	ImageRect<float> variance(width, height);
+
+	for (int yi = 0; yi < height; ++yi)
+	{
+		for (int xi = 0; xi < width; ++xi)
+		{
+			const int nSamples = m_SampleCounts(xi, yi);
+			variance(xi, yi) = (nSamples >= 2) ? m_LuminanceM2(xi, yi) / (float(nSamples - 1) * nSamples) : 1.0e+30f;
+		}
 	}
+
+	m_IsDenoised = m_Denoiser.denoise(m_FrameBuffer, variance, m_AOVs, m_DenoisedFrameBuffer);
+
+	const auto tEnd = chrono::steady_clock::now();
+	cerr << __FUNCTION__ << ": " << chrono::duration<float, milli>(tEnd - tStart).count() << " ms" << endl;
 }
 
+static inline float luminance(const vec3 &c)
+{
+	return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+RenderStatistics &PathTracer::getWorkerStatistics()
+{
+#ifdef _OPENMP
+	return m_WorkerStatistics[omp_get_thread_num()];
+#else
+	return m_WorkerStatistics[0];
+#endif
+}
+
+int PathTracer::getNumNewSamples(int xi, int yi) const
+{
+	const int nSamples = m_SampleCounts(xi, yi);
+	const int nRemainingSamples = m_MaxSamplesPerPixel - nSamples;
+
+	if (nRemainingSamples <= 0)
+		return 0;
+
+	if (s_UseAdaptiveSampling && nSamples >= std::max(s_MinAdaptiveSamples, 2))
+	{
+		// relative standard error of the mean luminance
+		const float mean = luminance(m_FrameBuffer(xi, yi));
+		const float variance = m_LuminanceM2(xi, yi) / (nSamples - 1);
+		const float standardError = sqrtf(variance / nSamples);
+
+		if (standardError <= s_AdaptiveErrorThreshold * std::max(mean, 1.0e-3f))
+			return 0;
+	}
+
+	return std::min(m_NumSamplesPerPass, nRemainingSamples);
+}
+
+void PathTracer::addSample(int xi, int yi, const vec3 &color, const FirstHitAttributes &firstHit)
+{
+	// running mean of the color and Welford's update of the luminance variance
+	const int nSamples = ++m_SampleCounts(xi, yi);
+	vec3 &mean = m_FrameBuffer(xi, yi);
+
+	const float sampleLuminance = luminance(color);
+	const float delta = sampleLuminance - luminance(mean);
+
+	mean += (color - mean) / float(nSamples);
+	m_LuminanceM2(xi, yi) += delta * (sampleLuminance - luminance(mean));
+
+	if (m_AOVs.getTypeMask())
+		m_AOVs.addSample(xi + m_AOVs.getWidth() * yi, nSamples, firstHit);
+}
+
+Ray PathTracer::generatePrimaryRay(int xi, int yi, RandomStream &rng) const
+{
+	const CameraFrame &c = m_CameraFrame;
+
+	const float dx = rng.next();
+	const float dy = rng.next();
+	const vec3 dir = (xi + dx - c.m_HalfWidth) * c.m_XAxis + (yi + dy - c.m_HalfHeight) * c.m_YAxis - c.m_ScreenDist * c.m_ZAxis;
+
+	// a pixel spans 1 / screenDist radians at the center of the screen
+	return Ray(c.m_Eye, glm::normalize(dir), s_UseRayCones ? 1.f / c.m_ScreenDist : 0.f);
+}
+
+float PathTracer::GetBounceConeAngle(float coneAngle, float pdf, int nSamplesPerPixel)
+{
+	return coneAngle + SampleConeAngle(pdf, nSamplesPerPixel);
+}
+
+float PathTracer::GetTextureFootprint(const Ray &ray, const HitRecord &record)
+{
+	// the section of the cone on the surface is stretched by 1 / cos; its longer axis is taken, so grazing angles blur rather than alias
+	const float cosTheta = std::max(fabsf(dot(record.m_Normal, ray.getUnitDir())), 1.0e-3f);
+
+	return ray.getConeWidth(record.m_ParamT) / cosTheta * record.m_TexCoordScale;
+}
+
+int PathTracer::renderTile(const ImageTile &tile, int workerIdx)
+{
+	if (s_UseWavefront)
+		return renderTileWavefront(tile, workerIdx);
+
+	if (s_UsePacketTracing)
+		return renderTilePackets(tile);
+
+	int nTracedSamples = 0;
+	const bool isTimed = m_AOVs.has(AOVBuffer::Time_AOV);
+
+	for (int yi = tile.m_Y0; yi < tile.m_Y1; ++yi)
+	{
+		for (int xi = tile.m_X0; xi < tile.m_X1; ++xi)
+		{
+			const unsigned int pixelIdx = xi + m_FrameBuffer.getWidth() * yi;
+			const int nNewSamples = getNumNewSamples(xi, yi);
+			const auto tPixelStart = isTimed ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+
+			for (int si = 0; si < nNewSamples; ++si)
+			{
+				// random numbers depend only on the pixel and the sample index, not on the thread
+				RandomStream rng(pixelIdx, m_SampleCounts(xi, yi), s_RandomSeed, s_SamplerType);
+				FirstHitAttributes firstHit;
+				const vec3 color = traceRec(generatePrimaryRay(xi, yi, rng), 0, rng, 0.f, 0.f, &firstHit);
+				addSample(xi, yi, color, firstHit);
+			}
+
+			if (isTimed && nNewSamples > 0)
+				m_AOVs.addTime(pixelIdx, chrono::duration<float, micro>(chrono::steady_clock::now() - tPixelStart).count());
+
+			nTracedSamples += nNewSamples;
+		}
+	}
+
+	return nTracedSamples;
+}
+
+// the primary rays of a 2x2 pixel quad share one BVH traversal; secondary bounces are traced one by one
+int PathTracer::renderTilePackets(const ImageTile &tile)
+{
+	const float tEpsilon = 0.01f;
+	const float tInfinity = 1.0e+10f;
+
+	int nTracedSamples = 0;
+	const bool isTimed = m_AOVs.has(AOVBuffer::Time_AOV);
+
+	for (int yi = tile.m_Y0; yi < tile.m_Y1; yi += 2)
+	{
+		for (int xi = tile.m_X0; xi < tile.m_X1; xi += 2)
+		{
+			int pixelX[RayPacket::Width], pixelY[RayPacket::Width], nNewSamples[RayPacket::Width];
+			int nMaxNewSamples = 0, nQuadSamples = 0;
+			const auto tQuadStart = isTimed ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+
+			// lanes that fall outside the tile stay inactive
+			for (int lane = 0; lane < RayPacket::Width; ++lane)
+			{
+				pixelX[lane] = xi + (lane & 1);
+				pixelY[lane] = yi + (lane >> 1);
+				nNewSamples[lane] = (pixelX[lane] < tile.m_X1 && pixelY[lane] < tile.m_Y1) ? getNumNewSamples(pixelX[lane], pixelY[lane]) : 0;
+				nMaxNewSamples = std::max(nMaxNewSamples, nNewSamples[lane]);
+				nQuadSamples += nNewSamples[lane];
+			}
+
+			nTracedSamples += nQuadSamples;
+
+			for (int si = 0; si < nMaxNewSamples; ++si)
+			{
+				RayPacket packet;
+				RandomStream rngs[RayPacket::Width];
+				Ray rays[RayPacket::Width];
+				int activeMask = 0;
+
+				for (int lane = 0; lane < RayPacket::Width; ++lane)
+				{
+					if (si >= nNewSamples[lane])
+					{
+						// keep the inactive lanes finite
+						packet.setRay(lane, Ray(m_CameraFrame.m_Eye, -m_CameraFrame.m_ZAxis));
+						continue;
+					}
+
+					const unsigned int pixelIdx = pixelX[lane] + m_FrameBuffer.getWidth() * pixelY[lane];
+					rngs[lane] = RandomStream(pixelIdx, m_SampleCounts(pixelX[lane], pixelY[lane]), s_RandomSeed, s_SamplerType);
+					rays[lane] = generatePrimaryRay(pixelX[lane], pixelY[lane], rngs[lane]);
+					packet.setRay(lane, rays[lane]);
+					activeMask |= (1 << lane);
+				}
+
+				HitRecord records[RayPacket::Width];
+				const int hitMask = m_pScene->hitPacket(packet, activeMask, tEpsilon, tInfinity, records);
+
+				RenderStatistics &stats = getWorkerStatistics();
+				for (int lane = 0; lane < RayPacket::Width; ++lane)
+				{
+					if (RayPacket::IsLaneActive(activeMask, lane))
+					{
+						++stats.m_NumPrimaryRays;
+						++stats.m_NumRays;
+					}
+				}
+
+				for (int lane = 0; lane < RayPacket::Width; ++lane)
+				{
+					if (!RayPacket::IsLaneActive(activeMask, lane))
+						continue;
+
+					FirstHitAttributes firstHit;
+					firstHit.setNoHit();
+
+					vec3 emittedRadiance;
+					if (hitLightSource(rays[lane], RayPacket::IsLaneActive(hitMask, lane) ? records[lane].m_ParamT : tInfinity, 0.f, emittedRadiance))
+						addSample(pixelX[lane], pixelY[lane], emittedRadiance, firstHit);
+					else if (RayPacket::IsLaneActive(hitMask, lane))
+					{
+						firstHit.setHit(records[lane]);
+						addSample(pixelX[lane], pixelY[lane], shade(rays[lane], records[lane], 0, rngs[lane], 0.f), firstHit);
+					}
+					else
+						addSample(pixelX[lane], pixelY[lane], m_pScene->getBackgroundColor(rays[lane]), firstHit);
+				}
+			}
+
+			// the time of the quad is shared out by the numbers of samples
+			if (isTimed && nQuadSamples > 0)
+			{
+				const float microseconds = chrono::duration<float, micro>(chrono::steady_clock::now() - tQuadStart).count();
+
+				for (int lane = 0; lane < RayPacket::Width; ++lane)
+				{
+					if (nNewSamples[lane] > 0)
+						m_AOVs.addTime(pixelX[lane] + m_FrameBuffer.getWidth() * pixelY[lane], microseconds * nNewSamples[lane] / nQuadSamples);
+				}
+			}
+		}
+	}
+
+	return nTracedSamples;
+}
+
+int PathTracer::renderTileWavefront(const ImageTile &tile, int workerIdx)
+{
+	const int tileWidth = tile.m_X1 - tile.m_X0;
+	const int tileHeight = tile.m_Y1 - tile.m_Y0;
+
+	const auto tTileStart = m_AOVs.has(AOVBuffer::Time_AOV) ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+
+	// all new samples of the tile are in flight at once; each sample has its own radiance slot
+	PathQueue &paths = m_WavefrontQueues[workerIdx];
+	paths.clear();
+
+	vector<int> nNewSamples(tileWidth * tileHeight);
+
+	for (int yi = tile.m_Y0; yi < tile.m_Y1; ++yi)
+	{
+		for (int xi = tile.m_X0; xi < tile.m_X1; ++xi)
+		{
+			const unsigned int pixelIdx = xi + m_FrameBuffer.getWidth() * yi;
+			const int tilePixelIdx = (xi - tile.m_X0) + tileWidth * (yi - tile.m_Y0);
+
+			nNewSamples[tilePixelIdx] = getNumNewSamples(xi, yi);
+
+			for (int si = 0; si < nNewSamples[tilePixelIdx]; ++si)
+			{
+				RandomStream rng(pixelIdx, m_SampleCounts(xi, yi) + si, s_RandomSeed, s_SamplerType);
+				const Ray ray = generatePrimaryRay(xi, yi, rng);
+				paths.push(ray.getOrigin(), ray.getUnitDir(), vec3(1.f), 0.f, 0.f, ray.getConeAngle(), ray.getConeWidth(), paths.size(), rng);
+			}
+		}
+	}
+
+	const int nTracedSamples = paths.size();
+
+	if (nTracedSamples == 0)
+		return 0;
+
+	vector<vec3> radiance(nTracedSamples, vec3(0.f));
+	vector<FirstHitAttributes> firstHits(nTracedSamples);
+
+	m_WavefrontIntegrators[workerIdx].trace(*m_pScene, paths, m_NumSamplesPerPixel, &radiance[0], m_WorkerStatistics[workerIdx], &firstHits[0]);
+
+	// the paths of a tile are traced together, so the time of the tile is shared out by the numbers of samples
+	const float microsecondsPerSample = m_AOVs.has(AOVBuffer::Time_AOV)
+		? chrono::duration<float, micro>(chrono::steady_clock::now() - tTileStart).count() / nTracedSamples : 0.f;
+
+	int sampleIdx = 0;
+
+	for (int yi = tile.m_Y0; yi < tile.m_Y1; ++yi)
+	{
+		for (int xi = tile.m_X0; xi < tile.m_X1; ++xi)
+		{
+			const int tilePixelIdx = (xi - tile.m_X0) + tileWidth * (yi - tile.m_Y0);
+
+			for (int si = 0; si < nNewSamples[tilePixelIdx]; ++si, ++sampleIdx)
+				addSample(xi, yi, radiance[sampleIdx], firstHits[sampleIdx]);
+
+			m_AOVs.addTime(xi + m_FrameBuffer.getWidth() * yi, microsecondsPerSample * nNewSamples[tilePixelIdx]);
+		}
+	}
+
+	return nTracedSamples;
+}
+
+void PathTracer::makeSampleCountHeatmap(ImageRGBf &heatmap) const
+{
+	const int width = m_SampleCounts.getWidth();
+	const int height = m_SampleCounts.getHeight();
+
+	heatmap.allocate(width, height);
+
+	// blue (no samples) -> green -> red (maximum number of samples)
+	for (int yi = 0; yi < height; ++yi)
+	{
+		for (int xi = 0; xi < width; ++xi)
+		{
+			const float s = std::min(float(m_SampleCounts(xi, yi)) / std::max(m_MaxSamplesPerPixel, 1), 1.f);
+			heatmap(xi, yi) = (s < 0.5f) ? mix(vec3(0.f, 0.f, 1.f), vec3(0.f, 1.f, 0.f), 2.f * s) : mix(vec3(0.f, 1.f, 0.f), vec3(1.f, 0.f, 0.f), 2.f * s - 1.f);
+		}
+	}
+}
+
+#ifndef HEADLESS
 void PathTracer::renderFrame()
 {
 	if (!m_FrameBufferTexID)
@@ -85,8 +573,8 @@ void PathTracer::renderFrame()
 	if (!m_pGammaShader)
 		initShader();
 
-	const float uOffset = (m_isNVIDIADriver) ? -0.5f / g_WindowWidth : 0.f;
-	const float vOffset = (m_isNVIDIADriver) ? -0.5f / g_WindowHeight : 0.f;
+	const float uOffset = (m_isNVIDIADriver) ? -0.5f / m_FrameBuffer.getWidth() : 0.f;
+	const float vOffset = (m_isNVIDIADriver) ? -0.5f / m_FrameBuffer.getHeight() : 0.f;
 
 	glBindTexture(GL_TEXTURE_2D, m_FrameBufferTexID);
 
@@ -147,11 +635,75 @@ void PathTracer::initShader()
 	// NVIDIA driver requires -0.5 offsets in texture fetch in order to match the path-traced result
 	m_isNVIDIADriver = strncmp((const char *)glGetString(GL_VENDOR), "NVIDIA", sizeof("NVIDIA") - 1) == 0;
 }
+#endif
+
+glm::vec3 PathTracer::getEscapedRadiance(const Ray &ray, float bsdfPdf) const
+{
+	// the environment has also been sampled directly at the previous vertex; both estimates must see the same unfiltered radiance,
+	// otherwise the energy that the filter spreads out of bright texels is counted twice
+	if (bsdfPdf > 0.f && isEnvironmentSamplingEnabled())
+		return m_pScene->getBackgroundColor(Ray(ray.getOrigin(), ray.getUnitDir())) * PowerHeuristic(bsdfPdf, m_pScene->getEnvironmentPdf(ray.getUnitDir()));
+
+	return m_pScene->getBackgroundColor(ray);
+}
+
+bool PathTracer::isEnvironmentSamplingEnabled() const
+{
+	return s_UseEnvironmentSampling && m_pScene->hasEnvironmentSampling();
+}
+
+bool PathTracer::isLightSamplingEnabled() const
+{
+	return s_UseLightSampling && m_pScene->hasLightSources();
+}
 
-glm::vec3 PathTracer::traceRec(const Ray &ray, int recursionDepth)
+bool PathTracer::hitLightSource(const Ray &ray, float tmax, float bsdfPdf, vec3 &radiance) const
 {
+	const float tEpsilon = 0.01f;
+
+	float lightPdf;
+	if (!m_pScene->hasLightSources() || !m_pScene->hitLightSource(ray, tEpsilon, tmax, radiance, lightPdf))
+		return false;
+
+	// the light has also been sampled directly at the previous vertex
+	if (bsdfPdf > 0.f && isLightSamplingEnabled())
+		radiance *= PowerHeuristic(bsdfPdf, lightPdf);
+
+	return true;
+}
+
+template <class EvalBRDF, class BRDFPdf>
+glm::vec3 PathTracer::estimateDirectLighting(const vec3 &pos, const vec3 &normal, RandomStream &rng, EvalBRDF evalBRDF, BRDFPdf brdfPdf)
+{
+	vec3 directRadiance(0.f);
+
+	if (isEnvironmentSamplingEnabled())
+	{
+		const float u1 = rng.next();
+		const float u2 = rng.next();
+
+		directRadiance += m_pScene->estimateEnvironmentLighting(pos, normal, u1, u2, evalBRDF, brdfPdf, getWorkerStatistics().m_NumShadowRays);
+	}
+
+	if (isLightSamplingEnabled())
+	{
+		const float u0 = rng.next();
+		const float u1 = rng.next();
+		const float u2 = rng.next();
+
+		directRadiance += m_pScene->estimateLightSourceLighting(pos, normal, u0, u1, u2, evalBRDF, brdfPdf, getWorkerStatistics().m_NumShadowRays);
+	}
+
+	return directRadiance;
+}
+
+glm::vec3 PathTracer::traceRec(const Ray &ray, int recursionDepth, RandomStream &rng, float bsdfPdf, float wavelength, FirstHitAttributes *pFirstHit)
+{
+	if (pFirstHit)
+		pFirstHit->setNoHit();
+
 	if (recursionDepth > s_MaxRecursionDepth)
-		return g_Scene.getBackgroundColor(ray);
+		return getEscapedRadiance(ray, bsdfPdf);
 
 	const float tEpsilon = 0.01f;
 	const float tInfinity = 1.0e+10f;
@@ -159,214 +711,308 @@ glm::vec3 PathTracer::traceRec(const Ray &ray, int recursionDepth)
 	HitRecord record;
 	record.m_ParamT = tInfinity;
 
-	bool hitObject = false;
+	RenderStatistics &stats = getWorkerStatistics();
+	++stats.m_NumRays;
+	if (recursionDepth == 0)
+		++stats.m_NumPrimaryRays;
 
-	for (int oi = 0; oi < g_Scene.getNumObjects(); oi++)
-	{
-		GeometricObject *o = g_Scene.getObject(oi);
+	const bool isHit = m_pScene->hit(ray, tEpsilon, tInfinity, record);
 
-		HitRecord tmpRec;
-		const bool isHit = o->hit(ray, tEpsilon, tInfinity, tmpRec);
+	// area lights do not reflect, so the path ends at them
+	vec3 emittedRadiance;
+	if (hitLightSource(ray, isHit ? record.m_ParamT : tInfinity, bsdfPdf, emittedRadiance))
+		return emittedRadiance;
 
-		if (isHit && record.m_ParamT > tmpRec.m_ParamT)
-		{
-			record = tmpRec;
-			hitObject = true;
-		}
+	if (!isHit)
+		return getEscapedRadiance(ray, bsdfPdf);
+
+	if (pFirstHit)
+		pFirstHit->setHit(record);
+
+	return shade(ray, record, recursionDepth, rng, wavelength);
+}
+
+// shading kernels indexed by Material::Material_Type (ambient materials are not lit by the path tracer)
+const PathTracer::ShadeFunction PathTracer::s_ShadeFunctions[Material::Num_Material_Types] =
+{
+	&PathTracer::shadePseudoNormalColor,	// Pseudo_Normal_Color_Type
+	&PathTracer::shadeBlack,	// Ambient_Type
+	&PathTracer::shadeDiffuse,	// Diffuse_Type
+	&PathTracer::shadeBlinnPhong,	// Blinn_Phong_Type
+	&PathTracer::shadeTextured,	// Textured_Type
+	&PathTracer::shadePerfectSpecular,	// Perfect_Specular_Type
+	&PathTracer::shadeSpecularRefraction	// Specular_Refraction_Type
+};
+
+glm::vec3 PathTracer::shade(const Ray &ray, const HitRecord &record, int recursionDepth, RandomStream &rng, float wavelength)
+{
+	rng.startBounce(recursionDepth);
+
+	const MaterialData &mat = Material::GetMaterialData(record.m_MaterialId);
+
+	++getWorkerStatistics().m_NumMaterialHits[mat.m_Type];
+
+	return (this->*s_ShadeFunctions[mat.m_Type])(ray, record, mat, recursionDepth, rng, wavelength);
+}
+
+glm::vec3 PathTracer::shadeBlack(const Ray &ray, const HitRecord &record, const MaterialData &mat, int recursionDepth, RandomStream &rng, float wavelength)
+{
+	return vec3(0.f);
+}
+
+glm::vec3 PathTracer::shadePseudoNormalColor(const Ray &ray, const HitRecord &record, const MaterialData &mat, int recursionDepth, RandomStream &rng, float wavelength)
+{
+	return 0.5f * record.m_Normal + vec3(0.5f);
+}
+
+glm::vec3 PathTracer::shadeDiffuse(const Ray &ray, const HitRecord &record, const MaterialData &mat, int recursionDepth, RandomStream &rng, float wavelength)
+{
+	// 拡散反射係数を取得
+	const vec3 &diffuseCoeff = mat.m_DiffuseCoeff;
+	const vec3 normal = (dot(record.m_Normal, ray.getUnitDir()) < 0.f) ? record.m_Normal : -record.m_Normal;
+
+	// next-event estimation towards the environment and the lights, combined with BRDF sampling by multiple importance sampling
+	const vec3 directRadiance = estimateDirectLighting(record.m_HitPos, normal, rng,
+		[&](const vec3 &wi) { return diffuseCoeff / pi<float>(); },
+		[&](const vec3 &wi) { return CosineWeightedPdf(normal, wi); });
+
+	// 再帰の深さが最小値より小さければ閾値を1.0にする。
+	const float russianRouletterProbability = (recursionDepth > s_MinRecursionDepth) ? std::max(diffuseCoeff.x, std::max(diffuseCoeff.y, diffuseCoeff.z)) : 1.f;
+	// 閾値より大きければ計算を打ち切る
+	if (rng.next() >= russianRouletterProbability){
+		// return m_pScene->getBackgroundColor(ray);
+		return directRadiance;
 	}
 
-	if (!hitObject)
-		return g_Scene.getBackgroundColor(ray);
+	// 追跡するレイの方向を決めるために、局所座標系を定義する。
+	// HINT: local coordinate system can be defined using the following function:
+	vec3 xLocal, yLocal, zLocal;
+	calcLocalCoordinateSystem(normal, ray.getUnitDir(), xLocal, yLocal, zLocal);
+
+	// 乱数に基づいてθとφの値を決め、局所座標系でレイの追跡方向を決定する。
+	// 乱数でサンプリング
+	const float xi1 = rng.next();
+	const float xi2 = rng.next();
+	// 局所座標系でのレイの追跡方向を決定
+	const float phi = 2.f * pi<float>() * xi1;
+	const float theta = acos(sqrt(xi2));
+	// 通常座標系でのレイの追跡方向
+	const vec3 traceDirLocal = vec3(cos(phi) * cos(theta), sin(theta), sin(phi) * cos(theta));
+	const vec3 traceDir = normalize(traceDirLocal.x * xLocal + traceDirLocal.y * yLocal + traceDirLocal.z * zLocal);
+	
+	// 積分計算と、再帰呼び出しの返値であるレイの追跡結果の色とを、RGBの各成分に乗算してリターンする。
+	const vec3 weight = diffuseCoeff / russianRouletterProbability;
+	// const vec3 weight = diffuseCoeff;
+	const float bsdfPdf = isNextEventEstimationEnabled() ? CosineWeightedPdf(normal, traceDir) : 0.f;
+	const float coneAngle = s_UseRayCones ? GetBounceConeAngle(ray.getConeAngle(), CosineWeightedPdf(normal, traceDir), m_NumSamplesPerPixel) : 0.f;
+	return directRadiance + weight * traceRec(Ray(record.m_HitPos, traceDir, coneAngle, ray.getConeWidth(record.m_ParamT)), recursionDepth + 1, rng, bsdfPdf, wavelength);
+}
+
+glm::vec3 PathTracer::shadeBlinnPhong(const Ray &ray, const HitRecord &record, const MaterialData &mat, int recursionDepth, RandomStream &rng, float wavelength)
+{
+	return shadeBlinnPhongLobes(ray, record, mat.m_DiffuseCoeff, mat.m_SpecularCoeff, mat.m_Shininess, recursionDepth, rng, wavelength);
+}
+
+// Blinn-Phong with the diffuse color from the texture, filtered over the footprint of the ray cone
+glm::vec3 PathTracer::shadeTextured(const Ray &ray, const HitRecord &record, const MaterialData &mat, int recursionDepth, RandomStream &rng, float wavelength)
+{
+	const float footprint = GetTextureFootprint(ray, record);
+	const vec3 diffuseCoeff = mat.m_pTexture ? mat.m_pTexture->getFilteredColor(record.m_TexCoords, footprint) : vec3(0.f);
+
+	return shadeBlinnPhongLobes(ray, record, diffuseCoeff, mat.m_SpecularCoeff, mat.m_Shininess, recursionDepth, rng, wavelength);
+}
+
+glm::vec3 PathTracer::shadeBlinnPhongLobes(const Ray &ray, const HitRecord &record, const vec3 &diffuseCoeff, const vec3 &specularCoeff, float shiness, int recursionDepth, RandomStream &rng, float wavelength)
+{
+	// 鏡面反射係数を取得
+	const vec3 normal = (dot(record.m_Normal, ray.getUnitDir()) < 0.f) ? record.m_Normal : -record.m_Normal;
+	const vec3 wo = -ray.getUnitDir();
 
-	const Material::Material_Type matType = record.m_pMaterial->getMaterialType();
+	// next-event estimation towards the environment and the lights, combined with BRDF sampling by multiple importance sampling
+	const BlinnPhongLobes lobes(diffuseCoeff, specularCoeff, recursionDepth > s_MinRecursionDepth);
+	const vec3 directRadiance = estimateDirectLighting(record.m_HitPos, normal, rng,
+		[&](const vec3 &wi) { return diffuseCoeff / pi<float>() + EvalBlinnPhongSpecular(normal, wo, wi, specularCoeff, shiness); },
+		[&](const vec3 &wi) { return lobes.getPdf(normal, wo, wi, shiness); });
 
-	if (matType == Material::Pseudo_Normal_Color_Type)
+	// choose a lobe; the path is terminated with the remaining probability
+	const float val = rng.next();
+	const float xi1 = rng.next();
+	const float xi2 = rng.next();
+
+	vec3 traceDir;
+	vec3 weight;
+
+	if (val < lobes.m_DiffuseProb)
 	{
-		return 0.5f * record.m_Normal + vec3(0.5f);
+		traceDir = SampleCosineWeightedDirection(normal, xi1, xi2);
+		weight = diffuseCoeff / lobes.m_DiffuseProb;
 	}
-	else if (matType == Material::Diffuse_Type)
+	else if (val < lobes.m_DiffuseProb + lobes.m_SpecularProb)
 	{
-		// TODO: implement Lambert (diffuse) reflection with BRDF importance sampling
-		// 拡散反射係数を取得
-		const vec3 &diffuseCoeff = ((DiffuseMaterial *)record.m_pMaterial)->getDiffuseCoeff();
-		// 再帰の深さが最小値より小さければ閾値を1.0にする。
-		const float russianRouletterProbability = (recursionDepth > s_MinRecursionDepth) ? std::max(diffuseCoeff.x, std::max(diffuseCoeff.y, diffuseCoeff.z)) : 1.f;
-		// 閾値より大きければ計算を打ち切る
-		if (frand() >= russianRouletterProbability){
-			// return g_Scene.getBackgroundColor(ray);
-			return vec3(0.f);
-		}
+		traceDir = SampleBlinnPhongDirection(normal, wo, shiness, xi1, xi2);
+
+		const float cosIn = dot(normal, traceDir);
+		const float pdf = BlinnPhongPdf(normal, wo, traceDir, shiness);
+
+		if (cosIn <= 0.f || pdf <= 0.f)
+			return directRadiance;
 
-		// 追跡するレイの方向を決めるために、局所座標系を定義する。
-		// HINT: local coordinate system can be defined using the following function:
-		vec3 xLocal, yLocal, zLocal;
-		calcLocalCoordinateSystem(record.m_Normal, ray.getUnitDir(), xLocal, yLocal, zLocal);
-
-		// 乱数に基づいてθとφの値を決め、局所座標系でレイの追跡方向を決定する。
-		// 乱数でサンプリング
-		const float xi1 = frand();
-		const float xi2 = frand();
-		// 局所座標系でのレイの追跡方向を決定
-		const float phi = 2.f * pi<float>() * xi1;
-		const float theta = acos(sqrt(xi2));
-		// 通常座標系でのレイの追跡方向
-		const vec3 traceDirLocal = vec3(cos(phi) * cos(theta), sin(theta), sin(phi) * cos(theta));
-		const vec3 traceDir = normalize(traceDirLocal);
-		
-		// 積分計算と、再帰呼び出しの返値であるレイの追跡結果の色とを、RGBの各成分に乗算してリターンする。
-		const vec3 weight = diffuseCoeff / russianRouletterProbability;
-		// const vec3 weight = diffuseCoeff;
-		return weight * traceRec(Ray(record.m_HitPos, traceDir), recursionDepth + 1);
+		weight = EvalBlinnPhongSpecular(normal, wo, traceDir, specularCoeff, shiness) * cosIn / (pdf * lobes.m_SpecularProb);
 	}
-	else if (matType == Material::Blinn_Phong_Type)
+	else
 	{
-		// TODO: implement Blinn-Phong reflection with BRDF importance sampling
-		// 鏡面反射係数を取得
-		const vec3 &diffuseCoeff = ((BlinnPhongMaterial *)record.m_pMaterial)->getDiffuseCoeff();
-		const vec3 &specularCoeff = ((BlinnPhongMaterial *)record.m_pMaterial)->getSpecularCoeff();
-		const float shiness = ((BlinnPhongMaterial *)record.m_pMaterial)->getShininess();
-		// 再帰の深さが最小値より小さければ閾値を1.0にする。
-		const float russianRouletterProbability = std::max(diffuseCoeff.x, std::max(diffuseCoeff.y, diffuseCoeff.z));
-		const vec3 dsCoeff = diffuseCoeff + specularCoeff;
-		const float russianRouletterProbability2 = (recursionDepth > s_MinRecursionDepth) ? std::max(dsCoeff.x, std::max(dsCoeff.y, dsCoeff.z)) : 1.f;
-		// 閾値より場合分け
-		const float val = frand();
-
-		// 追跡するレイの方向を決めるために、局所座標系を定義する。
-		vec3 xLocal, yLocal, zLocal;
-		calcLocalCoordinateSystem(record.m_Normal, ray.getUnitDir(), xLocal, yLocal, zLocal);
-
-		if (val < russianRouletterProbability) {
-			// ****拡散反射の計算****
-			// 乱数に基づいてθとφの値を決め、局所座標系でレイの追跡方向を決定する。
-			// 乱数でサンプリング
-			const float xi1 = frand();
-			const float xi2 = frand();
-			// 局所座標系でのレイの追跡方向を決定
-			const float phi = 2.f * pi<float>() * xi1;
-			const float theta = acos(sqrt(xi2));
-			// 通常座標系でのレイの追跡方向
-			const vec3 traceDirLocal = vec3(cos(phi) * cos(theta), sin(theta), sin(phi) * cos(theta));
-			const vec3 traceDir = normalize(traceDirLocal);
-
-			// 積分計算と、再帰呼び出しの返値であるレイの追跡結果の色とを、RGBの各成分に乗算してリターンする。
-			// const vec3 weight = 1.f / diffuseCoeff;
-			const float weight = 0.8f;
-			// const vec3 weight = diffuseCoeff / russianRouletterProbability;
-			return weight * traceRec(Ray(record.m_HitPos, traceDir), recursionDepth + 1);
-
-		} else if (russianRouletterProbability <= val && val < russianRouletterProbability2){
-			// ****鏡面反射の計算****
-			// 乱数に基づいてθとφの値を決め、局所座標系でレイの追跡方向を決定する。
-			const float xi1 = frand();
-			const float xi2 = frand();
-			float phi = 2.f * pi<float>() * xi1;
-			float theta = acos(pow(xi2, 1.f/(shiness+1)));
-			// 通常座標系でのレイの追跡方向
-			const vec3 traceDirLocal = vec3(cos(phi) * cos(theta), sin(theta), sin(phi) * cos(theta));
-			const vec3 traceDir = normalize(traceDirLocal);
-
-			// ハーフベクトルの計算（これは局所座標系で計算されているのか？）
-			const vec3 half = (-ray.getUnitDir() + traceDir) / length(-ray.getUnitDir() + traceDir);
-
-			// const vec3 weight = (specularCoeff * ((shiness + 2.f) / (shiness + 1.f)) * 4.f * std::max(glm::dot(traceDir, half), 0.f));
-			// const vec3 weight = (specularCoeff * ((shiness + 2.f) / (shiness + 1.f)) * glm::dot(4.f * traceDir, half));
-			const vec3 weight = (specularCoeff * ((shiness + 2.f) / (shiness + 1.f)) * 4.f * glm::dot(traceDir, half));
-			return weight * traceRec(Ray(record.m_HitPos, traceDir), recursionDepth + 1);
-		} else {
-			// ****計算しない****
-			// return g_Scene.getBackgroundColor(ray);
-			return vec3(0.f);
-		}
+		return directRadiance;
 	}
-	else if (matType == Material::Perfect_Specular_Type)
-	{
-		const vec3 &specularCoeff = ((PerfectSpecularMaterial *)record.m_pMaterial)->getSpecularCoeff();
-		const float russianRouletteProbability = (recursionDepth > s_MinRecursionDepth) ? std::max(specularCoeff.x, std::max(specularCoeff.y, specularCoeff.z)) : 1.f;
 
-		if (frand() >= russianRouletteProbability)
-			return g_Scene.getBackgroundColor(ray);
+	const float bsdfPdf = isNextEventEstimationEnabled() ? lobes.getPdf(normal, wo, traceDir, shiness) : 0.f;
+	const float coneAngle = s_UseRayCones ? GetBounceConeAngle(ray.getConeAngle(), lobes.getPdf(normal, wo, traceDir, shiness), m_NumSamplesPerPixel) : 0.f;
+	return directRadiance + weight * traceRec(Ray(record.m_HitPos, traceDir, coneAngle, ray.getConeWidth(record.m_ParamT)), recursionDepth + 1, rng, bsdfPdf, wavelength);
+}
+
+glm::vec3 PathTracer::shadePerfectSpecular(const Ray &ray, const HitRecord &record, const MaterialData &mat, int recursionDepth, RandomStream &rng, float wavelength)
+{
+	const vec3 &specularCoeff = mat.m_SpecularCoeff;
+	const float russianRouletteProbability = (recursionDepth > s_MinRecursionDepth) ? std::max(specularCoeff.x, std::max(specularCoeff.y, specularCoeff.z)) : 1.f;
 
-		const vec3 reflectDir = normalize(reflect(ray.getUnitDir(), record.m_Normal));
+	if (rng.next() >= russianRouletteProbability)
+		return m_pScene->getBackgroundColor(ray);
 
-		const vec3 incomingRadiance = traceRec(Ray(record.m_HitPos, reflectDir), recursionDepth + 1);
-		const vec3 weight = specularCoeff / russianRouletteProbability;
+	const vec3 reflectDir = normalize(reflect(ray.getUnitDir(), record.m_Normal));
 
-		return weight * incomingRadiance;
-	}
-	else if (matType == Material::Specular_Refraction_Type)
-	{
-		const vec3 &specularCoeff = ((SpecularRefractionMaterial *)record.m_pMaterial)->getSpecularCoeff();
-		const float russianRouletteProbability = (recursionDepth > s_MinRecursionDepth) ? std::max(specularCoeff.x, std::max(specularCoeff.y, specularCoeff.z)) : 1.f;
+	const vec3 incomingRadiance = traceRec(Ray(record.m_HitPos, reflectDir, ray.getConeAngle(), ray.getConeWidth(record.m_ParamT)), recursionDepth + 1, rng, 0.f, wavelength);
+	const vec3 weight = specularCoeff / russianRouletteProbability;
 
-		if (frand() >= russianRouletteProbability)
-			return g_Scene.getBackgroundColor(ray);
+	return weight * incomingRadiance;
+}
 
-		const float _dot = dot(ray.getUnitDir(), record.m_Normal);
+glm::vec3 PathTracer::shadeSpecularRefraction(const Ray &ray, const HitRecord &record, const MaterialData &mat, int recursionDepth, RandomStream &rng, float wavelength)
+{
+	const vec3 &specularCoeff = mat.m_SpecularCoeff;
+	const float russianRouletteProbability = (recursionDepth > s_MinRecursionDepth) ? std::max(specularCoeff.x, std::max(specularCoeff.y, specularCoeff.z)) : 1.f;
 
-		// is the ray entering or outgoing the ball?
-		const bool isEntering = _dot < 0.f;
+	if (rng.next() >= russianRouletteProbability)
+		return m_pScene->getBackgroundColor(ray);
 
-		const float eta = ((SpecularRefractionMaterial *)record.m_pMaterial)->getRefractionIndex();
-		const float relativeIndex = isEntering ? 1 / eta : eta;
+	// hero wavelength: the first dispersive surface of the path picks its wavelength, and the RGB response of the wavelength
+	// weights everything the path gathers from here on
+	vec3 spectralWeight(1.f);
+	if (s_UseSpectralDispersion && mat.m_DispersionCoeff != 0.f && wavelength <= 0.f)
+		wavelength = Spectrum::SampleWavelength(rng.next(), spectralWeight);
 
-		// Schlick's Fresnel approximation
+	const float _dot = dot(ray.getUnitDir(), record.m_Normal);
 
-		const float R0 = ((eta - 1.f) * (eta - 1.f)) / ((eta + 1.f) * (eta + 1.f));
+	// is the ray entering or outgoing the ball?
+	const bool isEntering = _dot < 0.f;
 
-		const float c = 1.f - fabsf(_dot);
-		const float c2 = c * c;
-		const float Re = R0 + (1 - R0) * c2 * c2 * c;
-		const float Tr = (1.f - Re) * relativeIndex * relativeIndex;
+	const float eta = Spectrum::GetRefractionIndex(mat.m_RefractionIndex, mat.m_DispersionCoeff, wavelength);
+	const float relativeIndex = isEntering ? 1 / eta : eta;
 
-		const vec3 normal = isEntering ? record.m_Normal : -record.m_Normal;
+	// Schlick's Fresnel approximation
 
-		const vec3 refractVec = refract(ray.getUnitDir(), normal, relativeIndex);
-		const vec3 reflectVec = reflect(ray.getUnitDir(), normal);
+	const float R0 = ((eta - 1.f) * (eta - 1.f)) / ((eta + 1.f) * (eta + 1.f));
 
-		if (refractVec == vec3(0.f)) // total reflection
-		{
-			const vec3 incomingRadiance = traceRec(Ray(record.m_HitPos, reflectVec), recursionDepth + 1);
-			const vec3 weight = specularCoeff / russianRouletteProbability;
+	const float c = 1.f - fabsf(_dot);
+	const float c2 = c * c;
+	const float Re = R0 + (1 - R0) * c2 * c2 * c;
+	const float Tr = (1.f - Re) * relativeIndex * relativeIndex;
 
-			return weight * incomingRadiance;
-		}
+	const vec3 normal = isEntering ? record.m_Normal : -record.m_Normal;
 
-		if (recursionDepth <= 2)
-		{
-			const vec3 incomingRadiance = Re * traceRec(Ray(record.m_HitPos, reflectVec), recursionDepth + 1) + Tr * traceRec(Ray(record.m_HitPos, refractVec), recursionDepth + 1);
+	const vec3 refractVec = refract(ray.getUnitDir(), normal, relativeIndex);
+	const vec3 reflectVec = reflect(ray.getUnitDir(), normal);
 
-			const vec3 weight = specularCoeff / russianRouletteProbability;
+	if (refractVec == vec3(0.f)) // total reflection
+	{
+		const vec3 incomingRadiance = traceRec(Ray(record.m_HitPos, reflectVec, ray.getConeAngle(), ray.getConeWidth(record.m_ParamT)), recursionDepth + 1, rng, 0.f, wavelength);
+		const vec3 weight = spectralWeight * specularCoeff / russianRouletteProbability;
+
+		return weight * incomingRadiance;
+	}
+
+	// both rays near the camera, where the split pays off most; deeper, one of them so that the number of paths stays bounded
+	if (recursionDepth <= s_FresnelSplitDepth)
+	{
+		const vec3 incomingRadiance = Re * traceRec(Ray(record.m_HitPos, reflectVec, ray.getConeAngle(), ray.getConeWidth(record.m_ParamT)), recursionDepth + 1, rng, 0.f, wavelength) + Tr * traceRec(Ray(record.m_HitPos, refractVec, ray.getConeAngle(), ray.getConeWidth(record.m_ParamT)), recursionDepth + 1, rng, 0.f, wavelength);
+
+		const vec3 weight = spectralWeight * specularCoeff / russianRouletteProbability;
+
+		return weight * incomingRadiance;
+	}
+	else
+	{
+		// apply russian roulette for Fresnel reflection
+
+		const float reflectionProbability = Re;
+
+		if (rng.next() < reflectionProbability)
+		{
+			const vec3 incomingRadiance = Re * traceRec(Ray(record.m_HitPos, reflectVec, ray.getConeAngle(), ray.getConeWidth(record.m_ParamT)), recursionDepth + 1, rng, 0.f, wavelength);
+			const vec3 weight = spectralWeight * specularCoeff / (reflectionProbability * russianRouletteProbability);
 
 			return weight * incomingRadiance;
 		}
 		else
 		{
-			// apply russian roulette for Fresnel reflection
+			const vec3 incomingRadiance = Tr * traceRec(Ray(record.m_HitPos, refractVec, ray.getConeAngle(), ray.getConeWidth(record.m_ParamT)), recursionDepth + 1, rng, 0.f, wavelength);
+			const vec3 weight = spectralWeight * specularCoeff / ((1.f - reflectionProbability) * russianRouletteProbability);
 
-			const float reflectionProbability = Re;
+			return weight * incomingRadiance;
+		}
+	}
+}
 
-			if (frand() < reflectionProbability)
-			{
-				const vec3 incomingRadiance = Re * traceRec(Ray(record.m_HitPos, reflectVec), recursionDepth + 1);
-				const vec3 weight = specularCoeff / (reflectionProbability * russianRouletteProbability);
+bool PathTracer::publishPass()
+{
+	const int epoch = m_PublishedEpoch.load(memory_order_relaxed);
 
-				return weight * incomingRadiance;
-			}
-			else
-			{
-				const vec3 incomingRadiance = Tr * traceRec(Ray(record.m_HitPos, refractVec), recursionDepth + 1);
-				const vec3 weight = specularCoeff / ((1.f - reflectionProbability) * russianRouletteProbability);
+	// the display reads the buffer of the published epoch until it has consumed it
+	if (m_ConsumedEpoch.load(memory_order_acquire) != epoch)
+		return false;
 
-				return weight * incomingRadiance;
-			}
-		}
-	}
+	ImageRGBf &buffer = m_DisplayBuffers[(epoch + 1) & 1];
 
-	return vec3(0.f);
+	if (s_DisplaySampleCountHeatmap)
+		makeSampleCountHeatmap(buffer);
+	else
+		buffer = getDenoisedFrameBuffer();
+
+	m_PublishedEpoch.store(epoch + 1, memory_order_release);
+
+	return true;
+}
+
+#ifndef HEADLESS
+bool PathTracer::updatePublishedFrameTexture()
+{
+	const int epoch = m_PublishedEpoch.load(memory_order_acquire);
+
+	if (epoch == m_ConsumedEpoch.load(memory_order_relaxed))
+		return false;
+
+	uploadTexture(m_DisplayBuffers[epoch & 1]);
+
+	m_ConsumedEpoch.store(epoch, memory_order_release);
+
+	return true;
 }
 
 void PathTracer::updateFrameBufferTexture()
+{
+	// the buffers are being written by the workers; the display follows the published passes instead
+	if (isBackgroundRenderingRunning())
+		return;
+
+	if (s_DisplaySampleCountHeatmap && m_SampleCounts.getData())
+	{
+		ImageRGBf heatmap;
+		makeSampleCountHeatmap(heatmap);
+		uploadTexture(heatmap);
+	}
+	else
+		uploadTexture(getDenoisedFrameBuffer());
+}
+
+void PathTracer::uploadTexture(const ImageRGBf &image)
 {
 	if (!m_FrameBufferTexID)
 		glGenTextures(1, &m_FrameBufferTexID);
@@ -375,22 +1021,11 @@ void PathTracer::updateFrameBufferTexture()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, g_WindowWidth, g_WindowHeight, 0, GL_RGB, GL_FLOAT, m_FrameBuffer.getData());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, image.getWidth(), image.getHeight(), 0, GL_RGB, GL_FLOAT, image.getData());
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
-
-void PathTracer::renderIntermediateFrame()
-{
-	updateFrameBufferTexture();
-
-	if (!g_KeepTracing)
-	{
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		renderFrame();
-		glfwSwapBuffers(g_pWindow);
-	}
-}
+#endif
 
 void PathTracer::calcLocalCoordinateSystem(const vec3 &normal, const vec3 &inDir, vec3 &xLocal, vec3 &yLocal, vec3 &zLocal) const
 {
@@ -1,10 +1,23 @@
 #pragma once
 
 #include "Ray.h"
+#include "HitRecord.h"
+#include "Material.h"
 #include "ImageRect.h"
 #include "glm/glm.hpp"
-#include "GLSLProgramObject.h"
-#include <random>
+#include "RandomStream.h"
+#include "TileScheduler.h"
+#include "WavefrontIntegrator.h"
+#include "RenderStatistics.h"
+#include "AOVBuffer.h"
+#include "Denoiser.h"
+#include <functional>
+#include <atomic>
+#include <thread>
+
+class Scene;
+class ArcballCamera;
+class GLSLProgramObject;
 
 class PathTracer
 {
@@ -16,35 +29,180 @@ public:
 	static int s_MinRecursionDepth;
 	static int s_NumSamplesPerPixel;
 	static int s_NumSamplesPerUpdate;
+	static unsigned int s_RandomSeed;
+	static RandomStream::Sampler_Type s_SamplerType;	// of the camera and BSDF dimensions (see RandomStream)
+	static int s_TileSize;
+	static int s_NumThreads;	// 0: use all available threads
+	static bool s_ReportTileTimes;
+	static bool s_UsePacketTracing;	// trace primary rays of 2x2 pixel quads as packets
+	static bool s_UseWavefront;	// trace the paths of a tile bounce by bounce with WavefrontIntegrator instead of traceRec
 
-	PathTracer() : m_FrameBufferTexID(0), m_RandSrc(12345), m_RandDist(0.f, 1.f), m_pGammaShader(0) {}
-	~PathTracer()
-	{
-		if (m_FrameBufferTexID) glDeleteTextures(1, &m_FrameBufferTexID);
-		if (m_pGammaShader) delete m_pGammaShader;
-	}
+	// adaptive sampling: a pixel stops taking samples once the relative standard error of its mean luminance falls below the threshold;
+	// the total number of samples of the image stays s_NumSamplesPerPixel per pixel on average
+	static bool s_UseAdaptiveSampling;
+	static float s_AdaptiveErrorThreshold;
+	static int s_MinAdaptiveSamples;
+	static int s_MaxAdaptiveSamplesScale;	// a single pixel takes at most this many times s_NumSamplesPerPixel
+	static std::atomic<bool> s_DisplaySampleCountHeatmap;	// display only: read by publishPass(), so it may change during the background rendering
+	static bool s_UseEnvironmentSampling;	// next-event estimation towards the environment map at diffuse and Blinn-Phong surfaces
+	static bool s_UseLightSampling;	// next-event estimation towards the light sources of the scene at the same surfaces
+	// rays carry the cone of the pixel footprint, widened by the BRDF samples; the environment and the image textures are filtered over it
+	static bool s_UseRayCones;
+	static bool s_UseDenoiser;	// filter the frame buffer after every pass, guided by the first hits of the paths (see Denoiser)
+	static unsigned int s_AOVMask;	// AOVBuffer channels rendered along with the color (the denoiser adds its guides)
+	static bool s_UseSpectralDispersion;	// hero-wavelength mode: a path entering a dispersive refractive material continues with one sampled wavelength
+	static int s_FresnelSplitDepth;	// refraction traces both the reflected and the refracted ray up to this depth, then chooses one by Fresnel (-1: always choose)
+
+	// cone angle of a ray sampled with the density pdf (for s_UseRayCones) from a vertex reached by a ray of the given cone angle,
+	// in a render of nSamplesPerPixel samples per pixel
+	static float GetBounceConeAngle(float coneAngle, float pdf, int nSamplesPerPixel);
+	// width of the ray cone on the surface of the hit, in texture coordinate units
+	static float GetTextureFootprint(const Ray& ray, const HitRecord& record);
+
+	PathTracer()
+		: m_pScene(0), m_FrameBufferTexID(0), m_NumSamplesPerPixel(0), m_MaxSamplesPerPixel(0), m_NumSamplesPerPass(0),
+		m_UseDenoiser(false), m_IsDenoised(false), m_IsBackgroundRendering(false), m_CancelRequested(false), m_IsBackgroundRenderingDone(false), m_PublishedEpoch(0), m_ConsumedEpoch(0),
+		m_pGammaShader(0) {}
+	~PathTracer();
+
+	// interactive rendering; the intermediate frame callback is invoked after every update pass
+	void renderScene(Scene& scene, const ArcballCamera& camera, int width, int height, const glm::mat4& projMatrix);
+
+	// headless rendering straight into the frame buffer (no OpenGL calls); fovy is given in degrees
+	void renderImage(Scene& scene, const ArcballCamera& camera, float fovy, int width, int height, int nSamplesPerPixel);
+
+	void setIntermediateFrameCallback(const std::function<void()>& callback) { m_IntermediateFrameCallback = callback; }
 
-	void renderScene();
+	// progressive rendering on a background thread, so that the calling (UI) thread is never blocked:
+	// the workers stop after their current tile once the rendering is cancelled, and every completed pass
+	// is published to the display through a double buffer (see updatePublishedFrameTexture)
+	void startBackgroundRendering(Scene& scene, const ArcballCamera& camera, int width, int height, const glm::mat4& projMatrix);	// cancels the running one first
+	void stopBackgroundRendering();
+	bool isBackgroundRenderingRunning() const { return m_BackgroundThread.joinable() && !m_IsBackgroundRenderingDone; }
+	// true if nothing is being rendered in the background for this view (the caller restarts the rendering then)
+	bool isBackgroundRenderingOutdated(const ArcballCamera& camera, int width, int height, const glm::mat4& projMatrix) const;
+
+	const ImageRGBf& getFrameBuffer() const { return m_FrameBuffer; }
+	const ImageRGBf& getDenoisedFrameBuffer() const { return m_IsDenoised ? m_DenoisedFrameBuffer : m_FrameBuffer; }	// the frame buffer if the denoiser is off
+	const ImageRect<int>& getSampleCounts() const { return m_SampleCounts; }
+	const AOVBuffer& getAOVs() const { return m_AOVs; }
+	void makeSampleCountHeatmap(ImageRGBf& heatmap) const;
+
+#ifndef HEADLESS
+	// OpenGL display of the frame buffer
+	void updateFrameBufferTexture();	// not while rendering in the background
+	bool updatePublishedFrameTexture();	// uploads the latest pass published by the background rendering; returns false if there is no new one
 	void renderFrame();
+#endif
+
+	const TileScheduler &getTileScheduler() const { return m_TileScheduler; }
+
+	const RenderStatistics &getStatistics() const { return m_Statistics; }	// counters of the latest rendering
 
 private:
-	ImageRGBf m_FrameBuffer;
-	GLuint m_FrameBufferTexID;
+	// eye coordinate system used for generating primary rays
+	struct CameraFrame
+	{
+		glm::vec3 m_XAxis, m_YAxis, m_ZAxis, m_Eye;
+		float m_HalfWidth, m_HalfHeight, m_ScreenDist;
+
+		bool operator==(const CameraFrame& f) const
+		{
+			return m_XAxis == f.m_XAxis && m_YAxis == f.m_YAxis && m_ZAxis == f.m_ZAxis && m_Eye == f.m_Eye
+				&& m_HalfWidth == f.m_HalfWidth && m_HalfHeight == f.m_HalfHeight && m_ScreenDist == f.m_ScreenDist;
+		}
+	};
+
+	const Scene* m_pScene;
 
-	std::mt19937 m_RandSrc;
-	std::uniform_real_distribution<float> m_RandDist;
+	ImageRGBf m_FrameBuffer;	// running mean of the samples of each pixel
+	unsigned int m_FrameBufferTexID;	// OpenGL texture name
+
+	ImageRect<int> m_SampleCounts;
+	ImageRect<float> m_LuminanceM2;	// sum of squared deviations from the mean luminance
+	int m_NumSamplesPerPixel;	// of the current render, on average with adaptive sampling
+	int m_MaxSamplesPerPixel;
+	int m_NumSamplesPerPass;	// upper bound of the new samples of a pixel in the current pass
+
+	AOVBuffer m_AOVs;
+
+	bool m_UseDenoiser;	// s_UseDenoiser when the render started: the guides are allocated only then
+	Denoiser m_Denoiser;
+	ImageRGBf m_DenoisedFrameBuffer;
+	bool m_IsDenoised;	// m_DenoisedFrameBuffer holds the latest pass
+
+	std::function<void()> m_IntermediateFrameCallback;
+
+	CameraFrame m_CameraFrame;
+	TileScheduler m_TileScheduler;
+	std::vector<WavefrontIntegrator> m_WavefrontIntegrators;	// one per worker thread
+	std::vector<PathQueue> m_WavefrontQueues;
+
+	RenderStatistics m_Statistics;
+	std::vector<RenderStatistics> m_WorkerStatistics;	// one per worker thread, added to m_Statistics after every pass
+
+	// background rendering; the published pass is in m_DisplayBuffers[m_PublishedEpoch & 1],
+	// and the other buffer is written only after the display has consumed the published one
+	std::thread m_BackgroundThread;
+	bool m_IsBackgroundRendering;	// render() publishes its passes and can be cancelled
+	std::atomic<bool> m_CancelRequested;
+	std::atomic<bool> m_IsBackgroundRenderingDone;
+	std::atomic<int> m_PublishedEpoch;	// number of passes published since the start
+	std::atomic<int> m_ConsumedEpoch;	// latest epoch uploaded by the display
+	ImageRGBf m_DisplayBuffers[2];
 
 	GLSLProgramObject* m_pGammaShader;
 	bool m_isNVIDIADriver;
 
+#ifndef HEADLESS
 	void initShader();
+	void uploadTexture(const ImageRGBf& image);
+#endif
 
-	glm::vec3 traceRec(const Ray& ray, int recursionDepth);
+	static CameraFrame MakeCameraFrame(const ArcballCamera& camera, int width, int height, float screenDist);
+	void setupCameraFrame(const ArcballCamera& camera, int width, int height, float screenDist);
+	void render(Scene& scene, int nSamplesPerPixel, bool invokeCallback);
+	bool publishPass();	// background thread only; false if the display has not consumed the previous pass yet
+	void denoiseFrameBuffer();
+	// each returns the number of samples traced
+	int renderTile(const ImageTile& tile, int workerIdx);
+	int renderTilePackets(const ImageTile& tile);
+	int renderTileWavefront(const ImageTile& tile, int workerIdx);
 
-	void updateFrameBufferTexture();
-	void renderIntermediateFrame();
+	RenderStatistics& getWorkerStatistics();	// of the calling worker thread
 
-	void calcLocalCoordinateSystem(const glm::vec3& normal, const glm::vec3& inDir, glm::vec3& xLocal, glm::vec3& yLocal, glm::vec3& zLocal) const;
+	int getNumNewSamples(int xi, int yi) const;
+	void addSample(int xi, int yi, const glm::vec3& color, const FirstHitAttributes& firstHit);
+
+	Ray generatePrimaryRay(int xi, int yi, RandomStream& rng) const;
+
+	// bsdfPdf: density of the BRDF sample that generated the ray, if next-event estimation was also done at its origin (0 otherwise)
+	// wavelength: of the path in nm, once it has been sampled by a dispersive material (0: RGB)
+	// pFirstHit: receives the first hit of a primary ray
+	glm::vec3 traceRec(const Ray& ray, int recursionDepth, RandomStream& rng, float bsdfPdf = 0.f, float wavelength = 0.f, FirstHitAttributes* pFirstHit = 0);
+	glm::vec3 shade(const Ray& ray, const HitRecord& record, int recursionDepth, RandomStream& rng, float wavelength);
+
+	// one shading kernel per material type, selected by the type stored in the material table
+	typedef glm::vec3 (PathTracer::*ShadeFunction)(const Ray& ray, const HitRecord& record, const MaterialData& mat, int recursionDepth, RandomStream& rng, float wavelength);
+	static const ShadeFunction s_ShadeFunctions[Material::Num_Material_Types];
 
-	inline float frand() { return m_RandDist(m_RandSrc); }
+	glm::vec3 shadeBlack(const Ray& ray, const HitRecord& record, const MaterialData& mat, int recursionDepth, RandomStream& rng, float wavelength);
+	glm::vec3 shadePseudoNormalColor(const Ray& ray, const HitRecord& record, const MaterialData& mat, int recursionDepth, RandomStream& rng, float wavelength);
+	glm::vec3 shadeDiffuse(const Ray& ray, const HitRecord& record, const MaterialData& mat, int recursionDepth, RandomStream& rng, float wavelength);
+	glm::vec3 shadeBlinnPhong(const Ray& ray, const HitRecord& record, const MaterialData& mat, int recursionDepth, RandomStream& rng, float wavelength);
+	glm::vec3 shadeTextured(const Ray& ray, const HitRecord& record, const MaterialData& mat, int recursionDepth, RandomStream& rng, float wavelength);
+	glm::vec3 shadeBlinnPhongLobes(const Ray& ray, const HitRecord& record, const glm::vec3& diffuseCoeff, const glm::vec3& specularCoeff, float shininess, int recursionDepth, RandomStream& rng, float wavelength);
+	glm::vec3 shadePerfectSpecular(const Ray& ray, const HitRecord& record, const MaterialData& mat, int recursionDepth, RandomStream& rng, float wavelength);
+	glm::vec3 shadeSpecularRefraction(const Ray& ray, const HitRecord& record, const MaterialData& mat, int recursionDepth, RandomStream& rng, float wavelength);
+
+	bool isEnvironmentSamplingEnabled() const;
+	bool isLightSamplingEnabled() const;
+	bool isNextEventEstimationEnabled() const { return isEnvironmentSamplingEnabled() || isLightSamplingEnabled(); }
+	glm::vec3 getEscapedRadiance(const Ray& ray, float bsdfPdf) const;
+	bool hitLightSource(const Ray& ray, float tmax, float bsdfPdf, glm::vec3& radiance) const;	// emission of the nearest area light before tmax, MIS weighted
+	// one sample of each enabled next-event estimation at a diffuse or Blinn-Phong vertex
+	template <class EvalBRDF, class BRDFPdf>
+	glm::vec3 estimateDirectLighting(const glm::vec3& pos, const glm::vec3& normal, RandomStream& rng, EvalBRDF evalBRDF, BRDFPdf brdfPdf);
+
+	void calcLocalCoordinateSystem(const glm::vec3& normal, const glm::vec3& inDir, glm::vec3& xLocal, glm::vec3& yLocal, glm::vec3& zLocal) const;
 };
\ No newline at end of file
@@ -6,27 +6,28 @@ class PerfectSpecularMaterial : public Material
 {
 private:
 	PerfectSpecularMaterial()
-		: ks(1,1,1)
 	{
+		data().m_Type = Perfect_Specular_Type;
+		data().m_SpecularCoeff = vec3(1,1,1);
 	}
 
 	PerfectSpecularMaterial(const PerfectSpecularMaterial &m)
-		: ks(m.ks), Material(m)
+		: Material(m)
 	{
 	}
 
 public:
 	static PerfectSpecularMaterial *CreateMaterial()
 	{
-		PerfectSpecularMaterial *m = new PerfectSpecularMaterial();
-		material_cache.push_back( m );
+		PerfectSpecularMaterial *m = new (AllocateMaterial<PerfectSpecularMaterial>()) PerfectSpecularMaterial();
+		RegisterMaterial(m);
 		return m;
 	}
 
 	static PerfectSpecularMaterial *CreateMaterial(const PerfectSpecularMaterial *_m)
 	{
-		PerfectSpecularMaterial *m = new PerfectSpecularMaterial(*_m);
-		material_cache.push_back( m );
+		PerfectSpecularMaterial *m = new (AllocateMaterial<PerfectSpecularMaterial>()) PerfectSpecularMaterial(*_m);
+		RegisterMaterial(m);
 		return m;
 	}
 
@@ -34,15 +35,10 @@ public:
 	{
 	}
 
-	Material_Type getMaterialType() const { return Perfect_Specular_Type; }
-
 	void clone(Material **m) const { *m = new PerfectSpecularMaterial(*this); }
 
-	vec3 getSpecularCoeff() const { return ks; }
-	void setSpecularCoeff(const vec3 &k) { ks = k; }
-	void setSpecularCoeff(float r, float g, float b) { ks = vec3(r,g,b); }
-
-private:
-	vec3 ks;	// specular
+	const vec3 &getSpecularCoeff() const { return data().m_SpecularCoeff; }
+	void setSpecularCoeff(const vec3 &k) { data().m_SpecularCoeff = k; }
+	void setSpecularCoeff(float r, float g, float b) { data().m_SpecularCoeff = vec3(r,g,b); }
 
 };
@@ -10,24 +10,26 @@ private:
 
 	PseudoNormalColorMaterial()
 	{
+		data().m_Type = Pseudo_Normal_Color_Type;
 	}
 
 	PseudoNormalColorMaterial(const PseudoNormalColorMaterial &m)
+		: Material(m)
 	{
 	}
 
 public:
 	static PseudoNormalColorMaterial *CreateMaterial()
 	{
-		PseudoNormalColorMaterial *m = new PseudoNormalColorMaterial();
-		material_cache.push_back( m );
+		PseudoNormalColorMaterial *m = new (AllocateMaterial<PseudoNormalColorMaterial>()) PseudoNormalColorMaterial();
+		RegisterMaterial(m);
 		return m;
 	}
 
 	static PseudoNormalColorMaterial *CreateMaterial(const PseudoNormalColorMaterial *_m)
 	{
-		PseudoNormalColorMaterial *m = new PseudoNormalColorMaterial(*_m);
-		material_cache.push_back( m );
+		PseudoNormalColorMaterial *m = new (AllocateMaterial<PseudoNormalColorMaterial>()) PseudoNormalColorMaterial(*_m);
+		RegisterMaterial(m);
 		return m;
 	}
 
@@ -35,8 +37,6 @@ public:
 	{
 	}
 
-	Material_Type getMaterialType() const { return Pseudo_Normal_Color_Type; }
-
 	void clone(Material **m) const { *m = new PseudoNormalColorMaterial(*this); }
 
 };
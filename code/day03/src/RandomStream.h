@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Sampler.h"
+
+// counter-based random numbers for path tracing
+// every value is a pure function of (seed, pixel, sample, bounce, draw counter), so there is no shared
+// generator state between threads and the rendered image does not depend on the number of threads
+//
+// the sampler decides how the values are made from these: independent uniform hashes, or Owen-scrambled Sobol points,
+// where each group of four consecutive draws of a bounce is one low-discrepancy point over the samples of the pixel
+
+class RandomStream
+{
+public:
+	enum Sampler_Type
+	{
+		Independent_Sampler,
+		Sobol_Sampler,
+		Num_Sampler_Types
+	};
+
+	RandomStream() : m_Key(0), m_SampleIdx(0), m_Bounce(0), m_Counter(0), m_SamplerType(Independent_Sampler) {}
+
+	RandomStream(unsigned int pixelIdx, unsigned int sampleIdx, unsigned int seed = 0, Sampler_Type samplerType = Independent_Sampler)
+		: m_SampleIdx(sampleIdx), m_Bounce(0), m_Counter(0), m_SamplerType(samplerType)
+	{
+		// the Sobol points of a pixel are indexed by the sample, so only its independent values hash the sample into the key
+		m_Key = (samplerType == Sobol_Sampler) ? PCGHash(pixelIdx ^ PCGHash(PCGHash(seed))) : PCGHash(pixelIdx ^ PCGHash(sampleIdx + PCGHash(seed)));
+	}
+
+	inline void startBounce(int bounce) { m_Bounce = (unsigned int)bounce; }
+
+	// returns a value in [0, 1)
+	inline float next()
+	{
+		if (m_SamplerType == Sobol_Sampler)
+		{
+			const unsigned int dim = m_Counter++;
+			const unsigned int groupSeed = PCGHash(m_Key ^ PCGHash((m_Bounce << 24) + dim / OwenScrambledSobol::Num_Dimensions));
+
+			return OwenScrambledSobol::Sample(m_SampleIdx, dim % OwenScrambledSobol::Num_Dimensions, groupSeed);
+		}
+
+		const unsigned int bits = PCGHash(m_Key ^ PCGHash((m_Bounce << 24) + m_Counter++));
+		return (bits >> 8) * (1.f / 16777216.f);
+	}
+
+	// independent stream for a path spawned from this one (e.g. by Fresnel splitting)
+	inline RandomStream fork(unsigned int branchIdx) const
+	{
+		RandomStream rng(*this);
+		rng.m_Key = PCGHash(m_Key ^ PCGHash(branchIdx + 0x9e3779b9u));
+		rng.m_Counter = 0;
+		return rng;
+	}
+
+	// PCG-RXS-M-XS hash (Jarzynski and Olano, "Hash Functions for GPU Rendering", JCGT 2020)
+	static inline unsigned int PCGHash(unsigned int v)
+	{
+		const unsigned int state = v * 747796405u + 2891336453u;
+		const unsigned int word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+private:
+	unsigned int m_Key;
+	unsigned int m_SampleIdx;
+	unsigned int m_Bounce;
+	unsigned int m_Counter;
+	Sampler_Type m_SamplerType;
+};
@@ -8,16 +8,17 @@ class Ray
 {
 public:
 	Ray()
+		: m_ConeAngle(0.f), m_ConeWidth(0.f)
 	{
 	}
 
 	Ray(const Ray& r)
-		: m_Origin(r.m_Origin), m_UnitDir(r.m_UnitDir)
+		: m_Origin(r.m_Origin), m_UnitDir(r.m_UnitDir), m_ConeAngle(r.m_ConeAngle), m_ConeWidth(r.m_ConeWidth)
 	{
 	}
 
-	Ray(const glm::vec3 &o, const glm::vec3 &d)
-		: m_Origin(o), m_UnitDir(d)
+	Ray(const glm::vec3 &o, const glm::vec3 &d, float coneAngle = 0.f, float coneWidth = 0.f)
+		: m_Origin(o), m_UnitDir(d), m_ConeAngle(coneAngle), m_ConeWidth(coneWidth)
 	{
 	}
 
@@ -27,6 +28,9 @@ public:
 
 	inline glm::vec3 getOrigin() const { return m_Origin; }
 	inline glm::vec3 getUnitDir() const { return m_UnitDir; }
+	inline float getConeAngle() const { return m_ConeAngle; }
+	inline float getConeWidth() const { return m_ConeWidth; }
+	inline float getConeWidth(float t) const { return m_ConeWidth + m_ConeAngle * t; }	// at the distance t along the ray
 
 	inline glm::vec3 calculatePosition(float t) const { return m_Origin + t*m_UnitDir; }
 
@@ -36,6 +40,8 @@ public:
 	{
 		m_UnitDir = glm::normalize(d);
 	}
+	inline void setConeAngle(float a) { m_ConeAngle = a; }
+	inline void setConeWidth(float w) { m_ConeWidth = w; }
 
 	friend std::ostream &operator<<(std::ostream &os, const Ray &r)
 	{
@@ -47,5 +53,9 @@ public:
 private:
 	glm::vec3 m_Origin;
 	glm::vec3 m_UnitDir;	// should be a unit vector
+	// ray cone: the footprint of the ray is m_ConeWidth wide at the origin and widens by m_ConeAngle per unit distance,
+	// for filtered lookups (0: point sample)
+	float m_ConeAngle;
+	float m_ConeWidth;
 };
 
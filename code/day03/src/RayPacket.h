@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Ray.h"
+
+// bundle of coherent rays (e.g. primary rays of a 2x2 pixel quad) stored as structure of arrays
+// the intersection kernels loop over the lanes without branches so that the compiler maps them to SIMD instructions
+struct RayPacket
+{
+	enum { Width = 4 };
+
+	float m_OriginX[Width], m_OriginY[Width], m_OriginZ[Width];
+	float m_DirX[Width], m_DirY[Width], m_DirZ[Width];
+	float m_InvDirX[Width], m_InvDirY[Width], m_InvDirZ[Width];
+
+	void setRay(int lane, const Ray &r)
+	{
+		const glm::vec3 o = r.getOrigin();
+		const glm::vec3 d = r.getUnitDir();
+
+		m_OriginX[lane] = o.x; m_OriginY[lane] = o.y; m_OriginZ[lane] = o.z;
+		m_DirX[lane] = d.x; m_DirY[lane] = d.y; m_DirZ[lane] = d.z;
+		m_InvDirX[lane] = 1.f / d.x; m_InvDirY[lane] = 1.f / d.y; m_InvDirZ[lane] = 1.f / d.z;
+	}
+
+	Ray getRay(int lane) const
+	{
+		return Ray(glm::vec3(m_OriginX[lane], m_OriginY[lane], m_OriginZ[lane]), glm::vec3(m_DirX[lane], m_DirY[lane], m_DirZ[lane]));
+	}
+
+	static inline bool IsLaneActive(int mask, int lane) { return (mask >> lane) & 1; }
+	static inline int FullMask() { return (1 << Width) - 1; }
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Material.h"
+
+// ray and shading counters of a rendering; each worker thread counts into its own copy, summed up after every pass
+struct RenderStatistics
+{
+	long long m_NumPrimaryRays;
+	long long m_NumRays;	// closest-hit rays, primary and secondary
+	long long m_NumShadowRays;	// occlusion rays cast by next-event estimation (samples below the surface or with zero radiance cast none)
+	long long m_NumMaterialHits[Material::Num_Material_Types];	// shaded hits per material type
+	char m_Padding[64];	// keeps the counters of different workers on different cache lines
+
+	RenderStatistics() { clear(); }
+
+	void clear()
+	{
+		m_NumPrimaryRays = 0;
+		m_NumRays = 0;
+		m_NumShadowRays = 0;
+
+		for (int ti = 0; ti < Material::Num_Material_Types; ++ti)
+			m_NumMaterialHits[ti] = 0;
+	}
+
+	RenderStatistics& operator+=(const RenderStatistics& s)
+	{
+		m_NumPrimaryRays += s.m_NumPrimaryRays;
+		m_NumRays += s.m_NumRays;
+		m_NumShadowRays += s.m_NumShadowRays;
+
+		for (int ti = 0; ti < Material::Num_Material_Types; ++ti)
+			m_NumMaterialHits[ti] += s.m_NumMaterialHits[ti];
+
+		return *this;
+	}
+
+	long long getNumTotalRays() const { return m_NumRays + m_NumShadowRays; }
+
+	// number of closest-hit rays per path
+	float getAveragePathLength() const { return m_NumPrimaryRays ? (float)m_NumRays / m_NumPrimaryRays : 0.f; }
+};
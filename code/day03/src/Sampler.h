@@ -0,0 +1,60 @@
+#pragma once
+
+// Owen-scrambled Sobol points (Burley, "Practical Hash-based Owen Scrambling", JCGT 2020), the low-discrepancy
+// sampler of RandomStream: the points of the first four Sobol dimensions are shuffled and scrambled per seed,
+// so that the samples of a pixel stay stratified in each group of four dimensions while the pixels decorrelate;
+// higher dimensions are padded with independently seeded groups
+class OwenScrambledSobol
+{
+public:
+	static const int Num_Dimensions = 4;
+
+	// returns a value in [0, 1)
+	static inline float Sample(unsigned int sampleIdx, int dim, unsigned int seed)
+	{
+		const unsigned int shuffledIdx = NestedUniformScramble(sampleIdx, seed);
+		const unsigned int bits = NestedUniformScramble(Sobol(shuffledIdx, dim), seed ^ s_DimensionSeeds[dim]);
+
+		return (bits >> 8) * (1.f / 16777216.f);
+	}
+
+private:
+	static const unsigned int s_Directions[Num_Dimensions][32];
+	static const unsigned int s_DimensionSeeds[Num_Dimensions];
+
+	static inline unsigned int Sobol(unsigned int index, int dim)
+	{
+		unsigned int x = 0;
+
+		for (int bit = 0; index; ++bit, index >>= 1)
+		{
+			if (index & 1)
+				x ^= s_Directions[dim][bit];
+		}
+
+		return x;
+	}
+
+	static inline unsigned int ReverseBits(unsigned int x)
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+		x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+		x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+		x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+		return x;
+	}
+
+	// a random permutation of the binary tree of intervals: each bit is flipped depending only on the higher bits
+	static inline unsigned int NestedUniformScramble(unsigned int x, unsigned int seed)
+	{
+		// Laine-Karras style hash on the reversed bits, with the constants of Burley
+		x = ReverseBits(x);
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return ReverseBits(x);
+	}
+};
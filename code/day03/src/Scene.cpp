@@ -1,11 +1,142 @@
 #include "Scene.h"
+#ifndef HEADLESS
 #include <GL/glew.h>
+#endif
+#include <algorithm>
 
 using namespace std;
 
 mt19937 Scene::s_RandSrc(12345);
 uniform_real_distribution<float> Scene::s_RandDist(0, 1);
 
+bool Scene::updateAccelerationStructure()
+{
+	// moved objects keep the topology of the tree, unless its quality has degraded too far
+	if (!m_IsBVHDirty && m_IsBVHOutdated)
+		m_IsBVHDirty = !m_BVH.refit();
+
+	m_IsBVHOutdated = false;
+
+	if (!m_IsBVHDirty)
+		return false;
+
+	m_BVH.build(m_Objects);
+	m_IsBVHDirty = false;
+
+	return true;
+}
+
+glm::vec3 Scene::sampleEnvironmentLight(const glm::vec3& pos, const glm::vec3& normal, float u1, float u2, glm::vec3& dir, float& pdf, long long& numShadowRays) const
+{
+	const float tEpsilon = 0.01f;
+	const float tInfinity = 1.0e+10f;
+
+	pdf = 0.f;
+
+	if (!hasEnvironmentSampling())
+		return glm::vec3(0.f);
+
+	const glm::vec3 radiance = m_pEnvironmentMap->sampleDirection(u1, u2, dir, pdf);
+
+	if (pdf <= 0.f || glm::dot(dir, normal) <= 0.f)
+		return glm::vec3(0.f);
+
+	++numShadowRays;
+	if (isOccluded(Ray(pos, dir), tEpsilon, tInfinity))
+		return glm::vec3(0.f);
+
+	return radiance;
+}
+
+void Scene::addLight(LightSource* l)
+{
+	m_Lights.push_back(l);
+
+	m_LightSelectionCdf.resize(m_Lights.size());
+
+	float sum = 0.f;
+	for (int i = 0; i < (int)m_Lights.size(); ++i)
+		m_LightSelectionCdf[i] = (sum += std::max(m_Lights[i]->getPower(), 0.f));
+
+	for (int i = 0; i < (int)m_Lights.size(); ++i)
+		m_LightSelectionCdf[i] = (sum > 0.f) ? m_LightSelectionCdf[i] / sum : float(i + 1) / m_Lights.size();
+}
+
+glm::vec3 Scene::sampleLightSource(const glm::vec3& pos, const glm::vec3& normal, float u0, float u1, float u2, glm::vec3& dir, float& pdf, bool& isDelta, long long& numShadowRays) const
+{
+	const float tEpsilon = 0.01f;
+
+	pdf = 0.f;
+	isDelta = false;
+
+	if (m_Lights.empty())
+		return glm::vec3(0.f);
+
+	const int li = std::min((int)(std::upper_bound(m_LightSelectionCdf.begin(), m_LightSelectionCdf.end(), u0) - m_LightSelectionCdf.begin()), (int)m_Lights.size() - 1);
+	const float selectionPdf = m_LightSelectionCdf[li] - (li ? m_LightSelectionCdf[li - 1] : 0.f);
+	const LightSource* light = m_Lights[li];
+
+	float distance, lightPdf;
+	const glm::vec3 radiance = light->sample(pos, u1, u2, dir, distance, lightPdf);
+
+	isDelta = light->isDelta();
+	pdf = selectionPdf * lightPdf;
+
+	if (pdf <= 0.f || radiance == glm::vec3(0.f) || glm::dot(dir, normal) <= 0.f)
+		return glm::vec3(0.f);
+
+	// stop short of the sampled point, so that an area light does not occlude itself
+	++numShadowRays;
+	if (isOccluded(Ray(pos, dir), tEpsilon, distance - tEpsilon))
+		return glm::vec3(0.f);
+
+	return radiance;
+}
+
+bool Scene::hitLightSource(const Ray& r, float tmin, float tmax, glm::vec3& radiance, float& pdf) const
+{
+	int closestIdx = -1;
+	float tClosest = tmax;
+
+	for (int i = 0; i < (int)m_Lights.size(); ++i)
+	{
+		float t;
+		glm::vec3 L;
+
+		if (m_Lights[i]->hit(r, tmin, tClosest, t, L))
+		{
+			closestIdx = i;
+			tClosest = t;
+			radiance = L;
+		}
+	}
+
+	if (closestIdx < 0)
+		return false;
+
+	const float selectionPdf = m_LightSelectionCdf[closestIdx] - (closestIdx ? m_LightSelectionCdf[closestIdx - 1] : 0.f);
+	pdf = selectionPdf * m_Lights[closestIdx]->getPdf(r.getOrigin(), r.getUnitDir(), tClosest);
+
+	return true;
+}
+
+bool Scene::isOccluded(const Ray& r, float tmin, float tmax) const
+{
+	if (shadowHit(r, tmin, tmax))
+		return true;
+
+	for (int i = 0; i < (int)m_Lights.size(); ++i)
+	{
+		float t;
+		glm::vec3 L;
+
+		if (m_Lights[i]->hit(r, tmin, tmax, t, L))
+			return true;
+	}
+
+	return false;
+}
+
 bool Scene::loadEnvironmentMap(const char* filename)
 {
 	auto* pEnv = new EnvironmentMap();
@@ -23,13 +154,14 @@ bool Scene::loadEnvironmentMap(const char* filename)
 	return false;
 }
 
-void Scene::drawGL() const
+#ifndef HEADLESS
+void Scene::drawGL(const glm::mat4& viewMatrix) const
 {
 	const int nObjects = (int)m_Objects.size();
 	if (!nObjects) return;
 
 	if (m_pEnvironmentMap)
-		m_pEnvironmentMap->drawGL();
+		m_pEnvironmentMap->drawGL(viewMatrix);
 
 	// colorize with pseudo colors
 
@@ -49,4 +181,9 @@ void Scene::drawGL() const
 	for (int oi = 0; oi < nObjects; ++oi)
 		m_Objects[oi]->drawGL();
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	glColor3f(1.f, 1.f, 0.5f);
+	for (int li = 0; li < (int)m_Lights.size(); ++li)
+		m_Lights[li]->drawGL();
 }
+#endif
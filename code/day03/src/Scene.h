@@ -5,19 +5,24 @@
 #include "GeometricObject.h"
 #include "Ray.h"
 #include "EnvironmentMap.h"
-//#include "LightSource.h"
+#include "BVH.h"
+#include "MaterialSampling.h"
+#include "LightSource.h"
 //#include "EnvironmentMap.h"
 
 class Scene
 {
 public:
 	Scene()
-		: m_pEnvironmentMap(0), m_BackgroundColor(1.f)
+		: m_IsBVHDirty(true), m_IsBVHOutdated(false), m_pEnvironmentMap(0), m_BackgroundColor(1.f)
 	{
 	}
 
 	~Scene()
 	{
+		for (int i = 0; i < (int)m_Lights.size(); i++)
+			delete m_Lights[i];
+
 		if (m_pEnvironmentMap) delete m_pEnvironmentMap;
 	}
 
@@ -32,19 +37,91 @@ public:
 	void addObject(GeometricObject* o)
 	{
 		m_Objects.push_back(o);
+		m_IsBVHDirty = true;
 		m_PseudoColors.emplace_back(0.5f * s_RandDist(s_RandSrc) + 0.5f,
 									0.5f * s_RandDist(s_RandSrc) + 0.5f,
 									0.5f * s_RandDist(s_RandSrc) + 0.5f);
 	}
 
+	// acceleration structure
+
+	// rebuilds the BVH if objects have been added since the last build, or refits it if they have moved;
+	// true if the tree was rebuilt, including when the refit gave up
+	bool updateAccelerationStructure();
+	void invalidateAccelerationStructure() { m_IsBVHOutdated = true; }	// after moving objects, e.g. by Instance::setTransform() or Sphere::setCenter()
+	const BVH& getBVH() const { return m_BVH; }
+
+	bool hit(const Ray& r, float tmin, float tmax, HitRecord& record) const { return m_BVH.hit(r, tmin, tmax, record); }
+	bool shadowHit(const Ray& r, float tmin, float tmax) const { return m_BVH.shadowHit(r, tmin, tmax); }
+	int hitPacket(const RayPacket& packet, int activeMask, float tmin, float tmax, HitRecord* records) const { return m_BVH.hitPacket(packet, activeMask, tmin, tmax, records); }
+
+	// light sources (owned by the scene)
+
+	void addLight(LightSource* l);
+	int getNumLights() const { return (int)m_Lights.size(); }
+	bool hasLightSources() const { return !m_Lights.empty(); }
+
+	// chooses a light in proportion to its power and samples it; returns zero if the sample is below the surface or occluded;
+	// pdf includes the probability of the choice (for delta lights it is that probability alone);
+	// numShadowRays is incremented if the shadow ray is cast
+	glm::vec3 sampleLightSource(const glm::vec3& pos, const glm::vec3& normal, float u0, float u1, float u2, glm::vec3& dir, float& pdf, bool& isDelta, long long& numShadowRays) const;
+
+	// nearest emitting surface of an area light hit by the ray; pdf is the density of sampleLightSource() choosing the ray direction
+	bool hitLightSource(const Ray& r, float tmin, float tmax, glm::vec3& radiance, float& pdf) const;
+
+	// radiance reflected towards the viewer from one light sample, weighted against BRDF sampling with the power heuristic
+	// (delta lights are not weighted, since BRDF sampling cannot hit them)
+	template <class EvalBRDF, class BRDFPdf>
+	glm::vec3 estimateLightSourceLighting(const glm::vec3& pos, const glm::vec3& normal, float u0, float u1, float u2, EvalBRDF evalBRDF, BRDFPdf brdfPdf, long long& numShadowRays) const
+	{
+		glm::vec3 wi;
+		float lightPdf;
+		bool isDelta;
+		const glm::vec3 radiance = sampleLightSource(pos, normal, u0, u1, u2, wi, lightPdf, isDelta, numShadowRays);
+
+		if (radiance == glm::vec3(0.f))
+			return glm::vec3(0.f);
+
+		const float misWeight = isDelta ? 1.f : PowerHeuristic(lightPdf, brdfPdf(wi));
+
+		return radiance * evalBRDF(wi) * (glm::dot(normal, wi) / lightPdf * misWeight);
+	}
+
 	bool loadEnvironmentMap(const char* filename);
 
+	void setBackgroundColor(const glm::vec3& color) { m_BackgroundColor = color; }
+
 	glm::vec3 getBackgroundColor(const Ray& r) const
 	{
 		return (!m_pEnvironmentMap) ? m_BackgroundColor : m_pEnvironmentMap->fetchColor(r);
 	}
 
-	void drawGL() const;
+	// next-event estimation towards the environment map
+	bool hasEnvironmentSampling() const { return m_pEnvironmentMap && m_pEnvironmentMap->hasSamplingDistribution(); }
+	float getEnvironmentPdf(const glm::vec3& dir) const { return hasEnvironmentSampling() ? m_pEnvironmentMap->getPdf(dir) : 0.f; }
+
+	// returns zero if the sampled direction is below the surface or occluded; pdf is set in any case;
+	// numShadowRays is incremented if the shadow ray is cast
+	glm::vec3 sampleEnvironmentLight(const glm::vec3& pos, const glm::vec3& normal, float u1, float u2, glm::vec3& dir, float& pdf, long long& numShadowRays) const;
+
+	// radiance reflected towards the viewer from one environment sample, weighted against BRDF sampling with the power heuristic;
+	// evalBRDF(wi) returns the BRDF value and brdfPdf(wi) the density of sampling wi by the BRDF
+	template <class EvalBRDF, class BRDFPdf>
+	glm::vec3 estimateEnvironmentLighting(const glm::vec3& pos, const glm::vec3& normal, float u1, float u2, EvalBRDF evalBRDF, BRDFPdf brdfPdf, long long& numShadowRays) const
+	{
+		glm::vec3 wi;
+		float lightPdf;
+		const glm::vec3 radiance = sampleEnvironmentLight(pos, normal, u1, u2, wi, lightPdf, numShadowRays);
+
+		if (radiance == glm::vec3(0.f))
+			return glm::vec3(0.f);
+
+		return radiance * evalBRDF(wi) * (glm::dot(normal, wi) / lightPdf * PowerHeuristic(lightPdf, brdfPdf(wi)));
+	}
+
+#ifndef HEADLESS
+	void drawGL(const glm::mat4& viewMatrix) const;
+#endif
 
 	//void clearScene()
 	//{
@@ -63,13 +140,21 @@ public:
 	//}
 
 private:
-	//std::vector<LightSource*> m_Lights;
+	std::vector<LightSource*> m_Lights;
+	std::vector<float> m_LightSelectionCdf;	// cumulative power of m_Lights, normalized
 	std::vector<GeometricObject*> m_Objects;
 	std::vector<glm::vec3> m_PseudoColors;
 
+	BVH m_BVH;
+	bool m_IsBVHDirty;
+	bool m_IsBVHOutdated;	// the bounds only; refit rather than rebuilt
+
 	EnvironmentMap* m_pEnvironmentMap;
 	glm::vec3 m_BackgroundColor;
 
+	// shadow rays are also blocked by area lights
+	bool isOccluded(const Ray& r, float tmin, float tmax) const;
+
 	static std::mt19937 s_RandSrc;
 	static std::uniform_real_distribution<float> s_RandDist;
 
@@ -0,0 +1,80 @@
+#include "Spectrum.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+// piecewise Gaussian lobe of the CIE 1931 fit
+static float Lobe(float wavelength, float mu, float sigma1, float sigma2)
+{
+	const float t = (wavelength - mu) / ((wavelength < mu) ? sigma1 : sigma2);
+	return expf(-0.5f * t * t);
+}
+
+// linear sRGB of a unit of energy at the wavelength, through the multi-lobe fit of the CIE color matching functions
+// (Wyman et al., "Simple Analytic Approximations to the CIE XYZ Color Matching Functions", JCGT 2013);
+// the colors outside the gamut are clamped
+static vec3 WavelengthToRGB(float wavelength)
+{
+	const float x = 1.056f * Lobe(wavelength, 599.8f, 37.9f, 31.0f) + 0.362f * Lobe(wavelength, 442.0f, 16.0f, 26.7f) - 0.065f * Lobe(wavelength, 501.1f, 20.4f, 26.2f);
+	const float y = 0.821f * Lobe(wavelength, 568.8f, 46.9f, 40.5f) + 0.286f * Lobe(wavelength, 530.9f, 16.3f, 31.1f);
+	const float z = 1.217f * Lobe(wavelength, 437.0f, 11.8f, 36.0f) + 0.681f * Lobe(wavelength, 459.0f, 26.0f, 13.8f);
+
+	const vec3 rgb(3.2406f * x - 1.5372f * y - 0.4986f * z, -0.9689f * x + 1.8758f * y + 0.0415f * z, 0.0557f * x - 0.2040f * y + 1.0570f * z);
+
+	return glm::max(rgb, vec3(0.f));
+}
+
+// RGB response per 1 nm bin of the visible range, normalized so that each channel sums up to 1,
+// and the cumulative sums of the RGB sums of the bins for sampling
+struct ResponseTable
+{
+	static const int Min_Wavelength = 380;
+	static const int Num_Bins = 400;
+
+	vec3 m_Response[Num_Bins];
+	float m_Cdf[Num_Bins + 1];
+
+	ResponseTable()
+	{
+		vec3 total(0.f);
+
+		for (int bi = 0; bi < Num_Bins; ++bi)
+		{
+			m_Response[bi] = WavelengthToRGB(Min_Wavelength + bi + 0.5f);
+			total += m_Response[bi];
+		}
+
+		m_Cdf[0] = 0.f;
+
+		for (int bi = 0; bi < Num_Bins; ++bi)
+		{
+			m_Response[bi] /= total;
+			m_Cdf[bi + 1] = m_Cdf[bi] + m_Response[bi].r + m_Response[bi].g + m_Response[bi].b;
+		}
+	}
+};
+
+static const ResponseTable& GetResponseTable()
+{
+	static const ResponseTable table;
+	return table;
+}
+
+float Spectrum::SampleWavelength(float u, vec3 &weight)
+{
+	const ResponseTable &table = GetResponseTable();
+	const float total = table.m_Cdf[ResponseTable::Num_Bins];
+
+	const float target = u * total;
+	const int bi = std::min((int)(upper_bound(table.m_Cdf + 1, table.m_Cdf + ResponseTable::Num_Bins + 1, target) - (table.m_Cdf + 1)), ResponseTable::Num_Bins - 1);
+
+	// uniform within the bin
+	const float binMass = table.m_Cdf[bi + 1] - table.m_Cdf[bi];
+	const float frac = (binMass > 0.f) ? std::min(std::max((target - table.m_Cdf[bi]) / binMass, 0.f), 1.f) : 0.5f;
+
+	weight = table.m_Response[bi] * (total / binMass);
+
+	return ResponseTable::Min_Wavelength + bi + frac;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+// single wavelengths for the spectral rendering of dispersion: a path that refracts through a dispersive material
+// continues with one sampled wavelength (in nm; 0 while the path is still RGB), and its radiance is weighted
+// by the RGB response of that wavelength
+class Spectrum
+{
+public:
+	// samples a wavelength in proportion to the sum of its RGB response;
+	// weight: response / pdf, which averages to (1, 1, 1) over the samples, so that white light stays white
+	static float SampleWavelength(float u, glm::vec3& weight);
+
+	// Cauchy's equation n = A + B / lambda^2, with A chosen so that eta is the index at the sodium d-line (587.6 nm);
+	// cauchyB is given in um^2 (e.g. 0.0042 for BK7 glass)
+	static inline float GetRefractionIndex(float eta, float cauchyB, float wavelength)
+	{
+		if (wavelength <= 0.f)
+			return eta;
+
+		const float lambda = wavelength * 1.0e-3f;	// in um
+
+		return eta + cauchyB * (1.f / (lambda * lambda) - 1.f / (0.5876f * 0.5876f));
+	}
+};
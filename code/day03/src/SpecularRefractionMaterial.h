@@ -6,27 +6,29 @@ class SpecularRefractionMaterial : public Material
 {
 private:
 	SpecularRefractionMaterial()
-		: eta(1.33f), ks(1,1,1)
 	{
+		data().m_Type = Specular_Refraction_Type;
+		data().m_RefractionIndex = 1.33f;
+		data().m_SpecularCoeff = vec3(1,1,1);
 	}
 
 	SpecularRefractionMaterial(const SpecularRefractionMaterial &m)
-		: eta(m.eta), ks(m.ks), Material(m)
+		: Material(m)
 	{
 	}
 
 public:
 	static SpecularRefractionMaterial *CreateMaterial()
 	{
-		SpecularRefractionMaterial *m = new SpecularRefractionMaterial();
-		material_cache.push_back( m );
+		SpecularRefractionMaterial *m = new (AllocateMaterial<SpecularRefractionMaterial>()) SpecularRefractionMaterial();
+		RegisterMaterial(m);
 		return m;
 	}
 
 	static SpecularRefractionMaterial *CreateMaterial(const SpecularRefractionMaterial *_m)
 	{
-		SpecularRefractionMaterial *m = new SpecularRefractionMaterial(*_m);
-		material_cache.push_back( m );
+		SpecularRefractionMaterial *m = new (AllocateMaterial<SpecularRefractionMaterial>()) SpecularRefractionMaterial(*_m);
+		RegisterMaterial(m);
 		return m;
 	}
 
@@ -34,17 +36,14 @@ public:
 	{
 	}
 
-	Material_Type getMaterialType() const { return Specular_Refraction_Type; }
+	const vec3 &getSpecularCoeff() const { return data().m_SpecularCoeff; }
+	void setSpecularCoeff(const vec3 &k) { data().m_SpecularCoeff = k; }
+	void setSpecularCoeff(float r, float g, float b) { data().m_SpecularCoeff = vec3(r,g,b); }
 
-	vec3 getSpecularCoeff() const { return ks; }
-	void setSpecularCoeff(const vec3 &k) { ks = k; }
-	void setSpecularCoeff(float r, float g, float b) { ks = vec3(r,g,b); }
+	float getRefractionIndex() const { return data().m_RefractionIndex; }
+	void setRefractionIndex(float _eta) { data().m_RefractionIndex = _eta; }
 
-	float getRefractionIndex() const { return eta; }
-	void setRefractionIndex(float _eta) { eta = _eta; }
-
-private:
-	float eta;
-	vec3 ks;	// refraction
+	float getDispersion() const { return data().m_DispersionCoeff; }
+	void setDispersion(float cauchyB) { data().m_DispersionCoeff = cauchyB; }	// see Spectrum::GetRefractionIndex
 
 };
@@ -1,13 +1,16 @@
 #include "Sphere.h"
 #include <cstdlib>
 #include <cmath>
+#include <algorithm>
 //#include <GL/glut.h>
 
 using namespace std;
 //using namespace MyAlgebra;
 
+#ifndef HEADLESS
 int Sphere::s_NumSphereVertices = 0;
 GLuint Sphere::s_VBO = 0;
+#endif
 
 bool Sphere::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
 {
@@ -40,7 +43,8 @@ bool Sphere::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
 		record.m_HitPos = r.calculatePosition(t);
 		//record.m_TexCoords.set( 0.f );
 		record.m_TexCoords = glm::vec3(0.f);
-		record.m_pMaterial = m_pMaterial;
+		record.m_TexCoordScale = 0.f;
+		record.m_MaterialId = m_MaterialId;
 
 		return true;
 	}
@@ -48,35 +52,60 @@ bool Sphere::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
 	return false;
 }
 
-//bool Sphere::shadowHit(const Ray &r, Real tmin, Real tmax) const
-//{
-//	const vec3 v = r.getOrigin() - center;
-//	const vec3 d = r.getUnitDir();
-//
-//	const Real b = dot(v, d);
-//	const Real c = v.sq_norm() - radius*radius;
-//
-//	const Real D = b*b - c;
-//
-//	if (D > 0.0)
-//	{
-//		const Real sqrtD = sqrtf(D);
-//		Real t = -b - sqrtD;
-//
-//		// check if t is within a valid interval
-//		if (t < tmin)
-//			t = -b + sqrtD;
-//		if (t < tmin || t > tmax)
-//			return false;
-//
-//		// valid hit
-//
-//		return true;
-//	}
-//
-//	return false;
-//}
+int Sphere::hitPrimitivePacket(int primIdx, const RayPacket &packet, Real tmin, Real *tmax, int activeMask) const
+{
+	const Real r2 = m_Radius * m_Radius;
+	int hitMask = 0;
+
+#pragma omp simd reduction(|:hitMask)
+	for (int lane = 0; lane < RayPacket::Width; ++lane)
+	{
+		const Real vx = packet.m_OriginX[lane] - m_Center.x;
+		const Real vy = packet.m_OriginY[lane] - m_Center.y;
+		const Real vz = packet.m_OriginZ[lane] - m_Center.z;
+
+		const Real b = vx * packet.m_DirX[lane] + vy * packet.m_DirY[lane] + vz * packet.m_DirZ[lane];
+		const Real c = vx * vx + vy * vy + vz * vz - r2;
+		const Real D = b * b - c;
+
+		const Real sqrtD = sqrtf(std::max(D, 0.f));
+		const Real t0 = -b - sqrtD;
+		const Real t = (t0 < tmin) ? -b + sqrtD : t0;
+
+		const bool isHit = ((activeMask >> lane) & 1) && D > 0.f && t >= tmin && t <= tmax[lane];
+
+		tmax[lane] = isHit ? t : tmax[lane];
+		hitMask |= (isHit ? 1 : 0) << lane;
+	}
+
+	return hitMask;
+}
+
+// same test as hit(), without the normal and the hit position
+bool Sphere::shadowHit(const Ray &r, Real tmin, Real tmax) const
+{
+	const vec3 v = r.getOrigin() - m_Center;
+	const vec3 d = r.getUnitDir();
+
+	const Real b = glm::dot(v, d);
+	const Real c = glm::dot(v, v) - m_Radius*m_Radius;
+
+	const Real D = b*b - c;
+
+	if (D <= 0.0)
+		return false;
+
+	const Real sqrtD = sqrtf(D);
+	Real t = -b - sqrtD;
+
+	// check if t is within a valid interval
+	if (t < tmin)
+		t = -b + sqrtD;
+
+	return (t >= tmin && t <= tmax);
+}
 
+#ifndef HEADLESS
 // for preview using OpenGL
 void Sphere::drawGL() const
 {
@@ -151,3 +180,4 @@ void Sphere::BakeVBO()
 
 	s_NumSphereVertices = (int)vertices.size();
 }
+#endif
@@ -1,6 +1,8 @@
 #pragma once
 
+#ifndef HEADLESS
 #include <GL/glew.h>
+#endif
 #include "GeometricObject.h"
 
 class Sphere : public GeometricObject
@@ -13,19 +15,19 @@ private:
 	Sphere(const Sphere &s)
 		: m_Center(s.m_Center), m_Radius(s.m_Radius)
 	{
-		m_pMaterial = s.m_pMaterial;
+		m_MaterialId = s.m_MaterialId;
 	}
 
 	Sphere(const vec3 &_center, Real r, Material *m)
 		: m_Center(_center), m_Radius(r)
 	{
-		m_pMaterial = m;
+		setMaterial(m);
 	}
 
 public:
 	static Sphere *CreateGeometricObject()
 	{
-		Sphere *obj = new Sphere();
+		Sphere *obj = new (AllocateObject<Sphere>()) Sphere();
 		GeometricObject::RegisterObject(obj);
 		//s_GeometricObjectCache.push_back( obj );
 		return obj;
@@ -33,7 +35,7 @@ public:
 
 	static Sphere *CreateGeometricObject(const Sphere &s)
 	{
-		Sphere *obj = new Sphere(s);
+		Sphere *obj = new (AllocateObject<Sphere>()) Sphere(s);
 		GeometricObject::RegisterObject(obj);
 		//s_GeometricObjectCache.push_back( obj );
 		return obj;
@@ -41,16 +43,19 @@ public:
 
 	static Sphere *CreateGeometricObject(const vec3 &_center, Real r, Material *m)
 	{
-		Sphere *obj = new Sphere(_center, r, m);
+		Sphere *obj = new (AllocateObject<Sphere>()) Sphere(_center, r, m);
 		GeometricObject::RegisterObject(obj);
 		//s_GeometricObjectCache.push_back( obj );
 		return obj;
 	}
 
 	bool hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const;
-	//bool shadowHit(const Ray &r, Real tmin, Real tmax) const;
+	int hitPrimitivePacket(int primIdx, const RayPacket &packet, Real tmin, Real *tmax, int activeMask) const;
+	bool shadowHit(const Ray &r, Real tmin, Real tmax) const;
 
+#ifndef HEADLESS
 	void drawGL() const;	// for preview using OpenGL
+#endif
 
 	inline vec3 getCenter() const { return m_Center; }
 	inline Real getRadius() const { return m_Radius; }
@@ -58,13 +63,18 @@ public:
 	inline void setCenter(const vec3 &c) { m_Center = c; }
 	inline void setRadius(Real r) { m_Radius = r; }
 
+	vec3 getBoundingBoxMin() const { return m_Center - vec3(m_Radius); }
+	vec3 getBoundingBoxMax() const { return m_Center + vec3(m_Radius); }
+
 private:
 	vec3 m_Center;
 	Real m_Radius;
 
+#ifndef HEADLESS
 	static int s_NumSphereVertices;
 	static GLuint s_VBO;
 
 	static void BakeVBO();
+#endif
 };
 
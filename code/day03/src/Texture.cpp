@@ -1,4 +1,4 @@
 #include "Texture.h"
 
-std::vector<Texture *> Texture::s_TextureCache;
+Arena Texture::s_TextureArena;
 
@@ -1,17 +1,14 @@
 #pragma once
 
 #include "glm/glm.hpp"
+#include "Arena.h"
 #include <vector>
 
 class Texture
 {
 public:
-	static void ClearTextureCache()
-	{
-		for (int i=0; i<(int)s_TextureCache.size(); i++)
-			delete s_TextureCache[i];
-		s_TextureCache.clear();
-	}
+	// destroys all the textures created by CreateTexture() and releases their blocks at once
+	static void ClearTextureCache() { s_TextureArena.clear(); }
 
 	enum Texture_Type
 	{
@@ -56,10 +53,22 @@ public:
 		return getColor(uv.x, uv.y, 0.f);
 	}
 
+	// average over a footprint of the given width in texture coordinate units (0: same as getColor)
+	virtual glm::vec3 getFilteredColor(const glm::vec3 &uvw, float footprint) const
+	{
+		return getColor(uvw);
+	}
+
 	virtual Texture_Type getTextureType() const = 0;
 	virtual bool isSolidTexture() const = 0;
 	
 protected:
-	static std::vector<Texture *> s_TextureCache;
+	static Arena s_TextureArena;
+
+	// for CreateTexture(): t = new (AllocateTexture<T>()) T(...); RegisterTexture(t);
+	template <class T>
+	static void *AllocateTexture() { return s_TextureArena.allocate<T>(); }
+	template <class T>
+	static void RegisterTexture(T *t) { s_TextureArena.registerDestructor(t); }
 
 };
@@ -10,51 +10,40 @@ class TexturedMaterial : public Material
 {
 private:
 	TexturedMaterial()
-		: shininess(32), ks(1,1,1)
 	{
+		data().m_Type = Textured_Type;
+		data().m_Shininess = 32;
+		data().m_SpecularCoeff = vec3(1,1,1);
 	}
 
 	TexturedMaterial(const TexturedMaterial &m)
-		: shininess(m.shininess), ks(m.ks), Material(m)
+		: Material(m)
 	{
-		texture = m.texture;
 	}
 
 public:
 	static TexturedMaterial *CreateMaterial()
 	{
-		TexturedMaterial *m = new TexturedMaterial();
-		material_cache.push_back( m );
+		TexturedMaterial *m = new (AllocateMaterial<TexturedMaterial>()) TexturedMaterial();
+		RegisterMaterial(m);
 		return m;
 	}
 
 	static TexturedMaterial *CreateMaterial(const TexturedMaterial *_m)
 	{
-		TexturedMaterial *m = new TexturedMaterial(*_m);
-		material_cache.push_back( m );
+		TexturedMaterial *m = new (AllocateMaterial<TexturedMaterial>()) TexturedMaterial(*_m);
+		RegisterMaterial(m);
 		return m;
 	}
 
-	~TexturedMaterial()
-	{
-		if (texture) delete texture;
-	}
-
-	Material_Type getMaterialType() const { return Textured_Type; }
+	void setTexture(Texture *t) { data().m_pTexture = t; }	// supplies the diffuse color; shared by the copies of the material
+	const Texture *getTexture() const { return data().m_pTexture; }
 
-	void setTexture(Texture *t) { texture = t; }
-	const Texture *getTexture() const { return texture; }
+	Real getShininess() const { return data().m_Shininess; }
+	void setShininess(Real s) { data().m_Shininess = s; }
 
-	Real getShininess() const { return shininess; }
-	void setShininess(Real s) { shininess = s; }
-
-	vec3 getPhongCoeff() const { return ks; }
-	void setPhongCoeff(const vec3 &k) { ks = k; }
-	void setPhongCoeff(Real r, Real g, Real b) { ks = vec3(r,g,b); }
-
-private:
-	Real shininess; // power of cosine lobe
-	vec3 ks;	// phong
-	Texture *texture;	// pointer for texture, supplies the diffuse color
+	const vec3 &getPhongCoeff() const { return data().m_SpecularCoeff; }
+	void setPhongCoeff(const vec3 &k) { data().m_SpecularCoeff = k; }
+	void setPhongCoeff(Real r, Real g, Real b) { data().m_SpecularCoeff = vec3(r,g,b); }
 
 };
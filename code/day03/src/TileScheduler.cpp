@@ -0,0 +1,129 @@
+#include "TileScheduler.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+// interleaves the lower 16 bits of x and y
+static inline unsigned int mortonCode2D(unsigned int x, unsigned int y)
+{
+	auto spread = [](unsigned int v)
+	{
+		v &= 0x0000ffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	};
+
+	return spread(x) | (spread(y) << 1);
+}
+
+void TileScheduler::setup(int width, int height, int tileSize, int numWorkers)
+{
+	tileSize = std::max(tileSize, 1);
+	numWorkers = std::max(numWorkers, 1);
+
+	const int nTilesX = (width + tileSize - 1) / tileSize;
+	const int nTilesY = (height + tileSize - 1) / tileSize;
+
+	vector<pair<unsigned int, ImageTile>> codedTiles;
+	codedTiles.reserve(nTilesX * nTilesY);
+
+	for (int ty = 0; ty < nTilesY; ++ty)
+	{
+		for (int tx = 0; tx < nTilesX; ++tx)
+		{
+			ImageTile t;
+			t.m_X0 = tx * tileSize;
+			t.m_Y0 = ty * tileSize;
+			t.m_X1 = std::min(t.m_X0 + tileSize, width);
+			t.m_Y1 = std::min(t.m_Y0 + tileSize, height);
+			codedTiles.emplace_back(mortonCode2D(tx, ty), t);
+		}
+	}
+
+	std::stable_sort(codedTiles.begin(), codedTiles.end(),
+		[](const pair<unsigned int, ImageTile> &a, const pair<unsigned int, ImageTile> &b) { return a.first < b.first; });
+
+	m_Tiles.resize(codedTiles.size());
+	for (int i = 0; i < (int)codedTiles.size(); ++i)
+		m_Tiles[i] = codedTiles[i].second;
+
+	m_TileTimes.assign(m_Tiles.size(), 0.f);
+
+	if (m_NumWorkers != numWorkers || !m_Queues)
+	{
+		m_Queues.reset(new WorkQueue[numWorkers]);
+		m_NumWorkers = numWorkers;
+	}
+
+	reset();
+}
+
+void TileScheduler::reset()
+{
+	const unsigned int nTiles = (unsigned int)m_Tiles.size();
+
+	for (int wi = 0; wi < m_NumWorkers; ++wi)
+	{
+		const unsigned int head = (unsigned int)((unsigned long long)nTiles * wi / m_NumWorkers);
+		const unsigned int tail = (unsigned int)((unsigned long long)nTiles * (wi + 1) / m_NumWorkers);
+		m_Queues[wi].m_Range.store(PackRange(head, tail));
+	}
+}
+
+bool TileScheduler::pop(int workerIdx, int &tileIdx)
+{
+	// own queue: take from the front to keep walking along the Morton curve
+	{
+		atomic<unsigned long long> &range = m_Queues[workerIdx].m_Range;
+		unsigned long long r = range.load();
+
+		while (RangeHead(r) < RangeTail(r))
+		{
+			if (range.compare_exchange_weak(r, PackRange(RangeHead(r) + 1, RangeTail(r))))
+			{
+				tileIdx = (int)RangeHead(r);
+				return true;
+			}
+		}
+	}
+
+	// steal from the back of the other queues
+	for (int i = 1; i < m_NumWorkers; ++i)
+	{
+		atomic<unsigned long long> &range = m_Queues[(workerIdx + i) % m_NumWorkers].m_Range;
+		unsigned long long r = range.load();
+
+		while (RangeHead(r) < RangeTail(r))
+		{
+			if (range.compare_exchange_weak(r, PackRange(RangeHead(r), RangeTail(r) - 1)))
+			{
+				tileIdx = (int)RangeTail(r) - 1;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void TileScheduler::printTileTimeStatistics(const char *caption) const
+{
+	if (m_TileTimes.empty())
+		return;
+
+	float minTime = m_TileTimes[0], maxTime = m_TileTimes[0], sumTime = 0.f;
+
+	for (int i = 0; i < (int)m_TileTimes.size(); ++i)
+	{
+		minTime = std::min(minTime, m_TileTimes[i]);
+		maxTime = std::max(maxTime, m_TileTimes[i]);
+		sumTime += m_TileTimes[i];
+	}
+
+	cerr << caption << ": " << m_Tiles.size() << " tiles on " << m_NumWorkers << " threads, tile time min/avg/max = "
+		<< minTime << "/" << sumTime / m_TileTimes.size() << "/" << maxTime << " ms" << endl;
+}
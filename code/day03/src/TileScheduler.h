@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <memory>
+
+struct ImageTile
+{
+	int m_X0, m_Y0;	// inclusive
+	int m_X1, m_Y1;	// exclusive
+};
+
+// distributes the tiles of an image to worker threads
+// tiles are sorted in Morton order and split into one contiguous range per worker;
+// a worker pops tiles from the front of its own range and steals from the back of the others once it runs dry
+class TileScheduler
+{
+public:
+	TileScheduler() : m_NumWorkers(0) {}
+
+	void setup(int width, int height, int tileSize, int numWorkers);
+
+	// refills the per-worker queues for a new pass
+	void reset();
+
+	// lock-free; returns false when no tile is left
+	bool pop(int workerIdx, int &tileIdx);
+
+	int getNumTiles() const { return (int)m_Tiles.size(); }
+	int getNumWorkers() const { return m_NumWorkers; }
+	const ImageTile &getTile(int i) const { return m_Tiles[i]; }
+
+	// per-tile timing of the latest pass (in milliseconds)
+	void setTileTime(int tileIdx, float ms) { m_TileTimes[tileIdx] = ms; }
+	const std::vector<float> &getTileTimes() const { return m_TileTimes; }
+	void printTileTimeStatistics(const char *caption) const;
+
+private:
+	// [head, tail) packed into a single 64-bit word so that owner and thieves can race with one CAS
+	struct WorkQueue
+	{
+		std::atomic<unsigned long long> m_Range;
+		char m_Padding[64 - sizeof(std::atomic<unsigned long long>)];	// one queue per cache line
+	};
+
+	std::vector<ImageTile> m_Tiles;
+	std::vector<float> m_TileTimes;
+	std::unique_ptr<WorkQueue[]> m_Queues;
+	int m_NumWorkers;
+
+	static inline unsigned long long PackRange(unsigned int head, unsigned int tail) { return ((unsigned long long)head << 32) | tail; }
+	static inline unsigned int RangeHead(unsigned long long r) { return (unsigned int)(r >> 32); }
+	static inline unsigned int RangeTail(unsigned long long r) { return (unsigned int)(r & 0xffffffffull); }
+};
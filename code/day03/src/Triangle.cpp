@@ -1,15 +1,15 @@
+#ifndef HEADLESS
 #include <GL/glew.h>
+#endif
 #include "Triangle.h"
 #include <cstdlib>
 //#include <GL/glut.h>
 
 using namespace std;
 
-bool Triangle::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
+bool Triangle::Intersect(const vec3 &v0, const vec3 &e1, const vec3 &e2, const Ray &r, Real tmin, Real tmax, Real &t, Real &beta, Real &gamma)
 {
 	const vec3 d = r.getUnitDir();
-	const vec3 e1 = m_Vertices[1] - m_Vertices[0];
-	const vec3 e2 = m_Vertices[2] - m_Vertices[0];
 
 	//const vec3 pVec = d ^ e2;
 	const vec3 pVec = glm::cross(d, e2);
@@ -21,9 +21,9 @@ bool Triangle::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
 
 	const Real invDet = 1.f/det;
 
-	const vec3 tVec = r.getOrigin() - m_Vertices[0];
+	const vec3 tVec = r.getOrigin() - v0;
 
-	const Real beta = invDet * glm::dot(tVec, pVec);
+	beta = invDet * glm::dot(tVec, pVec);
 
 	if (beta < 0.f || beta > 1.f)
 		return false;
@@ -31,14 +31,65 @@ bool Triangle::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
 	//const vec3 qVec = tVec ^ e1;
 	const vec3 qVec = glm::cross(tVec, e1);
 
-	const Real gamma = invDet * glm::dot(d, qVec);
+	gamma = invDet * glm::dot(d, qVec);
 
 	if (gamma < 0.f || beta + gamma > 1.f)
 		return false;
 
-	const Real t = invDet * glm::dot(e2, qVec);
+	t = invDet * glm::dot(e2, qVec);
+
+	return (t >= tmin && t <= tmax);
+}
+
+// same test as Intersect() on the active lanes, without early exits
+int Triangle::IntersectPacket(const vec3 &v0, const vec3 &e1, const vec3 &e2, const RayPacket &packet, Real tmin, Real *tmax, int activeMask)
+{
+	int hitMask = 0;
+
+#pragma omp simd reduction(|:hitMask)
+	for (int lane = 0; lane < RayPacket::Width; ++lane)
+	{
+		const Real dx = packet.m_DirX[lane], dy = packet.m_DirY[lane], dz = packet.m_DirZ[lane];
+
+		// pVec = d x e2
+		const Real px = dy * e2.z - dz * e2.y;
+		const Real py = dz * e2.x - dx * e2.z;
+		const Real pz = dx * e2.y - dy * e2.x;
+
+		const Real det = e1.x * px + e1.y * py + e1.z * pz;
+		const bool isValidDet = (det <= -1.0e-10 || det >= 1.0e-10);
+		const Real invDet = 1.f / (isValidDet ? det : 1.f);
+
+		const Real tx = packet.m_OriginX[lane] - v0.x;
+		const Real ty = packet.m_OriginY[lane] - v0.y;
+		const Real tz = packet.m_OriginZ[lane] - v0.z;
+
+		const Real beta = invDet * (tx * px + ty * py + tz * pz);
+
+		// qVec = tVec x e1
+		const Real qx = ty * e1.z - tz * e1.y;
+		const Real qy = tz * e1.x - tx * e1.z;
+		const Real qz = tx * e1.y - ty * e1.x;
+
+		const Real gamma = invDet * (dx * qx + dy * qy + dz * qz);
+		const Real t = invDet * (e2.x * qx + e2.y * qy + e2.z * qz);
+
+		const bool isHit = ((activeMask >> lane) & 1) && isValidDet
+			&& beta >= 0.f && beta <= 1.f && gamma >= 0.f && beta + gamma <= 1.f
+			&& t >= tmin && t <= tmax[lane];
+
+		tmax[lane] = isHit ? t : tmax[lane];
+		hitMask |= (isHit ? 1 : 0) << lane;
+	}
 
-	if (t < tmin || t > tmax)
+	return hitMask;
+}
+
+bool Triangle::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
+{
+	Real t, beta, gamma;
+
+	if (!Intersect(m_Vertices[0], m_Vertices[1] - m_Vertices[0], m_Vertices[2] - m_Vertices[0], r, tmin, tmax, t, beta, gamma))
 		return false;
 
 	const float alpha = 1.f - (beta + gamma);
@@ -50,48 +101,32 @@ bool Triangle::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
 	record.m_Normal = normal;
 	record.m_HitPos = r.calculatePosition(t);
 	record.m_TexCoords = vec3(texCoord.x, texCoord.y, 0.f);
-	record.m_pMaterial = m_pMaterial;
+	record.m_TexCoordScale = TexCoordScale(m_Vertices[1] - m_Vertices[0], m_Vertices[2] - m_Vertices[0], m_TexCoords[1] - m_TexCoords[0], m_TexCoords[2] - m_TexCoords[0]);
+	record.m_MaterialId = m_MaterialId;
 
 	return true;
 }
 
-//bool Triangle::shadowHit(const Ray &r, Real tmin, Real tmax) const
-//{
-//	const vec3 d = r.getUnitDir();
-//	const vec3 e1 = m_Vertices[1] - m_Vertices[0];
-//	const vec3 e2 = m_Vertices[2] - m_Vertices[0];
-//
-//	const vec3 pVec = d ^ e2;
-//
-//	const Real det = glm::dot(e1, pVec);
-//
-//	if (det > -1.0e-10 && det < 1.0e-10)
-//		return false;
-//
-//	const Real invDet = 1.0/det;
-//
-//	const vec3 tVec = r.getOrigin() - m_Vertices[0];
-//
-//	const Real u = invDet * dot(tVec, pVec);
-//
-//	if (u < 0.0 || u > 1.0)
-//		return false;
-//
-//	const vec3 qVec = tVec ^ e1;
-//
-//	const Real v = invDet * dot(d, qVec);
-//
-//	if (v < 0.0 || u + v > 1.0)
-//		return false;
-//
-//	const Real t = invDet * dot(e2, qVec);
-//
-//	if (t < tmin || t > tmax)
-//		return false;
-//
-//	return true;
-//}
+int Triangle::hitPacket(const RayPacket &packet, Real tmin, Real *tmax, int activeMask) const
+{
+	return IntersectPacket(m_Vertices[0], m_Vertices[1] - m_Vertices[0], m_Vertices[2] - m_Vertices[0], packet, tmin, tmax, activeMask);
+}
+
+bool Triangle::shadowHit(const Ray &r, Real tmin, Real tmax) const
+{
+	Real t, beta, gamma;
+	return Intersect(m_Vertices[0], m_Vertices[1] - m_Vertices[0], m_Vertices[2] - m_Vertices[0], r, tmin, tmax, t, beta, gamma);
+}
+
+Triangle::Real Triangle::TexCoordScale(const vec3 &e1, const vec3 &e2, const vec2 &dt1, const vec2 &dt2)
+{
+	const Real area = glm::length(glm::cross(e1, e2));
+	const Real texCoordArea = fabsf(dt1.x * dt2.y - dt1.y * dt2.x);
+
+	return (area > 0.f) ? sqrtf(texCoordArea / area) : 0.f;
+}
 
+#ifndef HEADLESS
 // for preview using OpenGL
 void Triangle::drawGL() const
 {
@@ -116,3 +151,4 @@ void Triangle::drawGL() const
 //	glEnd();
 //#endif
 }
+#endif
@@ -8,22 +8,22 @@ class Triangle : public GeometricObject
 public:
 	static Triangle *CreateGeometricObject()
 	{
-		Triangle *obj = new Triangle();
-		s_GeometricObjectCache.push_back( obj );
+		Triangle *obj = new (AllocateObject<Triangle>()) Triangle();
+		RegisterObject(obj);
 		return obj;
 	}
 
 	static Triangle *CreateGeometricObject(const Triangle &tri)
 	{
-		Triangle *obj = new Triangle(tri);
-		s_GeometricObjectCache.push_back( obj );
+		Triangle *obj = new (AllocateObject<Triangle>()) Triangle(tri);
+		RegisterObject(obj);
 		return obj;
 	}
 
 	static Triangle *CreateGeometricObject(const vec3 &_v0, const vec3 &_v1, const vec3 &_v2, Material *m)
 	{
-		Triangle *obj = new Triangle(_v0, _v1, _v2, m);
-		s_GeometricObjectCache.push_back( obj );
+		Triangle *obj = new (AllocateObject<Triangle>()) Triangle(_v0, _v1, _v2, m);
+		RegisterObject(obj);
 		return obj;
 	}
 
@@ -33,6 +33,7 @@ public:
 	{
 		m_TexCoords[0] = vec2( 0.f );
 		m_TexCoords[1] = vec2( 0.f );
+		m_TexCoords[2] = vec2( 0.f );
 	}
 
 	Triangle(const Triangle &tri)
@@ -50,8 +51,9 @@ public:
 
 		m_TexCoords[0] = vec2( 0.f );
 		m_TexCoords[1] = vec2( 0.f );
+		m_TexCoords[2] = vec2( 0.f );
 
-		m_pMaterial = m;
+		setMaterial(m);
 	}
 
 	void copy(const Triangle& tri)
@@ -66,8 +68,9 @@ public:
 
 		m_TexCoords[0] = tri.m_TexCoords[0];
 		m_TexCoords[1] = tri.m_TexCoords[1];
+		m_TexCoords[2] = tri.m_TexCoords[2];
 
-		m_pMaterial = tri.m_pMaterial;
+		m_MaterialId = tri.m_MaterialId;
 	}
 
 	Triangle& operator=(const Triangle& tri)
@@ -77,9 +80,23 @@ public:
 	}
 
 	bool hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const;
-	//bool shadowHit(const Ray &r, Real tmin, Real tmax) const;
+	int hitPacket(const RayPacket &packet, Real tmin, Real *tmax, int activeMask) const;
+	int hitPrimitivePacket(int primIdx, const RayPacket &packet, Real tmin, Real *tmax, int activeMask) const
+	{
+		return hitPacket(packet, tmin, tmax, activeMask);
+	}
+	bool shadowHit(const Ray &r, Real tmin, Real tmax) const;
+
+	// ray-triangle tests on a triangle given by its first vertex and the two edges from it
+	// (shared with TriangleMesh, which stores the edges precomputed); beta and gamma are the barycentric coordinates of vertex 1 and 2
+	static bool Intersect(const vec3 &v0, const vec3 &e1, const vec3 &e2, const Ray &r, Real tmin, Real tmax, Real &t, Real &beta, Real &gamma);
+	static int IntersectPacket(const vec3 &v0, const vec3 &e1, const vec3 &e2, const RayPacket &packet, Real tmin, Real *tmax, int activeMask);
+	// texture coordinate units per world unit (the square root of the ratio of the areas), given the edges and their texture coordinate differences
+	static Real TexCoordScale(const vec3 &e1, const vec3 &e2, const vec2 &dt1, const vec2 &dt2);
 
+#ifndef HEADLESS
 	void drawGL() const;	// for preview using OpenGL
+#endif
 
 	vec3 getFaceNormal() const
 	{ 
@@ -1,6 +1,12 @@
 #include "TriangleMesh.h"
+#include "MappedFile.h"
+#include <cstdio>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
 #include <array>
+#include <fstream>
+#include <string>
 #define FAST_OBJ_IMPLEMENTATION
 #include "fast_obj.h"
 //#include <GL/glut.h>
@@ -8,58 +14,179 @@
 using namespace std;
 //using namespace MyAlgebra;
 
+bool TriangleMesh::s_UseMeshCache = true;
+
+// layout of a mesh cache file: the header, then the arrays of the mesh in native byte order
+// (TriangleGeometry[m_NumTriangles], TriangleAttributes[m_NumTriangles], vec3[m_NumNormals], vec2[m_NumTexCoords])
+struct MeshCacheHeader
+{
+	char m_Magic[8];
+	uint32_t m_Version;
+	uint32_t m_ShadingType;
+	uint64_t m_ContentHash;	// of the obj file
+	uint32_t m_NumTriangles;
+	uint32_t m_NumNormals;
+	uint32_t m_NumTexCoords;
+	uint32_t m_Reserved;
+	float m_BoundingBoxMin[3];
+	float m_BoundingBoxMax[3];
+};
+
+static const char s_MeshCacheMagic[8] = { 'T', 'M', 'C', 'A', 'C', 'H', 'E', 0 };
+static const uint32_t s_MeshCacheVersion = 1;
+
+// 64-bit FNV-1a
+static uint64_t HashBytes(const unsigned char* data, size_t size)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		h ^= data[i];
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
 // public methods
 
 bool TriangleMesh::hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const
 {
-	bool hitTriangle = false;
-	float tTmp = tmax;
+	int closestIdx = -1;
+	Real tClosest = tmax, betaClosest = 0.f, gammaClosest = 0.f;
 
-	for (int i=0; i<(int)m_Triangles.size(); i++)
+	for (int i=0; i<getNumTriangles(); i++)
 	{
-		HitRecord tmpRec;
-		const bool isHit = m_Triangles[i].hit(r, tmin, tmax, tmpRec);
+		const TriangleGeometry &g = m_TriangleGeometries[i];
+		Real t, beta, gamma;
 
-		if (isHit && tTmp > tmpRec.m_ParamT)
+		if (Triangle::Intersect(g.m_Vertex0, g.m_Edge1, g.m_Edge2, r, tmin, tClosest, t, beta, gamma))
 		{
-			tTmp = tmpRec.m_ParamT;
-			record = tmpRec;
-			hitTriangle = true;
+			closestIdx = i;
+			tClosest = t;
+			betaClosest = beta;
+			gammaClosest = gamma;
 		}
 	}
 
-	if (hitTriangle)
+	if (closestIdx < 0)
+		return false;
+
+	setHitAttributes(closestIdx, r, tClosest, betaClosest, gammaClosest, record);
+
+	return true;
+}
+
+bool TriangleMesh::hitPrimitive(int primIdx, const Ray &r, Real tmin, Real tmax, HitRecord &record) const
+{
+	const TriangleGeometry &g = m_TriangleGeometries[primIdx];
+	Real t, beta, gamma;
+
+	if (!Triangle::Intersect(g.m_Vertex0, g.m_Edge1, g.m_Edge2, r, tmin, tmax, t, beta, gamma))
+		return false;
+
+	setHitAttributes(primIdx, r, t, beta, gamma, record);
+
+	return true;
+}
+
+void TriangleMesh::clear()
+{
+	m_TriangleGeometries.clear();
+	m_TriangleAttributes.clear();
+	m_Normals.clear();
+	m_TexCoords.clear();
+}
+
+void TriangleMesh::addTriangle(const Triangle &t)
+{
+	TriangleGeometry g;
+	g.m_Vertex0 = t.getVertex0();
+	g.m_Edge1 = t.getVertex1() - t.getVertex0();
+	g.m_Edge2 = t.getVertex2() - t.getVertex0();
+
+	TriangleAttributes a;
+	const int normalOffset = (int)m_Normals.size();
+	const int texCoordOffset = (int)m_TexCoords.size();
+
+	for (int k = 0; k < 3; ++k)
 	{
-		record.m_pMaterial = m_pMaterial;
+		a.m_NormalIndices[k] = normalOffset + k;
+		a.m_TexCoordIndices[k] = texCoordOffset + k;
 	}
 
-	return hitTriangle;
+	m_Normals.push_back(t.getNormal0());
+	m_Normals.push_back(t.getNormal1());
+	m_Normals.push_back(t.getNormal2());
+
+	m_TexCoords.push_back(t.getTexcoord0());
+	m_TexCoords.push_back(t.getTexcoord1());
+	m_TexCoords.push_back(t.getTexcoord2());
+
+	m_TriangleGeometries.push_back(g);
+	m_TriangleAttributes.push_back(a);
+
+	m_BoundingBoxPos[0] = glm::min(m_BoundingBoxPos[0], t.getBoundingBoxMin());
+	m_BoundingBoxPos[1] = glm::max(m_BoundingBoxPos[1], t.getBoundingBoxMax());
 }
 
-//bool TriangleMesh::shadowHit(const Ray &r, Real tmin, Real tmax) const
-//{
-//	//if ( ! rayBoundingBoxIntersectionTest(r,tmin,tmax) )
-//	//	return false;
-//
-//	for (int i=0; i<(int)m_Triangles.size(); i++)
-//	{
-//		const bool isHit = m_Triangles[i].shadowHit(r, tmin, tmax);
-//		if (isHit) return true;
-//	}
-//
-//	return false;
-//}
+Triangle TriangleMesh::getTriangle(int i) const
+{
+	const TriangleAttributes &a = m_TriangleAttributes[i];
+
+	Triangle tri;
+	tri.setVertex0(getVertex0(i));
+	tri.setVertex1(getVertex1(i));
+	tri.setVertex2(getVertex2(i));
+
+	tri.setNormal0(m_Normals[a.m_NormalIndices[0]]);
+	tri.setNormal1(m_Normals[a.m_NormalIndices[1]]);
+	tri.setNormal2(m_Normals[a.m_NormalIndices[2]]);
+
+	if (a.m_TexCoordIndices[0] >= 0)
+	{
+		tri.setTexCoord0(m_TexCoords[a.m_TexCoordIndices[0]]);
+		tri.setTexcoord1(m_TexCoords[a.m_TexCoordIndices[1]]);
+		tri.setTexcoord2(m_TexCoords[a.m_TexCoordIndices[2]]);
+	}
+
+	tri.setMaterialId(m_MaterialId);
+
+	return tri;
+}
+
+size_t TriangleMesh::getMemorySize() const
+{
+	return m_TriangleGeometries.size() * sizeof(TriangleGeometry) + m_TriangleAttributes.size() * sizeof(TriangleAttributes)
+		+ m_Normals.size() * sizeof(glm::vec3) + m_TexCoords.size() * sizeof(glm::vec2);
+}
+
+bool TriangleMesh::shadowHit(const Ray &r, Real tmin, Real tmax) const
+{
+	for (int i=0; i<getNumTriangles(); i++)
+	{
+		if (shadowHitPrimitive(i, r, tmin, tmax))
+			return true;
+	}
 
+	return false;
+}
+
+#ifndef HEADLESS
 void TriangleMesh::drawGL() const	// for preview using OpenGL
 {
-	if (!m_VBO)
+	if (m_TriangleGeometries.empty())
 		return;
 
+	if (!m_VBO)
+		bakeVBO();
+
 	glEnableClientState(GL_VERTEX_ARRAY);
 	glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
 	glVertexPointer(3, GL_FLOAT, 0, 0);
 
-	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)m_Triangles.size() * 3);
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)getNumTriangles() * 3);
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glDisableClientState(GL_VERTEX_ARRAY);
@@ -69,17 +196,18 @@ void TriangleMesh::drawGL() const	// for preview using OpenGL
 	//	m_Triangles[i].drawGL();
 	//}
 }
+#endif
 
 void TriangleMesh::computeBoundingBox()
 {
 	m_BoundingBoxPos[0] = glm::vec3(  100000.f );
 	m_BoundingBoxPos[1] = glm::vec3( -100000.f );
 
-	for (int i=0; i<(int)m_Triangles.size(); i++)
+	for (int i=0; i<getNumTriangles(); i++)
 	{
-		const vec3 v0 = m_Triangles[i].getVertex0();
-		const vec3 v1 = m_Triangles[i].getVertex1();
-		const vec3 v2 = m_Triangles[i].getVertex2();
+		const vec3 v0 = getVertex0(i);
+		const vec3 v1 = getVertex1(i);
+		const vec3 v2 = getVertex2(i);
 
 		m_BoundingBoxPos[0].x = min(m_BoundingBoxPos[0].x, min(v0.x, min(v1.x, v2.x)));
 		m_BoundingBoxPos[0].y = min(m_BoundingBoxPos[0].y, min(v0.y, min(v1.y, v2.y)));
@@ -93,6 +221,31 @@ void TriangleMesh::computeBoundingBox()
 
 bool TriangleMesh::loadObj(const char* filename)
 {
+	const string cacheFilename = string(filename) + ".meshcache";
+	uint64_t contentHash = 0;
+
+	if (s_UseMeshCache)
+	{
+		MappedFile objFile;
+
+		if (!objFile.open(filename))
+		{
+			cerr << __FUNCTION__ << ": loading " << filename << " failed" << endl;
+			return false;
+		}
+
+		contentHash = HashBytes(objFile.getData(), objFile.getSize());
+
+		if (loadMeshCache(cacheFilename.c_str(), contentHash))
+		{
+			cout << __FUNCTION__ << ": " << filename << " loaded from " << cacheFilename << endl;
+			cout << "  # normals:\t" << m_Normals.size() << endl
+				 << "  # tex coords:\t" << m_TexCoords.size() << endl
+				 << "  # triangles:\t" << m_TriangleGeometries.size() << endl;
+			return true;
+		}
+	}
+
 	fastObjMesh* m = fast_obj_read(filename);
 
 	if (!m)
@@ -179,54 +332,209 @@ bool TriangleMesh::loadObj(const char* filename)
 	cout << "  # verts:\t" << vertices.size() << endl
 		 << "  # normals:\t" << normals.size() << endl
 		 << "  # tex coords:\t" << texCoords.size() << endl
-		 << "  # triangles:\t" << m_Triangles.size() << endl;
+		 << "  # triangles:\t" << indices.size() << endl;
+
+	// normals computed here are per face (flat shading) or per position, not indexed by the obj normal indices
+	const bool hasObjNormals = !normals.empty();
 
-	if (normals.empty())
+	if (!hasObjNormals)
 		calcVertexNormals(normals, vertices, indices);
 
 	scaleAndCenterize(vertices, 1.f);
 
 	const int nTriangles = (int)indices.size();
 
-	m_Triangles.clear();
-	m_Triangles.resize(nTriangles);
+	clear();
+	m_TriangleGeometries.resize(nTriangles);
+	m_TriangleAttributes.resize(nTriangles);
+
+	// normals and texture coordinates stay indexed, positions are expanded into the per-triangle intersection data
+	m_Normals.swap(normals);
+	m_TexCoords.swap(texCoords);
 
 	for (int ti = 0; ti < nTriangles; ++ti)
 	{
 		const auto t = indices[ti].indices;
 
-		Triangle& tri = m_Triangles[ti];
+		TriangleGeometry& g = m_TriangleGeometries[ti];
+		TriangleAttributes& a = m_TriangleAttributes[ti];
 
-		tri.setVertex0(vertices[t[0].vertexIdx]);
-		tri.setVertex1(vertices[t[1].vertexIdx]);
-		tri.setVertex2(vertices[t[2].vertexIdx]);
+		g.m_Vertex0 = vertices[t[0].vertexIdx];
+		g.m_Edge1 = vertices[t[1].vertexIdx] - g.m_Vertex0;
+		g.m_Edge2 = vertices[t[2].vertexIdx] - g.m_Vertex0;
 
-		if (m_ShadingType == Flat_Shading)
-		{
-			tri.setNormal0(normals[ti]);
-			tri.setNormal1(normals[ti]);
-			tri.setNormal2(normals[ti]);
-		}
-		else
+		for (int k = 0; k < 3; ++k)
 		{
-			tri.setNormal0(normals[t[0].normalIdx]);
-			tri.setNormal1(normals[t[1].normalIdx]);
-			tri.setNormal2(normals[t[2].normalIdx]);
+			if (m_ShadingType == Flat_Shading && !hasObjNormals)
+				a.m_NormalIndices[k] = ti;
+			else if (!hasObjNormals)
+				a.m_NormalIndices[k] = t[k].vertexIdx;
+			else
+				a.m_NormalIndices[k] = t[k].normalIdx;
+
+			a.m_TexCoordIndices[k] = m_TexCoords.empty() ? -1 : t[k].textureIdx;
 		}
+	}
+
+	computeBoundingBox();
+
+	cout << "  memory:\t" << getMemorySize() / 1024 << " KB" << endl;
+
+	if (s_UseMeshCache)
+		saveMeshCache(cacheFilename.c_str(), contentHash);
+
+	return true;
+}
+
+bool TriangleMesh::loadMeshCache(const char* filename, unsigned long long contentHash)
+{
+	MappedFile file;
+
+	if (!file.open(filename) || file.getSize() < sizeof(MeshCacheHeader))
+		return false;
+
+	MeshCacheHeader header;
+	memcpy(&header, file.getData(), sizeof(header));
+
+	if (memcmp(header.m_Magic, s_MeshCacheMagic, sizeof(s_MeshCacheMagic)) || header.m_Version != s_MeshCacheVersion
+		|| header.m_ContentHash != contentHash || header.m_ShadingType != (uint32_t)m_ShadingType)
+	{
+		cerr << __FUNCTION__ << ": " << filename << " is outdated" << endl;
+		return false;
+	}
+
+	const size_t geometrySize = header.m_NumTriangles * sizeof(TriangleGeometry);
+	const size_t attributeSize = header.m_NumTriangles * sizeof(TriangleAttributes);
+	const size_t normalSize = header.m_NumNormals * sizeof(glm::vec3);
+	const size_t texCoordSize = header.m_NumTexCoords * sizeof(glm::vec2);
+
+	if (file.getSize() != sizeof(header) + geometrySize + attributeSize + normalSize + texCoordSize)
+	{
+		cerr << __FUNCTION__ << ": " << filename << " is broken" << endl;
+		return false;
+	}
+
+	clear();
+	m_TriangleGeometries.resize(header.m_NumTriangles);
+	m_TriangleAttributes.resize(header.m_NumTriangles);
+	m_Normals.resize(header.m_NumNormals);
+	m_TexCoords.resize(header.m_NumTexCoords);
+
+	// the arrays are copied out of the mapping in one pass each (the file is closed on return), so the mesh owns its data as if parsed
+	const unsigned char* p = file.getData() + sizeof(header);
+	if (geometrySize) memcpy(static_cast<void*>(m_TriangleGeometries.data()), p, geometrySize);
+	p += geometrySize;
+	if (attributeSize) memcpy(static_cast<void*>(m_TriangleAttributes.data()), p, attributeSize);
+	p += attributeSize;
+	if (normalSize) memcpy(static_cast<void*>(m_Normals.data()), p, normalSize);
+	p += normalSize;
+	if (texCoordSize) memcpy(static_cast<void*>(m_TexCoords.data()), p, texCoordSize);
+
+	// the sizes match, but the indices are dereferenced without checks while tracing
+	const int nNormals = (int)header.m_NumNormals;
+	const int nTexCoords = (int)header.m_NumTexCoords;
+
+	for (size_t ti = 0; ti < m_TriangleAttributes.size(); ++ti)
+	{
+		const TriangleAttributes& a = m_TriangleAttributes[ti];
+		const bool hasTexCoords = (a.m_TexCoordIndices[0] >= 0);
 
-		if (texCoords.size())
+		for (int k = 0; k < 3; ++k)
 		{
-			tri.setTexCoord0(texCoords[t[0].textureIdx]);
-			tri.setTexcoord1(texCoords[t[1].textureIdx]);
-			tri.setTexcoord2(texCoords[t[2].textureIdx]);
+			if (a.m_NormalIndices[k] < 0 || a.m_NormalIndices[k] >= nNormals
+				|| (hasTexCoords ? (a.m_TexCoordIndices[k] < 0 || a.m_TexCoordIndices[k] >= nTexCoords) : a.m_TexCoordIndices[k] != -1))
+			{
+				cerr << __FUNCTION__ << ": " << filename << " is broken (index out of range in triangle " << ti << ")" << endl;
+				clear();
+				return false;
+			}
 		}
 	}
 
-	bakeVBO();
+	m_BoundingBoxPos[0] = vec3(header.m_BoundingBoxMin[0], header.m_BoundingBoxMin[1], header.m_BoundingBoxMin[2]);
+	m_BoundingBoxPos[1] = vec3(header.m_BoundingBoxMax[0], header.m_BoundingBoxMax[1], header.m_BoundingBoxMax[2]);
 
 	return true;
 }
 
+bool TriangleMesh::saveMeshCache(const char* filename, unsigned long long contentHash) const
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_Magic, s_MeshCacheMagic, sizeof(s_MeshCacheMagic));
+	header.m_Version = s_MeshCacheVersion;
+	header.m_ShadingType = (uint32_t)m_ShadingType;
+	header.m_ContentHash = contentHash;
+	header.m_NumTriangles = (uint32_t)m_TriangleGeometries.size();
+	header.m_NumNormals = (uint32_t)m_Normals.size();
+	header.m_NumTexCoords = (uint32_t)m_TexCoords.size();
+
+	for (int k = 0; k < 3; ++k)
+	{
+		header.m_BoundingBoxMin[k] = m_BoundingBoxPos[0][k];
+		header.m_BoundingBoxMax[k] = m_BoundingBoxPos[1][k];
+	}
+
+	// written next to the cache and renamed when complete, so that an interrupted write never leaves a truncated cache
+	const string tmpFilename = string(filename) + ".tmp";
+	ofstream ofs(tmpFilename.c_str(), ios::binary);
+
+	if (!ofs)
+	{
+		cerr << __FUNCTION__ << ": cannot write " << tmpFilename << " (the obj file will be parsed again next time)" << endl;
+		return false;
+	}
+
+	ofs.write((const char*)&header, sizeof(header));
+	if (!m_TriangleGeometries.empty()) ofs.write((const char*)&m_TriangleGeometries[0], m_TriangleGeometries.size() * sizeof(TriangleGeometry));
+	if (!m_TriangleAttributes.empty()) ofs.write((const char*)&m_TriangleAttributes[0], m_TriangleAttributes.size() * sizeof(TriangleAttributes));
+	if (!m_Normals.empty()) ofs.write((const char*)&m_Normals[0], m_Normals.size() * sizeof(glm::vec3));
+	if (!m_TexCoords.empty()) ofs.write((const char*)&m_TexCoords[0], m_TexCoords.size() * sizeof(glm::vec2));
+
+	ofs.close();
+
+	if (!ofs.good())
+	{
+		remove(tmpFilename.c_str());
+		cerr << __FUNCTION__ << ": writing " << tmpFilename << " failed" << endl;
+		return false;
+	}
+
+#ifdef _WIN32
+	remove(filename);	// rename() does not replace an existing file there
+#endif
+
+	if (rename(tmpFilename.c_str(), filename) != 0)
+	{
+		remove(tmpFilename.c_str());
+		cerr << __FUNCTION__ << ": cannot rename " << tmpFilename << " to " << filename << endl;
+		return false;
+	}
+
+	return true;
+}
+
+void TriangleMesh::setHitAttributes(int triIdx, const Ray &r, Real t, Real beta, Real gamma, HitRecord &record) const
+{
+	const TriangleAttributes &a = m_TriangleAttributes[triIdx];
+	const float alpha = 1.f - (beta + gamma);
+
+	const vec3 normal = alpha * m_Normals[a.m_NormalIndices[0]] + beta * m_Normals[a.m_NormalIndices[1]] + gamma * m_Normals[a.m_NormalIndices[2]];
+	const vec2 texCoord = (a.m_TexCoordIndices[0] >= 0)
+		? alpha * m_TexCoords[a.m_TexCoordIndices[0]] + beta * m_TexCoords[a.m_TexCoordIndices[1]] + gamma * m_TexCoords[a.m_TexCoordIndices[2]]
+		: vec2(0.f);
+
+	record.m_ParamT = t;
+	record.m_Normal = normal;
+	record.m_HitPos = r.calculatePosition(t);
+	record.m_TexCoords = vec3(texCoord.x, texCoord.y, 0.f);
+	record.m_TexCoordScale = (a.m_TexCoordIndices[0] >= 0)
+		? Triangle::TexCoordScale(m_TriangleGeometries[triIdx].m_Edge1, m_TriangleGeometries[triIdx].m_Edge2,
+			m_TexCoords[a.m_TexCoordIndices[1]] - m_TexCoords[a.m_TexCoordIndices[0]], m_TexCoords[a.m_TexCoordIndices[2]] - m_TexCoords[a.m_TexCoordIndices[0]])
+		: 0.f;
+	record.m_MaterialId = m_MaterialId;
+}
+
 void TriangleMesh::calcVertexNormals(vector<glm::vec3>& normals, const vector<glm::vec3>& vertices, const vector<TriangleIndices>& indices)
 {
 	const int nFaces = (int)indices.size();
@@ -303,16 +611,17 @@ void TriangleMesh::scaleAndCenterize(vector<glm::vec3>& vertices, float scale)
 	}
 }
 
-void TriangleMesh::bakeVBO()
+#ifndef HEADLESS
+void TriangleMesh::bakeVBO() const
 {
-	const int nTriangles = (int)m_Triangles.size();
+	const int nTriangles = getNumTriangles();
 	vector<glm::vec3> vertices(3 * nTriangles);
 
 	for (int ti = 0; ti < nTriangles; ++ti)
 	{
-		vertices[3 * ti + 0] = m_Triangles[ti].getVertex0();
-		vertices[3 * ti + 1] = m_Triangles[ti].getVertex1();
-		vertices[3 * ti + 2] = m_Triangles[ti].getVertex2();
+		vertices[3 * ti + 0] = getVertex0(ti);
+		vertices[3 * ti + 1] = getVertex1(ti);
+		vertices[3 * ti + 2] = getVertex2(ti);
 	}
 
 	if (!m_VBO) glGenBuffers(1, &m_VBO);
@@ -320,6 +629,7 @@ void TriangleMesh::bakeVBO()
 	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
+#endif
 
 #if 0
 
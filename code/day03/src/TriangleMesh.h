@@ -1,6 +1,8 @@
 #pragma once
 
+#ifndef HEADLESS
 #include <GL/glew.h>
+#endif
 #include "Triangle.h"
 #include <array>
 #include <vector>
@@ -30,11 +32,29 @@ struct TriangleIndices
 	std::array<VertexTuple, 3> indices;
 };
 
+// intersection data of a triangle (the only data read during traversal): the first vertex and the two edges from it
+struct TriangleGeometry
+{
+	glm::vec3 m_Vertex0;
+	glm::vec3 m_Edge1;	// v1 - v0
+	glm::vec3 m_Edge2;	// v2 - v0
+};
+
+// shading attributes of a triangle as indices into the normal/texture coordinate arrays of the mesh,
+// fetched only for the closest hit
+struct TriangleAttributes
+{
+	int m_NormalIndices[3];
+	int m_TexCoordIndices[3];	// -1 if the triangle has no texture coordinates
+};
+
 class TriangleMesh : public GeometricObject
 {
 private:
 	TriangleMesh() : m_ShadingType(Auto_Shading), m_VBO(0)
 	{
+		m_BoundingBoxPos[0] = vec3( 100000.f);
+		m_BoundingBoxPos[1] = vec3(-100000.f);
 	}
 
 public:
@@ -47,7 +67,7 @@ public:
 
 	static TriangleMesh *CreateGeometricObject()
 	{
-		TriangleMesh *obj = new TriangleMesh();
+		TriangleMesh *obj = new (AllocateObject<TriangleMesh>()) TriangleMesh();
 		//s_GeometricObjectCache.push_back( obj );
 		GeometricObject::RegisterObject(obj);
 		return obj;
@@ -55,30 +75,33 @@ public:
 
 	~TriangleMesh()
 	{
+#ifndef HEADLESS
 		if (m_VBO) glDeleteBuffers(1, &m_VBO);
+#endif
 	}
 
 	// class definitions
 
 	bool hit(const Ray &r, Real tmin, Real tmax, HitRecord &record) const;
-	//bool shadowHit(const Ray &r, Real tmin, Real tmax) const;
+	bool shadowHit(const Ray &r, Real tmin, Real tmax) const;
 
+#ifndef HEADLESS
 	void drawGL() const;	// for preview using OpenGL
+#endif
 
-	void clear() { m_Triangles.clear(); }
+	void clear();
 
-	int getNumTriangles() const { return m_Triangles.size(); }
+	int getNumTriangles() const { return (int)m_TriangleGeometries.size(); }
 
 	// setter/getter
 
-	void addTriangle(const Triangle &t) { m_Triangles.push_back(t); }
-	void setTriangle(int i, const Triangle &t) { m_Triangles[i] = t; }
+	void addTriangle(const Triangle &t);	// the vertex attributes of t are appended to the mesh (not shared with other triangles)
 
-	const std::vector<Triangle> &getTriangles() const { return m_Triangles; }
-	std::vector<Triangle> &getTriangles() { return m_Triangles; }
+	Triangle getTriangle(int i) const;	// reassembled from the mesh arrays
 
-	const Triangle &getTriangle(int i) const { return m_Triangles[i]; }
-	Triangle &getTriangle(int i) { return m_Triangles[i]; }
+	vec3 getVertex0(int i) const { return m_TriangleGeometries[i].m_Vertex0; }
+	vec3 getVertex1(int i) const { return m_TriangleGeometries[i].m_Vertex0 + m_TriangleGeometries[i].m_Edge1; }
+	vec3 getVertex2(int i) const { return m_TriangleGeometries[i].m_Vertex0 + m_TriangleGeometries[i].m_Edge2; }
 
 	void computeBoundingBox();
 
@@ -88,24 +111,58 @@ public:
 	vec3 getBoundingBoxMin() const { return m_BoundingBoxPos[0]; }
 	vec3 getBoundingBoxMax() const { return m_BoundingBoxPos[1]; }
 
+	// each triangle is exposed as an individual primitive to acceleration structures
+	int getNumPrimitives() const { return getNumTriangles(); }
+	bool hitPrimitive(int primIdx, const Ray &r, Real tmin, Real tmax, HitRecord &record) const;
+	bool shadowHitPrimitive(int primIdx, const Ray &r, Real tmin, Real tmax) const
+	{
+		const TriangleGeometry &g = m_TriangleGeometries[primIdx];
+		Real t, beta, gamma;
+		return Triangle::Intersect(g.m_Vertex0, g.m_Edge1, g.m_Edge2, r, tmin, tmax, t, beta, gamma);
+	}
+	int hitPrimitivePacket(int primIdx, const RayPacket &packet, Real tmin, Real *tmax, int activeMask) const
+	{
+		const TriangleGeometry &g = m_TriangleGeometries[primIdx];
+		return Triangle::IntersectPacket(g.m_Vertex0, g.m_Edge1, g.m_Edge2, packet, tmin, tmax, activeMask);
+	}
+	vec3 getPrimitiveBoundingBoxMin(int primIdx) const { return glm::min(getVertex0(primIdx), glm::min(getVertex1(primIdx), getVertex2(primIdx))); }
+	vec3 getPrimitiveBoundingBoxMax(int primIdx) const { return glm::max(getVertex0(primIdx), glm::max(getVertex1(primIdx), getVertex2(primIdx))); }
+
+	size_t getMemorySize() const;	// bytes used by the triangle and attribute arrays
+
+	// a binary cache of the loaded arrays is written to <filename>.meshcache and used instead of parsing
+	// as long as the content hash of the obj file and the shading type match
 	bool loadObj(const char* filename);
 
+	static bool s_UseMeshCache;
+
 	void setShadingType(Shading_Type type) { m_ShadingType = type; }
 	Shading_Type getShadingType() const { return m_ShadingType; }
 
-	void bakeVBO();
+#ifndef HEADLESS
+	void bakeVBO() const;	// called on the first drawGL() if not done explicitly
+#endif
 
 private:
 	Shading_Type m_ShadingType;
 
-	GLuint m_VBO;
+	mutable unsigned int m_VBO;	// OpenGL buffer name
 
-	std::vector<Triangle> m_Triangles;
+	// intersection data and shading attributes are kept apart so that traversal only touches m_TriangleGeometries
+	std::vector<TriangleGeometry> m_TriangleGeometries;
+	std::vector<TriangleAttributes> m_TriangleAttributes;
+	std::vector<glm::vec3> m_Normals;
+	std::vector<glm::vec2> m_TexCoords;
 
 	vec3 m_BoundingBoxPos[2];
 
 	//bool rayBoundingBoxIntersectionTest(const Ray &r, Real tmin, Real tmax) const;
 
+	void setHitAttributes(int triIdx, const Ray &r, Real t, Real beta, Real gamma, HitRecord &record) const;
+
+	bool loadMeshCache(const char* filename, unsigned long long contentHash);
+	bool saveMeshCache(const char* filename, unsigned long long contentHash) const;
+
 	void calcVertexNormals(std::vector<glm::vec3>& normals, const std::vector<glm::vec3> &vertices, const std::vector<TriangleIndices> &indices);
 	void scaleAndCenterize(std::vector<glm::vec3>& vertices, float scale = 1.f);
 };
@@ -0,0 +1,391 @@
+#include "WavefrontIntegrator.h"
+#include "PathTracer.h"
+#include "Scene.h"
+#include "HitRecord.h"
+#include "MaterialSampling.h"
+#include "Spectrum.h"
+#include "Texture.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+// the material kernels follow the branches of PathTracer::traceRec, so that both integrators converge to the same image
+
+static inline bool isEnvironmentSamplingEnabled(const Scene &scene)
+{
+	return PathTracer::s_UseEnvironmentSampling && scene.hasEnvironmentSampling();
+}
+
+static inline bool isLightSamplingEnabled(const Scene &scene)
+{
+	return PathTracer::s_UseLightSampling && scene.hasLightSources();
+}
+
+// same as PathTracer::estimateDirectLighting
+template <class EvalBRDF, class BRDFPdf>
+static vec3 estimateDirectLighting(const Scene &scene, const vec3 &pos, const vec3 &normal, RandomStream &rng, EvalBRDF evalBRDF, BRDFPdf brdfPdf, long long &numShadowRays)
+{
+	vec3 directRadiance(0.f);
+
+	if (isEnvironmentSamplingEnabled(scene))
+	{
+		const float u1 = rng.next();
+		const float u2 = rng.next();
+
+		directRadiance += scene.estimateEnvironmentLighting(pos, normal, u1, u2, evalBRDF, brdfPdf, numShadowRays);
+	}
+
+	if (isLightSamplingEnabled(scene))
+	{
+		const float u0 = rng.next();
+		const float u1 = rng.next();
+		const float u2 = rng.next();
+
+		directRadiance += scene.estimateLightSourceLighting(pos, normal, u0, u1, u2, evalBRDF, brdfPdf, numShadowRays);
+	}
+
+	return directRadiance;
+}
+
+void WavefrontIntegrator::trace(const Scene &scene, PathQueue &paths, int nSamplesPerPixel, vec3 *radiance, RenderStatistics &stats, FirstHitAttributes *firstHits)
+{
+	m_NumSamplesPerPixel = nSamplesPerPixel;
+
+	for (int depth = 0; !paths.empty(); ++depth)
+	{
+		resize(paths.size());
+
+		intersect(scene, paths, depth, radiance, (depth == 0) ? firstHits : 0);
+
+		// closest-hit rays are counted per stage from the queue sizes, shadow rays where they are cast
+		if (depth <= PathTracer::s_MaxRecursionDepth)
+		{
+			stats.m_NumRays += paths.size();
+			if (depth == 0)
+				stats.m_NumPrimaryRays += paths.size();
+		}
+
+		for (int ti = 0; ti < Material::Num_Material_Types; ++ti)
+			stats.m_NumMaterialHits[ti] += m_MaterialQueues[ti].size();
+
+		shadeTerminal(paths, Material::Pseudo_Normal_Color_Type);
+		shadeTerminal(paths, Material::Ambient_Type);
+		shadeDiffuse(scene, paths, depth, radiance, stats);
+		shadeBlinnPhong(scene, paths, depth, radiance, stats, Material::Blinn_Phong_Type);
+		shadeBlinnPhong(scene, paths, depth, radiance, stats, Material::Textured_Type);
+		shadePerfectSpecular(scene, paths, depth);
+		shadeSpecularRefraction(scene, paths, depth);
+
+		m_NextPaths.clear();
+		m_NextPaths.reserve(paths.size());
+
+		russianRoulette(paths, radiance);
+
+		paths.swap(m_NextPaths);
+	}
+}
+
+void WavefrontIntegrator::resize(int n)
+{
+	m_HitPositions.resize(n);
+	m_Normals.resize(n);
+	m_Materials.resize(n);
+	m_TexCoords.resize(n);
+	m_TexFootprints.resize(n);
+	m_HitConeWidths.resize(n);
+
+	for (int ti = 0; ti < Material::Num_Material_Types; ++ti)
+		m_MaterialQueues[ti].clear();
+
+	m_NewDirections.resize(n);
+	m_Weights.resize(n);
+	m_ContinueProbabilities.resize(n);
+	m_TerminalRadiances.resize(n);
+	m_NewBsdfPdfs.assign(n, 0.f);
+	m_NewConeAngles.resize(n);
+	m_SplitDirections.resize(n);
+	m_SplitWeights.resize(n);
+	m_HasSplit.assign(n, false);
+}
+
+void WavefrontIntegrator::intersect(const Scene &scene, const PathQueue &paths, int depth, vec3 *radiance, FirstHitAttributes *firstHits)
+{
+	const float tEpsilon = 0.01f;
+	const float tInfinity = 1.0e+10f;
+
+	for (int i = 0; i < paths.size(); ++i)
+	{
+		const Ray ray(paths.m_Origins[i], paths.m_Directions[i], paths.m_ConeAngles[i], paths.m_ConeWidths[i]);
+
+		HitRecord record;
+		record.m_ParamT = tInfinity;
+
+		const float bsdfPdf = paths.m_BsdfPdfs[i];
+		const bool isHit = (depth <= PathTracer::s_MaxRecursionDepth) && scene.hit(ray, tEpsilon, tInfinity, record);
+
+		if (firstHits)
+			firstHits[paths.m_PixelIndices[i]].setNoHit();
+
+		// area lights end the path
+		vec3 emittedRadiance;
+		float lightPdf;
+
+		if (depth <= PathTracer::s_MaxRecursionDepth && scene.hasLightSources()
+			&& scene.hitLightSource(ray, tEpsilon, isHit ? record.m_ParamT : tInfinity, emittedRadiance, lightPdf))
+		{
+			const float misWeight = (bsdfPdf > 0.f && isLightSamplingEnabled(scene)) ? PowerHeuristic(bsdfPdf, lightPdf) : 1.f;
+
+			radiance[paths.m_PixelIndices[i]] += paths.m_Throughputs[i] * emittedRadiance * misWeight;
+			continue;
+		}
+
+		// terminated paths are not forwarded to any material queue
+		if (!isHit)
+		{
+			// unfiltered when combined with the direct sampling of the environment, as in PathTracer::getEscapedRadiance
+			const bool isCombined = bsdfPdf > 0.f && isEnvironmentSamplingEnabled(scene);
+			const vec3 background = scene.getBackgroundColor(isCombined ? Ray(ray.getOrigin(), ray.getUnitDir()) : ray);
+
+			radiance[paths.m_PixelIndices[i]] += paths.m_Throughputs[i] * background * (isCombined ? PowerHeuristic(bsdfPdf, scene.getEnvironmentPdf(ray.getUnitDir())) : 1.f);
+			continue;
+		}
+
+		if (firstHits)
+			firstHits[paths.m_PixelIndices[i]].setHit(record);
+
+		m_HitPositions[i] = record.m_HitPos;
+		m_Normals[i] = record.m_Normal;
+		m_Materials[i] = &Material::GetMaterialData(record.m_MaterialId);
+		m_TexCoords[i] = record.m_TexCoords;
+		m_TexFootprints[i] = PathTracer::GetTextureFootprint(ray, record);
+		m_HitConeWidths[i] = ray.getConeWidth(record.m_ParamT);
+
+		m_MaterialQueues[m_Materials[i]->m_Type].push_back(i);
+	}
+}
+
+void WavefrontIntegrator::shadeTerminal(const PathQueue &paths, Material::Material_Type matType)
+{
+	const vector<int> &queue = m_MaterialQueues[matType];
+
+	for (int qi = 0; qi < (int)queue.size(); ++qi)
+	{
+		const int i = queue[qi];
+
+		m_ContinueProbabilities[i] = 0.f;
+		m_TerminalRadiances[i] = (matType == Material::Pseudo_Normal_Color_Type) ? 0.5f * m_Normals[i] + vec3(0.5f) : vec3(0.f);
+	}
+}
+
+void WavefrontIntegrator::shadeDiffuse(const Scene &scene, PathQueue &paths, int depth, vec3 *radiance, RenderStatistics &stats)
+{
+	const vector<int> &queue = m_MaterialQueues[Material::Diffuse_Type];
+	const bool useNextEventEstimation = isEnvironmentSamplingEnabled(scene) || isLightSamplingEnabled(scene);
+
+	for (int qi = 0; qi < (int)queue.size(); ++qi)
+	{
+		const int i = queue[qi];
+		RandomStream &rng = paths.m_RandomStreams[i];
+		rng.startBounce(depth);
+
+		const vec3 &diffuseCoeff = m_Materials[i]->m_DiffuseCoeff;
+		const vec3 normal = (dot(m_Normals[i], paths.m_Directions[i]) < 0.f) ? m_Normals[i] : -m_Normals[i];
+
+		radiance[paths.m_PixelIndices[i]] += paths.m_Throughputs[i] * estimateDirectLighting(scene, m_HitPositions[i], normal, rng,
+			[&](const vec3 &wi) { return diffuseCoeff / pi<float>(); },
+			[&](const vec3 &wi) { return CosineWeightedPdf(normal, wi); }, stats.m_NumShadowRays);
+
+		const float xi1 = rng.next();
+		const float xi2 = rng.next();
+		const vec3 traceDir = SampleCosineWeightedDirection(normal, xi1, xi2);
+
+		m_NewDirections[i] = traceDir;
+		m_NewBsdfPdfs[i] = useNextEventEstimation ? CosineWeightedPdf(normal, traceDir) : 0.f;
+		m_NewConeAngles[i] = PathTracer::s_UseRayCones ? PathTracer::GetBounceConeAngle(paths.m_ConeAngles[i], CosineWeightedPdf(normal, traceDir), m_NumSamplesPerPixel) : 0.f;
+		m_Weights[i] = diffuseCoeff;
+		m_ContinueProbabilities[i] = (depth > PathTracer::s_MinRecursionDepth) ? std::max(diffuseCoeff.x, std::max(diffuseCoeff.y, diffuseCoeff.z)) : 1.f;
+		m_TerminalRadiances[i] = vec3(0.f);
+	}
+}
+
+void WavefrontIntegrator::shadeBlinnPhong(const Scene &scene, PathQueue &paths, int depth, vec3 *radiance, RenderStatistics &stats, Material::Material_Type matType)
+{
+	const vector<int> &queue = m_MaterialQueues[matType];
+	const bool useNextEventEstimation = isEnvironmentSamplingEnabled(scene) || isLightSamplingEnabled(scene);
+
+	for (int qi = 0; qi < (int)queue.size(); ++qi)
+	{
+		const int i = queue[qi];
+		RandomStream &rng = paths.m_RandomStreams[i];
+		rng.startBounce(depth);
+
+		const MaterialData *mat = m_Materials[i];
+		const vec3 diffuseCoeff = (matType == Material::Textured_Type)
+			? (mat->m_pTexture ? mat->m_pTexture->getFilteredColor(m_TexCoords[i], m_TexFootprints[i]) : vec3(0.f))
+			: mat->m_DiffuseCoeff;
+		const vec3 &specularCoeff = mat->m_SpecularCoeff;
+		const float shininess = mat->m_Shininess;
+
+		const vec3 normal = (dot(m_Normals[i], paths.m_Directions[i]) < 0.f) ? m_Normals[i] : -m_Normals[i];
+		const vec3 wo = -paths.m_Directions[i];
+		const BlinnPhongLobes lobes(diffuseCoeff, specularCoeff, depth > PathTracer::s_MinRecursionDepth);
+
+		radiance[paths.m_PixelIndices[i]] += paths.m_Throughputs[i] * estimateDirectLighting(scene, m_HitPositions[i], normal, rng,
+			[&](const vec3 &wi) { return diffuseCoeff / pi<float>() + EvalBlinnPhongSpecular(normal, wo, wi, specularCoeff, shininess); },
+			[&](const vec3 &wi) { return lobes.getPdf(normal, wo, wi, shininess); }, stats.m_NumShadowRays);
+
+		// the continue probability covers both lobes, and the lobe is chosen among the survivors;
+		// the russian roulette stage divides the weight by the continue probability again
+		const float continueProb = lobes.m_DiffuseProb + lobes.m_SpecularProb;
+
+		m_ContinueProbabilities[i] = continueProb;
+		m_TerminalRadiances[i] = vec3(0.f);
+
+		if (continueProb <= 0.f)
+			continue;
+
+		const float val = rng.next() * continueProb;
+		const float xi1 = rng.next();
+		const float xi2 = rng.next();
+
+		if (val < lobes.m_DiffuseProb)
+		{
+			m_NewDirections[i] = SampleCosineWeightedDirection(normal, xi1, xi2);
+			m_Weights[i] = diffuseCoeff * (continueProb / lobes.m_DiffuseProb);
+		}
+		else
+		{
+			const vec3 traceDir = SampleBlinnPhongDirection(normal, wo, shininess, xi1, xi2);
+			const float cosIn = dot(normal, traceDir);
+			const float pdf = BlinnPhongPdf(normal, wo, traceDir, shininess);
+
+			if (cosIn <= 0.f || pdf <= 0.f)
+			{
+				m_ContinueProbabilities[i] = 0.f;
+				continue;
+			}
+
+			m_NewDirections[i] = traceDir;
+			m_Weights[i] = EvalBlinnPhongSpecular(normal, wo, traceDir, specularCoeff, shininess) * (cosIn * continueProb / (pdf * lobes.m_SpecularProb));
+		}
+
+		m_NewBsdfPdfs[i] = useNextEventEstimation ? lobes.getPdf(normal, wo, m_NewDirections[i], shininess) : 0.f;
+		m_NewConeAngles[i] = PathTracer::s_UseRayCones ? PathTracer::GetBounceConeAngle(paths.m_ConeAngles[i], lobes.getPdf(normal, wo, m_NewDirections[i], shininess), m_NumSamplesPerPixel) : 0.f;
+	}
+}
+
+void WavefrontIntegrator::shadePerfectSpecular(const Scene &scene, PathQueue &paths, int depth)
+{
+	const vector<int> &queue = m_MaterialQueues[Material::Perfect_Specular_Type];
+
+	for (int qi = 0; qi < (int)queue.size(); ++qi)
+	{
+		const int i = queue[qi];
+		paths.m_RandomStreams[i].startBounce(depth);
+
+		const vec3 &specularCoeff = m_Materials[i]->m_SpecularCoeff;
+
+		m_NewDirections[i] = normalize(reflect(paths.m_Directions[i], m_Normals[i]));
+		m_Weights[i] = specularCoeff;
+		m_ContinueProbabilities[i] = (depth > PathTracer::s_MinRecursionDepth) ? std::max(specularCoeff.x, std::max(specularCoeff.y, specularCoeff.z)) : 1.f;
+		m_TerminalRadiances[i] = scene.getBackgroundColor(Ray(paths.m_Origins[i], paths.m_Directions[i], paths.m_ConeAngles[i]));
+		m_NewConeAngles[i] = paths.m_ConeAngles[i];
+	}
+}
+
+void WavefrontIntegrator::shadeSpecularRefraction(const Scene &scene, PathQueue &paths, int depth)
+{
+	const vector<int> &queue = m_MaterialQueues[Material::Specular_Refraction_Type];
+
+	for (int qi = 0; qi < (int)queue.size(); ++qi)
+	{
+		const int i = queue[qi];
+		RandomStream &rng = paths.m_RandomStreams[i];
+		rng.startBounce(depth);
+
+		const MaterialData *mat = m_Materials[i];
+		const vec3 &specularCoeff = mat->m_SpecularCoeff;
+		const vec3 &dir = paths.m_Directions[i];
+
+		m_ContinueProbabilities[i] = (depth > PathTracer::s_MinRecursionDepth) ? std::max(specularCoeff.x, std::max(specularCoeff.y, specularCoeff.z)) : 1.f;
+		m_TerminalRadiances[i] = scene.getBackgroundColor(Ray(paths.m_Origins[i], dir, paths.m_ConeAngles[i]));
+		m_NewConeAngles[i] = paths.m_ConeAngles[i];
+
+		// hero wavelength, as in PathTracer::shadeSpecularRefraction
+		vec3 spectralWeight(1.f);
+		if (PathTracer::s_UseSpectralDispersion && mat->m_DispersionCoeff != 0.f && paths.m_Wavelengths[i] <= 0.f)
+			paths.m_Wavelengths[i] = Spectrum::SampleWavelength(rng.next(), spectralWeight);
+
+		const float _dot = dot(dir, m_Normals[i]);
+		const bool isEntering = _dot < 0.f;
+
+		const float eta = Spectrum::GetRefractionIndex(mat->m_RefractionIndex, mat->m_DispersionCoeff, paths.m_Wavelengths[i]);
+		const float relativeIndex = isEntering ? 1 / eta : eta;
+
+		// Schlick's Fresnel approximation
+		const float R0 = ((eta - 1.f) * (eta - 1.f)) / ((eta + 1.f) * (eta + 1.f));
+		const float c = 1.f - fabsf(_dot);
+		const float c2 = c * c;
+		const float Re = R0 + (1 - R0) * c2 * c2 * c;
+		const float Tr = (1.f - Re) * relativeIndex * relativeIndex;
+
+		const vec3 normal = isEntering ? m_Normals[i] : -m_Normals[i];
+		const vec3 refractVec = refract(dir, normal, relativeIndex);
+		const vec3 reflectVec = reflect(dir, normal);
+
+		if (refractVec == vec3(0.f))	// total reflection
+		{
+			m_NewDirections[i] = reflectVec;
+			m_Weights[i] = spectralWeight * specularCoeff;
+		}
+		else if (depth <= PathTracer::s_FresnelSplitDepth)
+		{
+			// follow both directions near the eye
+			m_NewDirections[i] = reflectVec;
+			m_Weights[i] = Re * spectralWeight * specularCoeff;
+			m_SplitDirections[i] = refractVec;
+			m_SplitWeights[i] = Tr * spectralWeight * specularCoeff;
+			m_HasSplit[i] = true;
+		}
+		else if (rng.next() < Re)
+		{
+			m_NewDirections[i] = reflectVec;
+			m_Weights[i] = spectralWeight * specularCoeff;
+		}
+		else
+		{
+			m_NewDirections[i] = refractVec;
+			m_Weights[i] = Tr * spectralWeight * specularCoeff / (1.f - Re);
+		}
+	}
+}
+
+void WavefrontIntegrator::russianRoulette(PathQueue &paths, vec3 *radiance)
+{
+	// surviving paths are compacted into the next queue, grouped by the material they hit
+	for (int ti = 0; ti < Material::Num_Material_Types; ++ti)
+	{
+		const vector<int> &queue = m_MaterialQueues[ti];
+
+		for (int qi = 0; qi < (int)queue.size(); ++qi)
+		{
+			const int i = queue[qi];
+			const float p = m_ContinueProbabilities[i];
+			RandomStream &rng = paths.m_RandomStreams[i];
+
+			if (p <= 0.f || rng.next() >= p)
+			{
+				radiance[paths.m_PixelIndices[i]] += paths.m_Throughputs[i] * m_TerminalRadiances[i];
+				continue;
+			}
+
+			const vec3 throughput = paths.m_Throughputs[i] / p;
+
+			m_NextPaths.push(m_HitPositions[i], m_NewDirections[i], throughput * m_Weights[i], m_NewBsdfPdfs[i], paths.m_Wavelengths[i], m_NewConeAngles[i], m_HitConeWidths[i], paths.m_PixelIndices[i], rng);
+
+			if (m_HasSplit[i])
+				m_NextPaths.push(m_HitPositions[i], m_SplitDirections[i], throughput * m_SplitWeights[i], 0.f, paths.m_Wavelengths[i], m_NewConeAngles[i], m_HitConeWidths[i], paths.m_PixelIndices[i], rng.fork(1));
+		}
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "Ray.h"
+#include "Material.h"
+#include "RandomStream.h"
+#include "RenderStatistics.h"
+#include "FirstHitAttributes.h"
+#include "glm/glm.hpp"
+#include <vector>
+
+class Scene;
+
+// states of the paths in flight, stored as structure of arrays
+struct PathQueue
+{
+	std::vector<glm::vec3> m_Origins;
+	std::vector<glm::vec3> m_Directions;
+	std::vector<glm::vec3> m_Throughputs;
+	std::vector<float> m_BsdfPdfs;	// density of the BRDF sample if the environment was also sampled directly (0 otherwise)
+	std::vector<float> m_Wavelengths;	// hero wavelength in nm (0: RGB), see PathTracer::traceRec
+	std::vector<float> m_ConeAngles;	// ray cones, see Ray
+	std::vector<float> m_ConeWidths;
+	std::vector<int> m_PixelIndices;	// where the radiance of the path is accumulated
+	std::vector<RandomStream> m_RandomStreams;
+
+	int size() const { return (int)m_PixelIndices.size(); }
+	bool empty() const { return m_PixelIndices.empty(); }
+
+	void clear()
+	{
+		m_Origins.clear();
+		m_Directions.clear();
+		m_Throughputs.clear();
+		m_BsdfPdfs.clear();
+		m_Wavelengths.clear();
+		m_ConeAngles.clear();
+		m_ConeWidths.clear();
+		m_PixelIndices.clear();
+		m_RandomStreams.clear();
+	}
+
+	void reserve(int n)
+	{
+		m_Origins.reserve(n);
+		m_Directions.reserve(n);
+		m_Throughputs.reserve(n);
+		m_BsdfPdfs.reserve(n);
+		m_Wavelengths.reserve(n);
+		m_ConeAngles.reserve(n);
+		m_ConeWidths.reserve(n);
+		m_PixelIndices.reserve(n);
+		m_RandomStreams.reserve(n);
+	}
+
+	void push(const glm::vec3 &origin, const glm::vec3 &dir, const glm::vec3 &throughput, float bsdfPdf, float wavelength, float coneAngle, float coneWidth, int pixelIdx, const RandomStream &rng)
+	{
+		m_Origins.push_back(origin);
+		m_Directions.push_back(dir);
+		m_Throughputs.push_back(throughput);
+		m_BsdfPdfs.push_back(bsdfPdf);
+		m_Wavelengths.push_back(wavelength);
+		m_ConeAngles.push_back(coneAngle);
+		m_ConeWidths.push_back(coneWidth);
+		m_PixelIndices.push_back(pixelIdx);
+		m_RandomStreams.push_back(rng);
+	}
+
+	void swap(PathQueue &q)
+	{
+		m_Origins.swap(q.m_Origins);
+		m_Directions.swap(q.m_Directions);
+		m_Throughputs.swap(q.m_Throughputs);
+		m_BsdfPdfs.swap(q.m_BsdfPdfs);
+		m_Wavelengths.swap(q.m_Wavelengths);
+		m_ConeAngles.swap(q.m_ConeAngles);
+		m_ConeWidths.swap(q.m_ConeWidths);
+		m_PixelIndices.swap(q.m_PixelIndices);
+		m_RandomStreams.swap(q.m_RandomStreams);
+	}
+};
+
+// iterative alternative to PathTracer::traceRec
+// all paths of a queue advance one bounce at a time through separate stages:
+// intersection -> one kernel per material type -> russian roulette -> compaction into the next queue
+class WavefrontIntegrator
+{
+public:
+	// traces the paths in the queue (the queue is consumed) and adds their radiance to radiance[pixelIdx];
+	// the paths must start with primary rays, and the rays and hits are counted into stats;
+	// firstHits[pixelIdx] receives the first hit of each path; nSamplesPerPixel of the render sets the spread of the ray cones
+	void trace(const Scene &scene, PathQueue &paths, int nSamplesPerPixel, glm::vec3 *radiance, RenderStatistics &stats, FirstHitAttributes *firstHits);
+
+private:
+	// hit data of the current bounce
+	std::vector<glm::vec3> m_HitPositions;
+	std::vector<glm::vec3> m_Normals;
+	std::vector<const MaterialData*> m_Materials;	// entries of the material table
+	std::vector<glm::vec3> m_TexCoords;
+	std::vector<float> m_TexFootprints;	// see PathTracer::GetTextureFootprint
+	std::vector<float> m_HitConeWidths;	// width of the ray cone at the hit, that of the next ray
+	std::vector<int> m_MaterialQueues[Material::Num_Material_Types];	// indices of the paths that hit each material type
+
+	// output of the material kernels, consumed by the russian roulette stage
+	std::vector<glm::vec3> m_NewDirections;
+	std::vector<float> m_NewBsdfPdfs;
+	std::vector<float> m_NewConeAngles;
+	std::vector<glm::vec3> m_Weights;
+	std::vector<float> m_ContinueProbabilities;
+	std::vector<glm::vec3> m_TerminalRadiances;	// added when the path is terminated
+	std::vector<glm::vec3> m_SplitDirections;	// second path spawned by Fresnel splitting
+	std::vector<glm::vec3> m_SplitWeights;
+	std::vector<bool> m_HasSplit;
+
+	PathQueue m_NextPaths;
+	int m_NumSamplesPerPixel;	// of the current trace(), see PathTracer::GetBounceConeAngle
+
+	void resize(int n);
+
+	void intersect(const Scene &scene, const PathQueue &paths, int depth, glm::vec3 *radiance, FirstHitAttributes *firstHits);	// firstHits only at depth 0
+
+	void shadeTerminal(const PathQueue &paths, Material::Material_Type matType);
+	void shadeDiffuse(const Scene &scene, PathQueue &paths, int depth, glm::vec3 *radiance, RenderStatistics &stats);	// also adds environment lighting (next-event estimation)
+	void shadeBlinnPhong(const Scene &scene, PathQueue &paths, int depth, glm::vec3 *radiance, RenderStatistics &stats, Material::Material_Type matType);	// also the textured material
+	void shadePerfectSpecular(const Scene &scene, PathQueue &paths, int depth);
+	void shadeSpecularRefraction(const Scene &scene, PathQueue &paths, int depth);
+
+	void russianRoulette(PathQueue &paths, glm::vec3 *radiance);
+};
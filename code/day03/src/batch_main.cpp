@@ -0,0 +1,148 @@
+// headless batch renderer: renders the demo scene without creating a window or an OpenGL context
+//
+// usage: advanced03_batch [-scene pyramid|bunnies|lights|textured] [-o output.pfm|output.exr] [-w width] [-h height] [-spp samples] [-threads n] [-seed s] [-packets 0|1] [-wavefront 0|1] [-envsampling 0|1] [-lightsampling 0|1] [-raycones|-envfilter 0|1] [-sampler independent|sobol] [-dispersion 0|1] [-splitdepth n] [-denoise 0|1] [-aovs depth,normal,albedo,material_id,object_id,sample_count,time|all]
+//        [-adaptive error_threshold] [-heatmap sample_counts.pfm|.exr]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <chrono>
+
+#include <IL/il.h>
+
+#include "arcball_camera.h"
+#include "PathTracer.h"
+#include "Scene.h"
+#include "DemoScenes.h"
+#include "ImageIO.h"
+
+using namespace std;
+using namespace glm;
+
+static void printUsage(const char* command)
+{
+	cerr << "usage: " << command << " [-scene pyramid|bunnies|lights|textured] [-o output.pfm|output.exr] [-w width] [-h height] [-spp samples] [-threads n] [-seed s] [-packets 0|1] [-wavefront 0|1] [-envsampling 0|1] [-lightsampling 0|1] [-raycones|-envfilter 0|1] [-sampler independent|sobol] [-dispersion 0|1] [-splitdepth n] [-denoise 0|1] [-aovs depth,normal,albedo,material_id,object_id,sample_count,time|all]"
+		<< " [-adaptive error_threshold] [-heatmap sample_counts.pfm|.exr]" << endl;
+}
+
+int main(int argc, char** argv)
+{
+	string outputFilename = "output.pfm";
+	string heatmapFilename;
+	string sceneName = "pyramid";
+	int width = 800, height = 800;
+	int nSamplesPerPixel = PathTracer::s_NumSamplesPerPixel;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool hasValue = (i + 1 < argc);
+
+		if (!strcmp(argv[i], "-scene") && hasValue) sceneName = argv[++i];
+		else if (!strcmp(argv[i], "-o") && hasValue) outputFilename = argv[++i];
+		else if (!strcmp(argv[i], "-w") && hasValue) width = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-h") && hasValue) height = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-spp") && hasValue) nSamplesPerPixel = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-threads") && hasValue) PathTracer::s_NumThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-seed") && hasValue) PathTracer::s_RandomSeed = (unsigned int)strtoul(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "-packets") && hasValue) PathTracer::s_UsePacketTracing = (atoi(argv[++i]) != 0);
+		else if (!strcmp(argv[i], "-wavefront") && hasValue) PathTracer::s_UseWavefront = (atoi(argv[++i]) != 0);
+		else if (!strcmp(argv[i], "-envsampling") && hasValue) PathTracer::s_UseEnvironmentSampling = (atoi(argv[++i]) != 0);
+		else if (!strcmp(argv[i], "-lightsampling") && hasValue) PathTracer::s_UseLightSampling = (atoi(argv[++i]) != 0);
+		else if ((!strcmp(argv[i], "-raycones") || !strcmp(argv[i], "-envfilter")) && hasValue) PathTracer::s_UseRayCones = (atoi(argv[++i]) != 0);	// -envfilter: the former name
+		else if (!strcmp(argv[i], "-sampler") && hasValue)
+		{
+			const string samplerName = argv[++i];
+
+			if (samplerName == "independent")
+				PathTracer::s_SamplerType = RandomStream::Independent_Sampler;
+			else if (samplerName == "sobol")
+				PathTracer::s_SamplerType = RandomStream::Sobol_Sampler;
+			else
+			{
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "-dispersion") && hasValue) PathTracer::s_UseSpectralDispersion = (atoi(argv[++i]) != 0);
+		else if (!strcmp(argv[i], "-splitdepth") && hasValue) PathTracer::s_FresnelSplitDepth = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-denoise") && hasValue) PathTracer::s_UseDenoiser = (atoi(argv[++i]) != 0);
+		else if (!strcmp(argv[i], "-aovs") && hasValue)
+		{
+			if (!AOVBuffer::ParseTypeMask(argv[++i], PathTracer::s_AOVMask))
+			{
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "-adaptive") && hasValue)
+		{
+			PathTracer::s_UseAdaptiveSampling = true;
+			PathTracer::s_AdaptiveErrorThreshold = (float)atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-heatmap") && hasValue) heatmapFilename = argv[++i];
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (width < 1 || height < 1 || nSamplesPerPixel < 1 || (sceneName != "pyramid" && sceneName != "bunnies" && sceneName != "lights" && sceneName != "textured"))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	ilInit();
+
+	Scene scene;
+	if (sceneName == "bunnies")
+		CreateInstancedBunnyScene(scene);
+	else if (sceneName == "lights")
+		CreateLightSourceScene(scene);
+	else if (sceneName == "textured")
+		CreateTexturedScene(scene);
+	else
+		CreateSpherePyramidScene(scene);
+
+	// same initial view as the interactive viewer
+	ArcballCamera camera(vec3(-6, 2, 0), vec3(0, 1.5, 0), vec3(0, 1, 0));
+	const float fovy = 45.f;
+
+	PathTracer pathTracer;
+
+	const auto tStart = chrono::steady_clock::now();
+	pathTracer.renderImage(scene, camera, fovy, width, height, nSamplesPerPixel);
+	const auto tEnd = chrono::steady_clock::now();
+
+	cerr << __FUNCTION__ << ": " << width << "x" << height << ", " << nSamplesPerPixel << " spp rendered in "
+		<< chrono::duration<float>(tEnd - tStart).count() << " sec" << endl;
+
+	bool saved = SaveImage(outputFilename.c_str(), pathTracer.getDenoisedFrameBuffer());
+
+	if (saved)
+		cerr << __FUNCTION__ << ": " << outputFilename << " saved" << endl;
+
+	// next to the color image, e.g. output_depth.pfm
+	if (PathTracer::s_AOVMask && !pathTracer.getAOVs().saveImages(outputFilename.c_str(), PathTracer::s_AOVMask))
+		saved = false;
+
+	if (!heatmapFilename.empty())
+	{
+		PathTracer::ImageRGBf heatmap;
+		pathTracer.makeSampleCountHeatmap(heatmap);
+
+		if (SaveImage(heatmapFilename.c_str(), heatmap))
+			cerr << __FUNCTION__ << ": " << heatmapFilename << " saved" << endl;
+		else
+			saved = false;
+	}
+
+	GeometricObject::ClearGeometricObjectCache();
+	Material::ClearMaterialCache();
+	Texture::ClearTextureCache();
+
+	return saved ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+// ray tracing benchmark: renders fixed scenes headlessly with a fixed seed and reports the ray throughput,
+// the average path length, the hit counts per material type, the scaling over the number of threads and the times of a BVH build and refit as JSON;
+// for the refit, every other sphere and instance is moved by half its size, and the SAH cost before and after is reported
+//
+// usage: advanced03_benchmark [-o benchmark.json] [-w width] [-h height] [-spp samples] [-threads max_threads] [-scenes pyramid,bunny,instances]
+//        [-packets 0|1] [-wavefront 0|1]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <IL/il.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "arcball_camera.h"
+#include "PathTracer.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "Instance.h"
+#include "DemoScenes.h"
+
+using namespace std;
+using namespace glm;
+
+struct BenchmarkScene
+{
+	const char* m_Name;
+	void (*m_Create)(Scene& scene);
+	vec3 m_Eye, m_Target;
+};
+
+static const BenchmarkScene s_BenchmarkScenes[] =
+{
+	{ "pyramid", CreateSpherePyramidScene, vec3(-6, 2, 0), vec3(0, 1.5, 0) },
+	{ "bunny", CreateBunnyScene, vec3(2.5f, 1.2f, 2.5f), vec3(0.5f, 0.4f, 0.5f) },
+	{ "instances", CreateInstancedBunnyScene, vec3(-6, 2, 0), vec3(0, 1.5, 0) },
+};
+
+static const char* s_MaterialTypeNames[Material::Num_Material_Types] =
+{
+	"pseudo_normal_color", "ambient", "diffuse", "blinn_phong", "textured", "perfect_specular", "specular_refraction"
+};
+
+// moves every other sphere and instance of the scene by half its size; the number of moved objects
+static int moveObjects(Scene& scene)
+{
+	int nMoved = 0;
+
+	for (int oi = 0; oi < scene.getNumObjects(); oi += 2)
+	{
+		GeometricObject* pObject = scene.getObject(oi);
+
+		if (Sphere* pSphere = dynamic_cast<Sphere*>(pObject))
+		{
+			pSphere->setCenter(pSphere->getCenter() + vec3(0, pSphere->getRadius(), 0));
+			++nMoved;
+		}
+		else if (Instance* pInstance = dynamic_cast<Instance*>(pObject))
+		{
+			mat4x3 objectToWorld = pInstance->getTransform();
+			objectToWorld[3] += 0.5f * (pInstance->getBoundingBoxMax() - pInstance->getBoundingBoxMin());
+			pInstance->setTransform(objectToWorld);
+			++nMoved;
+		}
+	}
+
+	return nMoved;
+}
+
+static void printUsage(const char* command)
+{
+	cerr << "usage: " << command << " [-o benchmark.json] [-w width] [-h height] [-spp samples] [-threads max_threads] [-scenes pyramid,bunny,instances]"
+		<< " [-packets 0|1] [-wavefront 0|1]" << endl;
+}
+
+// 1, 2, 4, ... up to maxThreads, which is always included
+static vector<int> threadCounts(int maxThreads)
+{
+	vector<int> counts;
+
+	for (int n = 1; n < maxThreads; n *= 2)
+		counts.push_back(n);
+	counts.push_back(maxThreads);
+
+	return counts;
+}
+
+int main(int argc, char** argv)
+{
+	string outputFilename = "benchmark.json";	// not stdout, which also receives the log of the mesh loader
+	string sceneNames = "pyramid,bunny,instances";
+	int width = 256, height = 256;
+	int nSamplesPerPixel = 16;
+
+#ifdef _OPENMP
+	int maxThreads = omp_get_max_threads();
+#else
+	int maxThreads = 1;
+#endif
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool hasValue = (i + 1 < argc);
+
+		if (!strcmp(argv[i], "-o") && hasValue) outputFilename = argv[++i];
+		else if (!strcmp(argv[i], "-w") && hasValue) width = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-h") && hasValue) height = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-spp") && hasValue) nSamplesPerPixel = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-threads") && hasValue) maxThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-scenes") && hasValue) sceneNames = argv[++i];
+		else if (!strcmp(argv[i], "-packets") && hasValue) PathTracer::s_UsePacketTracing = (atoi(argv[++i]) != 0);
+		else if (!strcmp(argv[i], "-wavefront") && hasValue) PathTracer::s_UseWavefront = (atoi(argv[++i]) != 0);
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (width < 1 || height < 1 || nSamplesPerPixel < 1 || maxThreads < 1)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	ilInit();
+
+	// fixed settings, so that the results of different builds are comparable
+	PathTracer::s_RandomSeed = 0;
+	PathTracer::s_UseAdaptiveSampling = false;
+
+	const float fovy = 45.f;
+	const vector<int> nThreadsList = threadCounts(maxThreads);
+
+	ostringstream json;
+	json << "{\n"
+		<< "  \"width\": " << width << ",\n"
+		<< "  \"height\": " << height << ",\n"
+		<< "  \"spp\": " << nSamplesPerPixel << ",\n"
+		<< "  \"seed\": " << PathTracer::s_RandomSeed << ",\n"
+		<< "  \"packets\": " << (PathTracer::s_UsePacketTracing ? "true" : "false") << ",\n"
+		<< "  \"wavefront\": " << (PathTracer::s_UseWavefront ? "true" : "false") << ",\n"
+		<< "  \"scenes\": [";
+
+	int nScenes = 0;
+
+	for (const BenchmarkScene& bs : s_BenchmarkScenes)
+	{
+		if (("," + sceneNames + ",").find(string(",") + bs.m_Name + ",") == string::npos)
+			continue;
+
+		Scene scene;
+		bs.m_Create(scene);
+
+		const auto tBuildStart = chrono::steady_clock::now();
+		scene.updateAccelerationStructure();	// not included in the render timings
+		const auto tBuildEnd = chrono::steady_clock::now();
+
+		ArcballCamera camera(bs.m_Eye, bs.m_Target, vec3(0, 1, 0));
+		PathTracer pathTracer;
+
+		json << (nScenes++ ? "," : "") << "\n    {\n"
+			<< "      \"name\": \"" << bs.m_Name << "\",\n"
+			<< "      \"runs\": [";
+
+		float singleThreadSeconds = 0.f;
+
+		for (int ri = 0; ri < (int)nThreadsList.size(); ++ri)
+		{
+			PathTracer::s_NumThreads = nThreadsList[ri];
+
+			const auto tStart = chrono::steady_clock::now();
+			pathTracer.renderImage(scene, camera, fovy, width, height, nSamplesPerPixel);
+			const auto tEnd = chrono::steady_clock::now();
+
+			const float seconds = chrono::duration<float>(tEnd - tStart).count();
+			const RenderStatistics& stats = pathTracer.getStatistics();
+
+			if (ri == 0)
+				singleThreadSeconds = seconds;
+
+			json << (ri ? "," : "") << "\n        { "
+				<< "\"threads\": " << nThreadsList[ri]
+				<< ", \"seconds\": " << seconds
+				<< ", \"primary_rays_per_second\": " << stats.m_NumPrimaryRays / seconds
+				<< ", \"total_rays_per_second\": " << stats.getNumTotalRays() / seconds
+				<< ", \"speedup\": " << singleThreadSeconds / seconds << " }";
+
+			cerr << __FUNCTION__ << ": " << bs.m_Name << ", " << nThreadsList[ri] << " threads: "
+				<< stats.getNumTotalRays() / seconds * 1.0e-6f << " Mrays/s" << endl;
+		}
+
+		// the counters do not depend on the number of threads
+		const RenderStatistics& stats = pathTracer.getStatistics();
+
+		// the bounds update of the scene BVH when objects move, with all threads; it is a rebuild if the refit gives up
+		const float buildSAHCost = scene.getBVH().getSAHCost();
+		const int nMovedObjects = moveObjects(scene);
+		scene.invalidateAccelerationStructure();
+
+		const auto tRefitStart = chrono::steady_clock::now();
+		const bool isRebuilt = scene.updateAccelerationStructure();
+		const auto tRefitEnd = chrono::steady_clock::now();
+
+		json << "\n      ],\n"
+			<< "      \"primary_rays\": " << stats.m_NumPrimaryRays << ",\n"
+			<< "      \"rays\": " << stats.m_NumRays << ",\n"
+			<< "      \"shadow_rays\": " << stats.m_NumShadowRays << ",\n"
+			<< "      \"average_path_length\": " << stats.getAveragePathLength() << ",\n"
+			<< "      \"bvh_build_ms\": " << chrono::duration<float, milli>(tBuildEnd - tBuildStart).count() << ",\n"
+			<< "      \"bvh_refit_ms\": " << chrono::duration<float, milli>(tRefitEnd - tRefitStart).count() << ",\n"
+			<< "      \"bvh_refit_moved_objects\": " << nMovedObjects << ",\n"
+			<< "      \"bvh_refit_rebuilt\": " << (isRebuilt ? "true" : "false") << ",\n"
+			<< "      \"bvh_sah_cost_build\": " << buildSAHCost << ",\n"
+			<< "      \"bvh_sah_cost_refit\": " << scene.getBVH().getSAHCost() << ",\n"
+			<< "      \"material_hits\": {";
+
+		for (int ti = 0; ti < Material::Num_Material_Types; ++ti)
+			json << (ti ? ", " : " ") << "\"" << s_MaterialTypeNames[ti] << "\": " << stats.m_NumMaterialHits[ti];
+
+		json << " }\n    }";
+
+		GeometricObject::ClearGeometricObjectCache();
+		Material::ClearMaterialCache();
+		Texture::ClearTextureCache();
+	}
+
+	json << "\n  ]\n}\n";
+
+	if (!nScenes)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	ofstream ofs(outputFilename.c_str());
+
+	if (!(ofs << json.str()))
+	{
+		cerr << __FUNCTION__ << ": cannot write " << outputFilename << endl;
+		return 1;
+	}
+
+	cerr << __FUNCTION__ << ": " << outputFilename << " saved" << endl;
+
+	return 0;
+}
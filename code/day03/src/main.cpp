@@ -22,15 +22,7 @@
 #include "PathTracer.h"
 
 #include "Scene.h"
-
-#include "Sphere.h"
-#include "TriangleMesh.h"
-
-#include "PseudoNormalColorMaterial.h"
-#include "DiffuseMaterial.h"
-#include "BlinnPhongMaterial.h"
-#include "PerfectSpecularMaterial.h"
-#include "SpecularRefractionMaterial.h"
+#include "DemoScenes.h"
 
 #pragma comment(lib, "opengl32.lib")
 #pragma comment(lib, "glew32.lib")
@@ -60,6 +52,84 @@ glm::mat4 g_ProjMatrix = glm::perspective(45.f, g_WindowWidth / float(g_WindowHe
 bool g_KeepTracing = false;
 bool g_DraggingMenu = false;
 bool g_DisplayPathTracedResult = false;
+bool g_ProgressiveRendering = true;	// render in the background and restart whenever the view or the settings change
+bool g_RestartRendering = false;
+
+// the UI edits a copy of the settings of PathTracer: the background rendering reads the static members,
+// so the copy is applied only after it has been stopped
+struct RenderSettings
+{
+	int m_MaxRecursionDepth;
+	int m_MinRecursionDepth;
+	int m_NumSamplesPerPixel;
+	int m_NumSamplesPerUpdate;
+	int m_TileSize;
+	int m_NumThreads;
+	bool m_ReportTileTimes;
+	bool m_UsePacketTracing;
+	bool m_UseWavefront;
+	bool m_UseEnvironmentSampling;
+	bool m_UseLightSampling;
+	bool m_UseRayCones;
+	bool m_UseDenoiser;
+	int m_SamplerType;
+	bool m_UseSpectralDispersion;
+	int m_FresnelSplitDepth;
+	bool m_UseAdaptiveSampling;
+	float m_AdaptiveErrorThreshold;
+	int m_MinAdaptiveSamples;
+	int m_MaxAdaptiveSamplesScale;
+
+	void load()
+	{
+		m_MaxRecursionDepth = PathTracer::s_MaxRecursionDepth;
+		m_MinRecursionDepth = PathTracer::s_MinRecursionDepth;
+		m_NumSamplesPerPixel = PathTracer::s_NumSamplesPerPixel;
+		m_NumSamplesPerUpdate = PathTracer::s_NumSamplesPerUpdate;
+		m_TileSize = PathTracer::s_TileSize;
+		m_NumThreads = PathTracer::s_NumThreads;
+		m_ReportTileTimes = PathTracer::s_ReportTileTimes;
+		m_UsePacketTracing = PathTracer::s_UsePacketTracing;
+		m_UseWavefront = PathTracer::s_UseWavefront;
+		m_UseEnvironmentSampling = PathTracer::s_UseEnvironmentSampling;
+		m_UseLightSampling = PathTracer::s_UseLightSampling;
+		m_UseRayCones = PathTracer::s_UseRayCones;
+		m_UseDenoiser = PathTracer::s_UseDenoiser;
+		m_SamplerType = (int)PathTracer::s_SamplerType;
+		m_UseSpectralDispersion = PathTracer::s_UseSpectralDispersion;
+		m_FresnelSplitDepth = PathTracer::s_FresnelSplitDepth;
+		m_UseAdaptiveSampling = PathTracer::s_UseAdaptiveSampling;
+		m_AdaptiveErrorThreshold = PathTracer::s_AdaptiveErrorThreshold;
+		m_MinAdaptiveSamples = PathTracer::s_MinAdaptiveSamples;
+		m_MaxAdaptiveSamplesScale = PathTracer::s_MaxAdaptiveSamplesScale;
+	}
+
+	void apply() const
+	{
+		PathTracer::s_MaxRecursionDepth = m_MaxRecursionDepth;
+		PathTracer::s_MinRecursionDepth = m_MinRecursionDepth;
+		PathTracer::s_NumSamplesPerPixel = m_NumSamplesPerPixel;
+		PathTracer::s_NumSamplesPerUpdate = m_NumSamplesPerUpdate;
+		PathTracer::s_TileSize = m_TileSize;
+		PathTracer::s_NumThreads = m_NumThreads;
+		PathTracer::s_ReportTileTimes = m_ReportTileTimes;
+		PathTracer::s_UsePacketTracing = m_UsePacketTracing;
+		PathTracer::s_UseWavefront = m_UseWavefront;
+		PathTracer::s_UseEnvironmentSampling = m_UseEnvironmentSampling;
+		PathTracer::s_UseLightSampling = m_UseLightSampling;
+		PathTracer::s_UseRayCones = m_UseRayCones;
+		PathTracer::s_UseDenoiser = m_UseDenoiser;
+		PathTracer::s_SamplerType = (RandomStream::Sampler_Type)m_SamplerType;
+		PathTracer::s_UseSpectralDispersion = m_UseSpectralDispersion;
+		PathTracer::s_FresnelSplitDepth = m_FresnelSplitDepth;
+		PathTracer::s_UseAdaptiveSampling = m_UseAdaptiveSampling;
+		PathTracer::s_AdaptiveErrorThreshold = m_AdaptiveErrorThreshold;
+		PathTracer::s_MinAdaptiveSamples = m_MinAdaptiveSamples;
+		PathTracer::s_MaxAdaptiveSamplesScale = m_MaxAdaptiveSamplesScale;
+	}
+};
+
+RenderSettings g_RenderSettings;
 
 void errorCallback(int error, const char* description)
 {
@@ -158,73 +228,19 @@ void init()
 	glClampColor(GL_CLAMP_VERTEX_COLOR, GL_FALSE);
 	glClampColor(GL_CLAMP_FRAGMENT_COLOR, GL_FALSE);
 
-	{
-		{
-			PathFinder finder;
-			finder.addSearchPath("Resources");
-			finder.addSearchPath("../Resources");
-			finder.addSearchPath("../../Resources");
-
-			g_Scene.loadEnvironmentMap(finder.find("sunset_fairway_2k.hdr").c_str());
-		}
-
-		// floor
-		{
-			DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
-			m->setDiffuseCoeff(0.5f, 0.5f, 0.5f);
-
-			const float halfSize = 3.f;
-
-			TriangleMesh* o = TriangleMesh::CreateGeometricObject();
-			o->addTriangle(Triangle(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), m));
-			o->addTriangle(Triangle(vec3(-halfSize, 0.f, halfSize), vec3(halfSize, 0.f, -halfSize), vec3(-halfSize, 0.f, -halfSize), m));
-			o->bakeVBO();
-			o->setMaterial(m);
-
-			g_Scene.addObject(o);
-		}
-
-		// pyramid top
-		{
-			PerfectSpecularMaterial* m = PerfectSpecularMaterial::CreateMaterial();
-			m->setSpecularCoeff(0.5f, 0.5f, 0.5f);
-			g_Scene.addObject(Sphere::CreateGeometricObject(glm::vec3(0.f, sqrtf(2.f) + 1.f, 0.f), 1.f, m));
-		}
-
-		// front left
-		{
-			//DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
-			BlinnPhongMaterial* m = BlinnPhongMaterial::CreateMaterial();
-			m->setDiffuseCoeff(0.2f, 0.2f, 0.2f);
-			m->setSpecularCoeff(0.8f, 0.2f, 0.2f);
-			m->setShininess(64.f);
-			g_Scene.addObject(Sphere::CreateGeometricObject(glm::vec3(-1.f, 1.f, 1.f), 1.f, m));
-		}
-
-		// front right
-		{
-			//DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
-			//m->setDiffuseCoeff(0.5f, 1.f, 0.5f);
-			SpecularRefractionMaterial* m = SpecularRefractionMaterial::CreateMaterial();
-			m->setRefractionIndex(1.5f);
-			m->setSpecularCoeff(0.5f, 1.f, 0.5f);
-			g_Scene.addObject(Sphere::CreateGeometricObject(glm::vec3(1.f, 1.f, 1.f), 1.f, m));
-		}
+	CreateSpherePyramidScene(g_Scene);
 
-		// rear right
-		{
-			DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
-			m->setDiffuseCoeff(0.5f, 1.f, 0.5f);
-			g_Scene.addObject(Sphere::CreateGeometricObject(glm::vec3(-1.f, 1.f, -1.f), 1.f, m));
-		}
+	g_PathTracer.setIntermediateFrameCallback([]()
+	{
+		g_PathTracer.updateFrameBufferTexture();
 
-		// rear right
+		if (!g_KeepTracing)
 		{
-			DiffuseMaterial* m = DiffuseMaterial::CreateMaterial();
-			m->setDiffuseCoeff(0.5f, 0.5f, 1.f);
-			g_Scene.addObject(Sphere::CreateGeometricObject(glm::vec3(1.f, 1.f, -1.f), 1.f, m));
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			g_PathTracer.renderFrame();
+			glfwSwapBuffers(g_pWindow);
 		}
-	}
+	});
 }
 
 int main() {
@@ -266,6 +282,8 @@ int main() {
 
 	bool displayXYZAxes = false;
 
+	g_RenderSettings.load();
+
 	while (!glfwWindowShouldClose(g_pWindow)) {
 		glfwPollEvents();
 
@@ -274,10 +292,22 @@ int main() {
 		glClearColor(0.45f, 0.55f, 0.60f, 1.00f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		if (g_DisplayPathTracedResult)
+		if (!g_DisplayPathTracedResult || !g_ProgressiveRendering)
+			g_PathTracer.stopBackgroundRendering();
+
+		if (g_DisplayPathTracedResult && g_ProgressiveRendering)
+		{
+			if (g_RestartRendering || g_PathTracer.isBackgroundRenderingOutdated(g_Camera, g_WindowWidth, g_WindowHeight, g_ProjMatrix))
+				g_PathTracer.startBackgroundRendering(g_Scene, g_Camera, g_WindowWidth, g_WindowHeight, g_ProjMatrix);
+			g_RestartRendering = false;
+
+			g_PathTracer.updatePublishedFrameTexture();
+			g_PathTracer.renderFrame();
+		}
+		else if (g_DisplayPathTracedResult)
 		{
 			if (g_KeepTracing)
-				g_PathTracer.renderScene();
+				g_PathTracer.renderScene(g_Scene, g_Camera, g_WindowWidth, g_WindowHeight, g_ProjMatrix);
 			g_PathTracer.renderFrame();
 		}
 		else
@@ -297,7 +327,7 @@ int main() {
 				glEnd();
 			}
 
-			g_Scene.drawGL();
+			g_Scene.drawGL(g_Camera.transform());
 		}
 
 		CheckGLError(__FUNCTION__, __FILE__, __LINE__);
@@ -323,18 +353,66 @@ int main() {
 					"Opening an environment map", "", 4, lFilterPatterns, "Environment map (*.jpg;*.png;*.hdr;*.exr)", 0);
 
 				if (lTheOpenFileName)
+				{
+					// the scene must not change under the background rendering
+					g_PathTracer.stopBackgroundRendering();
 					g_Scene.loadEnvironmentMap(lTheOpenFileName);
+					g_RestartRendering = true;
+				}
+			}
+
+			// the background rendering reads all of these settings, so a change restarts it
+			bool settingsChanged = false;
+
+			settingsChanged |= ImGui::SliderInt("Max Recursion Depth", &g_RenderSettings.m_MaxRecursionDepth, 0, 64);
+			settingsChanged |= ImGui::SliderInt("Min Recursion Depth", &g_RenderSettings.m_MinRecursionDepth, 0, 64);
+			settingsChanged |= ImGui::SliderInt("# Samples Per Pixel", &g_RenderSettings.m_NumSamplesPerPixel, 1, 4096);
+			settingsChanged |= ImGui::SliderInt("# Samples Per Update", &g_RenderSettings.m_NumSamplesPerUpdate, 1, 4096);
+			settingsChanged |= ImGui::SliderInt("Tile Size", &g_RenderSettings.m_TileSize, 4, 128);
+			settingsChanged |= ImGui::SliderInt("# Threads (0: auto)", &g_RenderSettings.m_NumThreads, 0, 256);
+			settingsChanged |= ImGui::Checkbox("Report Tile Times", &g_RenderSettings.m_ReportTileTimes);
+			settingsChanged |= ImGui::Checkbox("Packet Tracing (2x2)", &g_RenderSettings.m_UsePacketTracing);
+			settingsChanged |= ImGui::Checkbox("Wavefront Integrator", &g_RenderSettings.m_UseWavefront);
+			settingsChanged |= ImGui::Checkbox("Environment Light Sampling", &g_RenderSettings.m_UseEnvironmentSampling);
+			settingsChanged |= ImGui::Checkbox("Light Source Sampling", &g_RenderSettings.m_UseLightSampling);
+			settingsChanged |= ImGui::Checkbox("Ray Cone Filtering", &g_RenderSettings.m_UseRayCones);
+			settingsChanged |= ImGui::Checkbox("Denoiser", &g_RenderSettings.m_UseDenoiser);
+
+			settingsChanged |= ImGui::Combo("Sampler", &g_RenderSettings.m_SamplerType, "Independent\0Owen-Scrambled Sobol\0");
+
+			settingsChanged |= ImGui::Checkbox("Spectral Dispersion", &g_RenderSettings.m_UseSpectralDispersion);
+			settingsChanged |= ImGui::SliderInt("Fresnel Split Depth (-1: none)", &g_RenderSettings.m_FresnelSplitDepth, -1, 8);
+
+			settingsChanged |= ImGui::Checkbox("Adaptive Sampling", &g_RenderSettings.m_UseAdaptiveSampling);
+			settingsChanged |= ImGui::SliderFloat("Adaptive Error Threshold", &g_RenderSettings.m_AdaptiveErrorThreshold, 0.001f, 0.2f, "%.3f");
+			settingsChanged |= ImGui::SliderInt("Min Adaptive Samples", &g_RenderSettings.m_MinAdaptiveSamples, 2, 256);
+			settingsChanged |= ImGui::SliderInt("Max Adaptive Samples Scale", &g_RenderSettings.m_MaxAdaptiveSamplesScale, 1, 64);
+
+			if (settingsChanged)
+			{
+				g_PathTracer.stopBackgroundRendering();
+				g_RenderSettings.apply();
+				g_RestartRendering = true;
+			}
+
+			// changes only the display: a running rendering shows it from its next pass on
+			bool displaySampleCountHeatmap = PathTracer::s_DisplaySampleCountHeatmap;
+			if (ImGui::Checkbox("Display Sample Count Heatmap", &displaySampleCountHeatmap))
+			{
+				PathTracer::s_DisplaySampleCountHeatmap = displaySampleCountHeatmap;
+				g_PathTracer.updateFrameBufferTexture();
 			}
 
-			ImGui::SliderInt("Max Recursion Depth", &PathTracer::s_MaxRecursionDepth, 0, 64);
-			ImGui::SliderInt("Min Recursion Depth", &PathTracer::s_MinRecursionDepth, 0, 64);
-			ImGui::SliderInt("# Samples Per Pixel", &PathTracer::s_NumSamplesPerPixel, 1, 4096);
-			ImGui::SliderInt("# Samples Per Update", &PathTracer::s_NumSamplesPerUpdate, 1, 4096);
+			ImGui::Checkbox("Progressive Rendering (Background)", &g_ProgressiveRendering);
 
 			if (ImGui::Button("Render"))
 			{
 				g_DisplayPathTracedResult = true;
-				g_PathTracer.renderScene();
+
+				if (g_ProgressiveRendering)
+					g_RestartRendering = true;
+				else
+					g_PathTracer.renderScene(g_Scene, g_Camera, g_WindowWidth, g_WindowHeight, g_ProjMatrix);
 			}
 
 			ImGui::Checkbox("Display Path Traced Result", &g_DisplayPathTracedResult);
@@ -351,8 +429,11 @@ int main() {
 		glfwSwapBuffers(g_pWindow);
 	}
 
+	g_PathTracer.stopBackgroundRendering();
+
 	GeometricObject::ClearGeometricObjectCache();
 	Material::ClearMaterialCache();
+	Texture::ClearTextureCache();
 
 	ImGui_ImplOpenGL2_Shutdown();
 	//ImGui_ImplOpenGL3_Shutdown();